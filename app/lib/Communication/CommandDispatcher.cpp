@@ -0,0 +1,69 @@
+#include "CommandDispatcher.h"
+
+namespace Communication {
+
+CommandDispatcher::CommandDispatcher() :
+  _invalidHandler(nullptr),
+  _unknownHandler(nullptr) {
+
+  for (size_t i = 0; i < 256; i++) {
+    _entries[i].handler = nullptr;
+    _entries[i].minLength = 1;
+  }
+}
+
+bool CommandDispatcher::registerHandler(SPICommand command, CommandHandler handler, uint16_t minLength) {
+  if (!handler || minLength == 0) {
+    return false;
+  }
+
+  Entry& entry = _entries[static_cast<uint8_t>(command)];
+  entry.handler = handler;
+  entry.minLength = minLength;
+  return true;
+}
+
+void CommandDispatcher::unregisterHandler(SPICommand command) {
+  Entry& entry = _entries[static_cast<uint8_t>(command)];
+  entry.handler = nullptr;
+  entry.minLength = 1;
+}
+
+bool CommandDispatcher::isRegistered(SPICommand command) const {
+  return _entries[static_cast<uint8_t>(command)].handler != nullptr;
+}
+
+void CommandDispatcher::setInvalidHandler(CommandHandler handler) {
+  _invalidHandler = handler;
+}
+
+void CommandDispatcher::setUnknownHandler(CommandHandler handler) {
+  _unknownHandler = handler;
+}
+
+bool CommandDispatcher::dispatch(const uint8_t* data, size_t length) const {
+  if (!data || length == 0) {
+    return false;
+  }
+
+  const Entry& entry = _entries[data[0]];
+  if (!entry.handler) {
+    if (_unknownHandler) {
+      _unknownHandler(data, length);
+    }
+    return false;
+  }
+
+  // Handlers can read their fixed fields without checking the length again
+  if (length < entry.minLength) {
+    if (_invalidHandler) {
+      _invalidHandler(data, length);
+    }
+    return false;
+  }
+
+  entry.handler(data, length);
+  return true;
+}
+
+} // namespace Communication
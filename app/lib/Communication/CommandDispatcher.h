@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+#include "SPIProtocol.h"
+
+namespace Communication {
+
+/**
+ * @brief Handler of one SPI command
+ * @param data Received packet, data[0] is the command byte
+ * @param length Length of the packet, at least the registered minimum length
+ */
+typedef void (*CommandHandler)(const uint8_t* data, size_t length);
+
+/**
+ * @brief Table-driven dispatch of received packets by their command byte
+ *
+ * One entry per possible command byte holds the handler and the shortest
+ * packet the command accepts, so validation and dispatch are a single table
+ * lookup whatever the number of registered commands. Nothing is allocated.
+ *
+ * Usage example:
+ * dispatcher.registerHandler(SPICommand::CAMERA_DATA_BLOCK_REQUEST, onBlockRequest, 3);
+ * dispatcher.setInvalidHandler(sendFormatNack);
+ * dispatcher.dispatch(data, length);
+ */
+class CommandDispatcher {
+public:
+  /**
+   * @brief Constructor, starts with no handlers registered
+   */
+  CommandDispatcher();
+
+  /**
+   * @brief Register the handler of a command, replacing any previous one
+   * @param command The command
+   * @param handler Function called with packets of this command
+   * @param minLength Shortest valid packet including the command byte
+   * @return true if registered, false if the handler is null or minLength is 0
+   */
+  bool registerHandler(SPICommand command, CommandHandler handler, uint16_t minLength = 1);
+
+  /**
+   * @brief Remove the handler of a command
+   * @param command The command
+   */
+  void unregisterHandler(SPICommand command);
+
+  /**
+   * @brief Check if a command has a handler
+   * @param command The command
+   * @return true if a handler is registered
+   */
+  bool isRegistered(SPICommand command) const;
+
+  /**
+   * @brief Set the handler of packets shorter than their command's minimum length
+   * @param handler Function called with the short packet, nullptr to drop them
+   */
+  void setInvalidHandler(CommandHandler handler);
+
+  /**
+   * @brief Set the handler of commands nobody registered
+   * @param handler Function called with the packet, nullptr to drop them
+   */
+  void setUnknownHandler(CommandHandler handler);
+
+  /**
+   * @brief Hand a packet to the handler of its command
+   * @param data Received packet
+   * @param length Length of the packet
+   * @return true if the registered handler of the command ran, false otherwise
+   */
+  bool dispatch(const uint8_t* data, size_t length) const;
+
+private:
+  struct Entry {
+    CommandHandler handler;
+    uint16_t minLength;
+  };
+
+  Entry _entries[256];
+  CommandHandler _invalidHandler;
+  CommandHandler _unknownHandler;
+};
+
+} // namespace Communication
@@ -0,0 +1,202 @@
+#include "SPIBulkChannel.h"
+#include "lib/Utils/Memory.h"
+
+namespace Communication {
+
+// Channel task timing
+static const uint32_t CHANNEL_TASK_POLL_MS = 10;  // Check for finished segments while others are still queued
+
+SPIBulkChannel::SPIBulkChannel(size_t segmentSize) :
+  _segmentSize(segmentSize & ~(size_t)3),
+  _host(SPI2_HOST),
+  _lineCount(0),
+  _initialized(false),
+  _filler(nullptr),
+  _segmentCount(0),
+  _taskHandle(nullptr) {
+
+  for (int i = 0; i < SPI_BULK_SEGMENT_BUFFERS; i++) {
+    _buffers[i] = nullptr;
+  }
+}
+
+SPIBulkChannel::~SPIBulkChannel() {
+  end();
+
+  for (int i = 0; i < SPI_BULK_SEGMENT_BUFFERS; i++) {
+    Utils::Memory::release(_buffers[i]);
+    _buffers[i] = nullptr;
+  }
+}
+
+bool SPIBulkChannel::init(spi_host_device_t host, int sckPin, int csPin, int data0Pin, int data1Pin,
+                          int data2Pin, int data3Pin, uint8_t mode) {
+#if SOC_SPI_SUPPORT_SLAVE_HD_VER2
+  if (_initialized) {
+    return true;
+  }
+
+  if (sckPin < 0 || csPin < 0 || data0Pin < 0 || data1Pin < 0) {
+    LOG_ERROR(SPI, "SPIBulkChannel: Pins not configured");
+    return false;
+  }
+
+  // The buffers are handed to DMA as they are, keep them in internal memory
+  for (int i = 0; i < SPI_BULK_SEGMENT_BUFFERS; i++) {
+    if (!_buffers[i]) {
+      _buffers[i] = (uint8_t*) Utils::Memory::allocate(_segmentSize, Utils::MemoryPlacement::Dma);
+    }
+    if (!_buffers[i]) {
+      LOG_ERROR(SPI, "SPIBulkChannel: Failed to allocate segment buffer %d", i);
+      return false;
+    }
+  }
+
+  // Only the lines given are claimed, the master picks dual or quad I/O per command
+  _lineCount = (data2Pin >= 0 && data3Pin >= 0) ? 4 : 2;
+  spi_bus_config_t busConfig = {};
+  busConfig.mosi_io_num = data0Pin;
+  busConfig.miso_io_num = data1Pin;
+  busConfig.sclk_io_num = sckPin;
+  busConfig.quadwp_io_num = _lineCount == 4 ? data2Pin : -1;
+  busConfig.quadhd_io_num = _lineCount == 4 ? data3Pin : -1;
+  busConfig.max_transfer_sz = _segmentSize;
+  busConfig.flags = _lineCount == 4 ? SPICOMMON_BUSFLAG_QUAD : SPICOMMON_BUSFLAG_DUAL;
+
+  // Segment mode: every queued transaction is one RDDMA segment for the master
+  spi_slave_hd_slot_config_t slotConfig = {};
+  slotConfig.spics_io_num = csPin;
+  slotConfig.flags = 0;
+  slotConfig.mode = mode;
+  slotConfig.command_bits = 8;
+  slotConfig.address_bits = 8;
+  slotConfig.dummy_bits = 8;
+  slotConfig.queue_size = SPI_BULK_SEGMENT_BUFFERS;
+  slotConfig.dma_chan = SPI_DMA_CH_AUTO;
+
+  esp_err_t ret = spi_slave_hd_init(host, &busConfig, &slotConfig);
+  if (ret != ESP_OK) {
+    LOG_ERROR(SPI, "SPIBulkChannel: Failed to initialize half-duplex slave driver: %d", ret);
+    return false;
+  }
+  _host = host;
+
+  // Same priority as the recycle task of the command bus, both only move buffers
+  if (xTaskCreatePinnedToCore(channelTask, "spi_bulk", 3072, this, configMAX_PRIORITIES - 2,
+                              &_taskHandle, xPortGetCoreID()) != pdPASS) {
+    LOG_ERROR(SPI, "SPIBulkChannel: Failed to create channel task");
+    _taskHandle = nullptr;
+    spi_slave_hd_deinit(_host);
+    return false;
+  }
+
+  _segmentCount = 0;
+  _initialized = true;
+  LOG_INFO(SPI, "SPIBulkChannel: %d-line bus on host %d, SCK=%d, CS=%d, %d byte segments",
+           _lineCount, host, sckPin, csPin, _segmentSize);
+  return true;
+#else
+  LOG_ERROR(SPI, "SPIBulkChannel: No half-duplex slave driver on this target");
+  return false;
+#endif
+}
+
+void SPIBulkChannel::end() {
+#if SOC_SPI_SUPPORT_SLAVE_HD_VER2
+  if (!_initialized) {
+    return;
+  }
+
+  _initialized = false;
+  if (_taskHandle) {
+    vTaskDelete(_taskHandle);
+    _taskHandle = nullptr;
+  }
+  spi_slave_hd_deinit(_host);
+  _lineCount = 0;
+#endif
+}
+
+bool SPIBulkChannel::isInitialized() const {
+  return _initialized;
+}
+
+void SPIBulkChannel::setFiller(SegmentFiller filler) {
+  _filler = filler;
+  notify();
+}
+
+void SPIBulkChannel::notify() {
+  if (_taskHandle) {
+    xTaskNotifyGive(_taskHandle);
+  }
+}
+
+size_t SPIBulkChannel::getSegmentSize() const {
+  return _segmentSize;
+}
+
+uint8_t SPIBulkChannel::getLineCount() const {
+  return _lineCount;
+}
+
+uint32_t SPIBulkChannel::getSegmentCount() const {
+  return _segmentCount;
+}
+
+void SPIBulkChannel::channelTask(void* parameter) {
+#if SOC_SPI_SUPPORT_SLAVE_HD_VER2
+  SPIBulkChannel* channel = static_cast<SPIBulkChannel*>(parameter);
+  uint8_t next = 0;    // Segments complete in the order they were queued, so buffers are used in turn
+  uint8_t queued = 0;
+
+  while (true) {
+    // Take back the buffers of segments the master has read
+    spi_slave_hd_data_t* done;
+    while (queued > 0 && spi_slave_hd_get_trans_res(channel->_host, SPI_SLAVE_CHAN_TX, &done, 0) == ESP_OK) {
+      queued--;
+      channel->_segmentCount++;
+    }
+
+    SegmentFiller filler = channel->_filler;
+    if (queued < SPI_BULK_SEGMENT_BUFFERS && filler) {
+      uint8_t* buffer = channel->_buffers[next];
+      size_t length = filler(buffer, channel->_segmentSize);
+      if (length > 0) {
+        // DMA moves whole words, the padding is zeros
+        size_t padded = (length + 3) & ~(size_t)3;
+        memset(buffer + length, 0, padded - length);
+
+        spi_slave_hd_data_t& segment = channel->_segments[next];
+        memset(&segment, 0, sizeof(segment));
+        segment.data = buffer;
+        segment.len = padded;
+
+        if (spi_slave_hd_queue_trans(channel->_host, SPI_SLAVE_CHAN_TX, &segment, portMAX_DELAY) == ESP_OK) {
+          queued++;
+          next = (next + 1) % SPI_BULK_SEGMENT_BUFFERS;
+        } else {
+          LOG_ERROR(SPI, "SPIBulkChannel: Failed to queue segment");
+        }
+        continue;
+      }
+    }
+
+    // Every buffer is queued, wait for the master to read one
+    if (queued == SPI_BULK_SEGMENT_BUFFERS) {
+      if (spi_slave_hd_get_trans_res(channel->_host, SPI_SLAVE_CHAN_TX, &done, portMAX_DELAY) == ESP_OK) {
+        queued--;
+        channel->_segmentCount++;
+      }
+      continue;
+    }
+
+    // Nothing to send, sleep until notify() or a queued segment may have finished
+    ulTaskNotifyTake(pdTRUE, queued > 0 ? pdMS_TO_TICKS(CHANNEL_TASK_POLL_MS) : portMAX_DELAY);
+  }
+#else
+  vTaskDelete(nullptr);
+#endif
+}
+
+} // namespace Communication
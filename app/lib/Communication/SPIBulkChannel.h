@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "Config.h"
+#include "lib/Utils/Logger.h"
+#include <soc/soc_caps.h>
+#include <driver/spi_slave.h>
+
+#if SOC_SPI_SUPPORT_SLAVE_HD_VER2
+#include <driver/spi_slave_hd.h>
+#endif
+
+// Number of segments queued in the half-duplex driver at once, each with its own DMA buffer
+#ifndef SPI_BULK_SEGMENT_BUFFERS
+#define SPI_BULK_SEGMENT_BUFFERS 2
+#endif
+
+namespace Communication {
+
+/**
+ * @brief Wide data bus for bulk transfers next to the command bus
+ *
+ * Runs the spi_slave_hd half-duplex driver on a second SPI host, where the
+ * master reads each queued segment with a dual or quad I/O RDDMA command.
+ * Commands and their responses stay on SPISlaveHandler, this channel only
+ * carries data the master asked for over there.
+ *
+ * A task keeps the driver queue full: every time a segment buffer is free it
+ * asks the filler for the next segment, and sleeps in notify() otherwise.
+ * The half-duplex driver only exists on targets with SOC_SPI_SUPPORT_SLAVE_HD_VER2
+ * such as the ESP32-S3, on others init() fails.
+ */
+class SPIBulkChannel {
+public:
+  /**
+   * @brief Callback that writes the next segment into a DMA buffer
+   * Called from the channel task, it may take locks but should not block for long
+   * @param buffer DMA buffer of the segment
+   * @param capacity Size of the buffer in bytes
+   * @return Number of bytes written, 0 if there is nothing to send
+   */
+  typedef size_t (*SegmentFiller)(uint8_t* buffer, size_t capacity);
+
+  /**
+   * @brief Constructor
+   * @param segmentSize Size of each segment buffer, a multiple of 4
+   */
+  explicit SPIBulkChannel(size_t segmentSize);
+
+  /**
+   * @brief Destructor
+   */
+  ~SPIBulkChannel();
+
+  /**
+   * @brief Initialize the half-duplex slave with its own pins
+   * @param host SPI host, must not be the one of the command bus
+   * @param sckPin SCK pin number
+   * @param csPin CS pin number
+   * @param data0Pin Data line 0, MOSI in single-line mode
+   * @param data1Pin Data line 1, MISO in single-line mode
+   * @param data2Pin Data line 2, -1 for a dual bus
+   * @param data3Pin Data line 3, -1 for a dual bus
+   * @param mode SPI mode (0-3)
+   * @return true if initialization was successful, false otherwise
+   */
+  bool init(spi_host_device_t host, int sckPin, int csPin, int data0Pin, int data1Pin,
+            int data2Pin, int data3Pin, uint8_t mode = SPI_MODE0);
+
+  /**
+   * @brief Stop the channel task and free the driver
+   */
+  void end();
+
+  /**
+   * @brief Check if the channel is running
+   * @return true after a successful init()
+   */
+  bool isInitialized() const;
+
+  /**
+   * @brief Set the source of the segments
+   * @param filler Filler callback, or nullptr to send nothing
+   */
+  void setFiller(SegmentFiller filler);
+
+  /**
+   * @brief Tell the channel task the filler has data again
+   */
+  void notify();
+
+  /**
+   * @brief Get the size of a segment buffer
+   * @return Largest segment in bytes
+   */
+  size_t getSegmentSize() const;
+
+  /**
+   * @brief Get the number of data lines of the bus
+   * @return 2 or 4, 0 before init()
+   */
+  uint8_t getLineCount() const;
+
+  /**
+   * @brief Get the number of segments the master read
+   * @return Segments completed since init()
+   */
+  uint32_t getSegmentCount() const;
+
+private:
+  size_t _segmentSize;
+  uint8_t* _buffers[SPI_BULK_SEGMENT_BUFFERS];
+  spi_host_device_t _host;
+  uint8_t _lineCount;
+  volatile bool _initialized;
+  volatile SegmentFiller _filler;
+  volatile uint32_t _segmentCount;
+  TaskHandle_t _taskHandle;
+
+#if SOC_SPI_SUPPORT_SLAVE_HD_VER2
+  spi_slave_hd_data_t _segments[SPI_BULK_SEGMENT_BUFFERS];
+#endif
+
+  // Task that queues segments as buffers come back from the driver
+  static void channelTask(void* parameter);
+};
+
+} // namespace Communication
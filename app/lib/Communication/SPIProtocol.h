@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Communication {
+
+/**
+ * @brief Command codes for SPI communication
+ * These must match with the master device
+ */
+enum class SPICommand : uint8_t {
+  NOP = 0x00,                        // Master only clocks out the pending response
+  PING = 0x01,
+  PONG = 0x02,
+  CAMERA_DATA_REQUEST = 0x20,        // New command for requesting camera data
+  CAMERA_DATA_RESPONSE = 0x21,       // Response with camera data
+  CAMERA_DATA_BLOCK_REQUEST = 0x22,  // Request for a specific block of camera data
+  CAMERA_DATA_BLOCK_RESPONSE = 0x23, // Response with a specific block of camera data
+  BLOCK_NACK_BITMAP = 0x24,          // Bitmap of damaged blocks to send again
+  CAMERA_FRAME_FETCH = 0x25,         // Make a frame of the ring current by its sequence number
+  FRAME_RING_STATUS_REQUEST = 0x26,  // Request the sequence range and loss counters of the ring
+  FRAME_RING_STATUS_RESPONSE = 0x27, // Response with the frame ring status
+  SPOOL_CONTROL = 0x28,              // Stop, start or clear the flash frame spool
+  SPOOL_FETCH = 0x29,                // Make a spooled frame current by its position in the spool
+  SPOOL_STATUS_REQUEST = 0x2A,       // Request the frame count and fill level of the spool
+  SPOOL_STATUS_RESPONSE = 0x2B,      // Response with the spool status
+  CAMERA_PREVIEW_REQUEST = 0x2C,     // Make a downscaled copy of a captured frame current
+  CAMERA_ROI_REQUEST = 0x2D,         // Make a cropped part of a captured frame current
+  CHANGE_DETECT_CONFIG = 0x2E,       // Turn change detection on or off and set its threshold
+  BUFFER_STATUS_REQUEST = 0x30,      // New command to check buffer status
+  BUFFER_STATUS_RESPONSE = 0x31,     // Response with buffer status
+  TELEMETRY_REQUEST = 0x32,          // Request the counters and latency histograms
+  TELEMETRY_RESPONSE = 0x33,         // Response with the telemetry record
+  CAMERA_CONFIG = 0x34,              // Switch the camera to a preset or to given settings
+  CAMERA_CONFIG_RESPONSE = 0x35,     // Response with the active camera settings
+  QUALITY_TARGET = 0x36,             // Keep frames under a byte budget by adjusting the JPEG quality
+  TIME_SYNC = 0x37,                  // Exchange clock readings to map slave timestamps to the master clock
+  TIME_SYNC_RESPONSE = 0x38,         // Response with the echoed master time and the slave receive time
+  FRAME_TIMING_REQUEST = 0x39,       // Request the stage timestamps of the last sent frame
+  FRAME_TIMING_RESPONSE = 0x3A,      // Response with the stage timestamps of a frame
+  CAMERA_DATA_MULTI_BLOCK_REQUEST = 0x3B,  // Request consecutive blocks packed into one transaction
+  CAMERA_DATA_MULTI_BLOCK_RESPONSE = 0x3C, // Response with several blocks, each with its own header
+  BULK_READ_REQUEST = 0x3D,          // Queue blocks of the current frame on the wide bulk bus
+  BULK_READ_RESPONSE = 0x3E,         // Response with the blocks queued on the bulk bus
+  STREAM_START = 0x40,               // Slave pushes frame headers and blocks without per-block requests
+  STREAM_STOP = 0x41,                // Back to request/response mode
+  SET_TRANSFER_PARAMS = 0x50,        // Negotiate block size and transaction length
+  TRANSFER_PARAMS_RESPONSE = 0x51,   // Response with the accepted transfer parameters
+  BENCH_SET_FRAMESIZE = 0x60,        // Benchmark builds only: change the camera resolution
+  ACK = 0xAA,
+  NACK = 0xFF
+};
+
+// Enhanced response codes
+enum class SPIResponseCode : uint8_t {
+  OK = 0x00,
+  INVALID_FORMAT = 0x04,  // Packet shorter than the command requires
+  INCOMPLETE_PACKET = 0x10,
+  LENGTH_MISMATCH = 0x11,
+  CHECKSUM_ERROR = 0x12,
+  BUFFER_FULL = 0x20,     // Added for flow control
+  NOT_READY = 0x21,       // Added for flow control
+  CAMERA_NOT_AVAILABLE = 0x30,
+  CAMERA_CAPTURE_FAILED = 0x31,
+  INVALID_BLOCK_INDEX = 0x32,
+  MEMORY_ERROR = 0x40,
+};
+
+} // namespace Communication
@@ -1,11 +1,25 @@
 #include "SPISlaveHandler.h"
 #include <esp_system.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
 
 namespace Communication {
 
+static_assert(SPI_BUFFER_POOL_SIZE > SPI_TRANSACTION_SLOTS,
+              "Buffer pool must hold a receive buffer for every slot plus queued packets");
+static_assert(SPI_RECEIVE_QUEUE_SIZE >= SPI_BUFFER_POOL_SIZE,
+              "Receive queue must be able to hold every pool buffer");
+
+// Transmit and receive buffer of every slot plus one spare receive buffer
+static const uint8_t SPI_INITIAL_DMA_BUFFERS = 2 * SPI_TRANSACTION_SLOTS + 1;
+
 // Static instance pointer for access in ISR callbacks
 static SPISlaveHandler* s_instance = nullptr;
 
+// Protocol task timing
+static const uint32_t PROTOCOL_TASK_IDLE_MS = 100;        // Wake up for housekeeping without packets
+static const unsigned long WATCHDOG_CHECK_INTERVAL = 15000; // Stalled transaction check interval
+
 SPISlaveHandler& SPISlaveHandler::getInstance() {
   static SPISlaveHandler instance;
   return instance;
@@ -13,17 +27,33 @@ SPISlaveHandler& SPISlaveHandler::getInstance() {
 
 SPISlaveHandler::SPISlaveHandler() : 
   _txBuffer(nullptr), 
-  _rxBuffer(nullptr), 
   _bufferSize(SPI_BUFFER_SIZE), // Default buffer size
+  _transactionLength(SPI_BUFFER_SIZE),
   _txLength(0),
+  _txGeneration(0),
   _dataReady(false),
+  _txMutex(nullptr),
   _needsNewTransaction(false),
+  _completedSlots(nullptr),
+  _recycleTaskHandle(nullptr),
   _lastTransactionTime(0),
   _transactionTimeout(3000), // 3 seconds timeout
   _transactionActive(false),
   _transactionCount(0),
   _recoveryAttempts(0),
+  _dmaBuffers("spi-dma", SPI_BUFFER_SIZE, SPI_BUFFER_POOL_SIZE + SPI_TRANSACTION_SLOTS, Utils::MemoryPlacement::Dma),
+  _droppedPackets(0),
+  _receiveQueueHighWater(0),
+  _receiveTime(0),
+  _sentGeneration(0),
+  _reportedDrops(0),
   _receiveCallback(nullptr),
+  _consumerTask(nullptr),
+  _transmitFiller(nullptr),
+  _streamSlotsQueued(0),
+  _fillerWakeups(0),
+  _handshakePin(-1),
+  _protocolTaskHandle(nullptr),
   _initialized(false),
   _sckPin(0),
   _misoPin(0),
@@ -32,37 +62,60 @@ SPISlaveHandler::SPISlaveHandler() :
   _mode(SPI_MODE0),
   _mux(portMUX_INITIALIZER_UNLOCKED) {
   
-  _logger = &Utils::Logger::getInstance();
+  _dispatcher.registerHandler(SPICommand::PING, respondToPing);
+  _dispatcher.setInvalidHandler(rejectShortPacket);
   
-  // Create semaphore for queue access
-  _queueSemaphore = xSemaphoreCreateMutex();
-  if (!_queueSemaphore) {
-    _logger->error("SPISlaveHandler: Failed to create queue semaphore");
+  // The slots need their buffers as long as the driver runs, the ISR one spare receive buffer
+  // More spare buffers are only added once packets pile up, see processNextReceive()
+  if (!_dmaBuffers.reserve(SPI_INITIAL_DMA_BUFFERS)) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Only %d of %d DMA buffers allocated", _dmaBuffers.getAllocatedCount(),
+              SPI_INITIAL_DMA_BUFFERS);
   }
   
   // Allocate DMA-capable buffer pool
-  for (int i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
-    _bufferPool[i].data = (uint8_t*) heap_caps_malloc(_bufferSize, MALLOC_CAP_DMA | MALLOC_CAP_DEFAULT);
-    _bufferPool[i].inUse = false;
+  for (int i = 0; i < SPI_TRANSACTION_SLOTS + 1; i++) {
+    _bufferPool[i].data = (uint8_t*) _dmaBuffers.acquire();
     
     if (!_bufferPool[i].data) {
-      _logger->error("SPISlaveHandler: Failed to allocate buffer %d for pool", i);
+      LOG_ERROR(SPI, "SPISlaveHandler: Failed to allocate buffer %d for pool", i);
     } else {
       memset(_bufferPool[i].data, 0, _bufferSize);
     }
   }
   
-  // Allocate main transaction buffers
-  _txBuffer = (uint8_t*) heap_caps_malloc(_bufferSize, MALLOC_CAP_DMA | MALLOC_CAP_DEFAULT);
-  _rxBuffer = (uint8_t*) heap_caps_malloc(_bufferSize, MALLOC_CAP_DMA | MALLOC_CAP_DEFAULT);
+  // Allocate the staging buffer for outgoing responses, only the CPU copies out of it
+  _txBuffer = (uint8_t*) Utils::Memory::allocate(_bufferSize, Utils::MemoryPlacement::Internal);
+  
+  if (!_txBuffer) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to allocate buffers");
+  } else {
+    memset(_txBuffer, 0, _bufferSize);
+  }
+  
+  // Allocate the transaction ring, every slot gets its own DMA buffers
+  // Receive buffers come from the pool so they can be handed to the consumer without a copy
+  for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+    _slots[i].txBuffer = (uint8_t*) _dmaBuffers.acquire();
+    
+    if (!_slots[i].txBuffer) {
+      LOG_ERROR(SPI, "SPISlaveHandler: Failed to allocate buffers for transaction slot %d", i);
+    } else {
+      memset(_slots[i].txBuffer, 0, _bufferSize);
+    }
+  }
+  resetBufferPool();
   
-  if (!_txBuffer || !_rxBuffer) {
-    _logger->error("SPISlaveHandler: Failed to allocate buffers");
+  // Staging and the slot copy take turns on the staged response, the ISR never touches it
+  _txMutex = xSemaphoreCreateMutex();
+  if (!_txMutex) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to create staging mutex");
   }
   
-  // Clear the buffers
-  memset(_txBuffer, 0, _bufferSize);
-  memset(_rxBuffer, 0, _bufferSize);
+  // Completed slots are handed from the ISR to the recycle task through this queue
+  _completedSlots = xQueueCreate(SPI_TRANSACTION_SLOTS, sizeof(uint8_t));
+  if (!_completedSlots) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to create completed slot queue");
+  }
   
   // Save instance pointer for ISR callbacks
   s_instance = this;
@@ -74,69 +127,73 @@ SPISlaveHandler::~SPISlaveHandler() {
     spi_slave_free(HSPI_HOST);
   }
   
-  // Clean up buffers
-  if (_txBuffer) {
-    heap_caps_free(_txBuffer);
+  // Stop the tasks
+  if (_protocolTaskHandle) {
+    vTaskDelete(_protocolTaskHandle);
   }
   
-  if (_rxBuffer) {
-    heap_caps_free(_rxBuffer);
+  if (_recycleTaskHandle) {
+    vTaskDelete(_recycleTaskHandle);
   }
   
-  // Free buffer pool
-  for (int i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
-    if (_bufferPool[i].data) {
-      heap_caps_free(_bufferPool[i].data);
-      _bufferPool[i].data = nullptr;
-    }
+  if (_completedSlots) {
+    vQueueDelete(_completedSlots);
+  }
+  
+  if (_txMutex) {
+    vSemaphoreDelete(_txMutex);
   }
   
-  // Delete semaphore
-  if (_queueSemaphore) {
-    vSemaphoreDelete(_queueSemaphore);
+  // Clean up buffers, the DMA pool frees its blocks itself
+  Utils::Memory::release(_txBuffer);
+  _txBuffer = nullptr;
+  
+  for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+    _dmaBuffers.release(_slots[i].txBuffer);
+    _slots[i].txBuffer = nullptr;
   }
   
-  // Clean up receive queue
-  while (!_receiveQueue.empty()) {
-    SPIDataPacket* packet = _receiveQueue.front();
-    _receiveQueue.pop();
-    delete packet;
+  // Free buffer pool
+  for (int i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
+    _dmaBuffers.release(_bufferPool[i].data);
+    _bufferPool[i].data = nullptr;
   }
 }
 
-// Get a buffer from the pool
-uint8_t* SPISlaveHandler::getBuffer() {
-  // Try to get a buffer from the pool first
-  for (int i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
-    if (!_bufferPool[i].inUse && _bufferPool[i].data) {
-      _bufferPool[i].inUse = true;
-      return _bufferPool[i].data;
+void SPISlaveHandler::resetBufferPool() {
+  _receiveQueue.reset();
+  _freeBuffers.reset();
+  
+  // The first buffers are bound to the slots, the rest wait for packets
+  for (uint8_t i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
+    if (i < SPI_TRANSACTION_SLOTS) {
+      _slots[i].rxBufferIndex = i;
+      _slots[i].rxBuffer = _bufferPool[i].data;
+    } else if (_bufferPool[i].data) {
+      _freeBuffers.push(i);
     }
   }
-  
-  // If no buffers available in pool, log warning and allocate a new one
-  _logger->warning("SPISlaveHandler: No buffers available in pool, allocating new buffer");
-  return (uint8_t*) heap_caps_malloc(_bufferSize, MALLOC_CAP_DMA | MALLOC_CAP_DEFAULT);
 }
 
-// Return a buffer to the pool
-void SPISlaveHandler::returnBuffer(uint8_t* buffer) {
-  // Check if buffer is from our pool
-  for (int i = 0; i < SPI_BUFFER_POOL_SIZE; i++) {
-    if (_bufferPool[i].data == buffer) {
-      _bufferPool[i].inUse = false;
-      memset(buffer, 0, _bufferSize); // Clear buffer for reuse
-      return;
+bool SPISlaveHandler::growBufferPool() {
+  for (uint8_t i = SPI_TRANSACTION_SLOTS; i < SPI_BUFFER_POOL_SIZE; i++) {
+    if (!_bufferPool[i].data) {
+      _bufferPool[i].data = (uint8_t*) _dmaBuffers.acquire();
+      if (!_bufferPool[i].data) {
+        return false;
+      }
+      _freeBuffers.push(i);
+      LOG_DEBUG(SPI, "SPISlaveHandler: Receive buffer %d added to the pool", i);
+      return true;
     }
   }
-  
-  // If not from pool, free it
-  heap_caps_free(buffer);
+  return false;
 }
 
 // Static callback handlers that work with the ESP32 SPI slave driver
 void IRAM_ATTR SPISlaveHandler::onSpiTransaction(spi_slave_transaction_t *trans) {
   if (!s_instance) return;
+  int64_t startTime = esp_timer_get_time();
   
   // Update transaction activity tracking
   s_instance->_lastTransactionTime = millis();
@@ -145,46 +202,60 @@ void IRAM_ATTR SPISlaveHandler::onSpiTransaction(spi_slave_transaction_t *trans)
   
   // Calculate the actual number of bytes received
   size_t rxBytes = trans->trans_len / 8;
-  if (rxBytes == 0) return;
-  
-  // Check if receive queue is getting full - drop packets if necessary for flow control
-  bool queueFull = s_instance->pendingReceiveCount() >= s_instance->_maxQueueSize;
-  
-  if (!queueFull) {
-    // Get a buffer from the pool for the packet
-    uint8_t* packetBuffer = s_instance->getBuffer();
-    
-    if (packetBuffer) {
-      // Copy data from rx buffer to packet buffer
-      memcpy(packetBuffer, trans->rx_buffer, rxBytes);
-      
-      // Create packet object using pooled buffer
-      SPIDataPacket* packet = new SPIDataPacket(packetBuffer, rxBytes);
+  uint8_t index = (uint8_t)(uintptr_t)trans->user;
+  SPITransactionSlot& slot = s_instance->_slots[index];
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  
+  if (rxBytes > 0) {
+    // Hand the filled buffer to the consumer and give the slot a free one,
+    // if none is free the consumer is behind and the packet is dropped
+    uint8_t freeIndex;
+    if (s_instance->_freeBuffers.pop(freeIndex)) {
+      SPIDataPacket packet = {slot.rxBufferIndex, rxBytes, startTime, slot.streamFilled ? 0 : slot.txGeneration};
+      s_instance->_receiveQueue.push(packet);
+      size_t queued = s_instance->_receiveQueue.size();
+      if (queued > s_instance->_receiveQueueHighWater) {
+        s_instance->_receiveQueueHighWater = queued;
+      }
       
-      // Return buffer to pool now that it's been copied to the packet
-      s_instance->returnBuffer(packetBuffer);
+      slot.rxBufferIndex = freeIndex;
+      slot.rxBuffer = s_instance->_bufferPool[freeIndex].data;
       
-      // Try to acquire semaphore for queue access
-      // Use ISR-safe version since we're in an interrupt
-      if (xSemaphoreTakeFromISR(s_instance->_queueSemaphore, NULL) == pdTRUE) {
-        s_instance->_receiveQueue.push(packet);
-        xSemaphoreGiveFromISR(s_instance->_queueSemaphore, NULL);
-      } else {
-        // If we can't get the semaphore, drop the packet
-        delete packet;
+      if (s_instance->_consumerTask) {
+        vTaskNotifyGiveFromISR(s_instance->_consumerTask, &higherPriorityTaskWoken);
       }
+    } else {
+      s_instance->_droppedPackets++;
     }
   }
   
-  // Clear the rx buffer for next transaction
-  memset(trans->rx_buffer, 0, s_instance->_bufferSize);
-  
   // Reset the data ready flag since the transaction is complete
   s_instance->_dataReady = false;
   
-  // Queue up another transaction
-  // We can't call ensureTransactionQueued from ISR, so set a flag
-  s_instance->_needsNewTransaction = true;
+  // Stream data has been clocked out, drop the handshake once none is left
+  portENTER_CRITICAL_ISR(&s_instance->_mux);
+  if (slot.streamFilled) {
+    slot.streamFilled = false;
+    if (--s_instance->_streamSlotsQueued == 0 && s_instance->_handshakePin >= 0) {
+      gpio_set_level((gpio_num_t)s_instance->_handshakePin, 0);
+    }
+  }
+  portEXIT_CRITICAL_ISR(&s_instance->_mux);
+  
+  // Hand the slot back to the recycle task so it is queued again right away
+  // We can't call spi_slave_queue_trans from ISR
+  slot.queued = false;
+  
+  if (xQueueSendFromISR(s_instance->_completedSlots, &index, &higherPriorityTaskWoken) != pdTRUE) {
+    // Fall back to re-queueing from the main loop
+    s_instance->_needsNewTransaction = true;
+  }
+  
+  s_instance->_isrTime.record(esp_timer_get_time() - startTime);
+  
+  if (higherPriorityTaskWoken) {
+    portYIELD_FROM_ISR();
+  }
 }
 
 void IRAM_ATTR SPISlaveHandler::onSpiPreTransaction(spi_slave_transaction_t *trans) {
@@ -195,9 +266,175 @@ void IRAM_ATTR SPISlaveHandler::onSpiPreTransaction(spi_slave_transaction_t *tra
   }
 }
 
+void SPISlaveHandler::recycleTask(void* parameter) {
+  SPISlaveHandler* handler = static_cast<SPISlaveHandler*>(parameter);
+  uint8_t index;
+  
+  while (true) {
+    if (xQueueReceive(handler->_completedSlots, &index, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    
+    if (!handler->_initialized) {
+      continue;
+    }
+    
+    // The driver queue has room for every slot, so this never has to wait
+    // Only this task asks the filler for data, so stream chunks go out in order
+    if (!handler->queueSlot(index, 0, true)) {
+      handler->_needsNewTransaction = true;
+    }
+  }
+}
+
+void SPISlaveHandler::protocolTask(void* parameter) {
+  SPISlaveHandler* handler = static_cast<SPISlaveHandler*>(parameter);
+  unsigned long lastWatchdogCheck = millis();
+  
+  while (true) {
+    // Sleep until the ISR queues a packet
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PROTOCOL_TASK_IDLE_MS));
+    
+    while (handler->processNextReceive()) {
+      // Each iteration processes one queued receive packet
+    }
+    
+    handler->ensureTransactionQueued();
+    
+    if (millis() - lastWatchdogCheck > WATCHDOG_CHECK_INTERVAL) {
+      lastWatchdogCheck = millis();
+      
+      if (handler->checkAndRecoverFromStalledTransaction()) {
+        LOG_WARNING(SPI, "SPISlaveHandler: Transaction watchdog triggered recovery action");
+      }
+    }
+  }
+}
+
+void SPISlaveHandler::refreshSlot(SPITransactionSlot& slot) {
+  xSemaphoreTake(_txMutex, portMAX_DELAY);
+  if (slot.txGeneration != _txGeneration) {
+    memcpy(slot.txBuffer, _txBuffer, _txLength);
+    
+    // Only clear what is left over from a longer previous response
+    if (slot.txLength > _txLength) {
+      memset(slot.txBuffer + _txLength, 0, slot.txLength - _txLength);
+    }
+    
+    slot.txLength = _txLength;
+    slot.txGeneration = _txGeneration;
+  }
+  xSemaphoreGive(_txMutex);
+}
+
+bool SPISlaveHandler::queueSlot(uint8_t index, TickType_t ticksToWait, bool useFiller) {
+  SPITransactionSlot& slot = _slots[index];
+  TransmitFiller filler = useFiller ? _transmitFiller : nullptr;
+  
+  // Claim the slot, the recycle task and the main loop fallback may race for it
+  portENTER_CRITICAL(&_mux);
+  if (slot.queued) {
+    portEXIT_CRITICAL(&_mux);
+    return true;
+  }
+  slot.queued = true;
+  slot.parked = false;
+  portEXIT_CRITICAL(&_mux);
+  
+  // The driver doesn't own the slot until it is queued below, so its buffer is written without the spinlock
+  // Let the stream source write straight into the slot, or copy in the staged response
+  size_t length = 0;
+  while (filler) {
+    uint32_t wakeups = _fillerWakeups;
+    length = filler(slot.txBuffer, _transactionLength);
+    if (length > 0) {
+      break;
+    }
+    
+    // Nothing to stream yet, park the slot as long as another one still listens for commands
+    // A wakeup while the filler ran means it may have data now, ask again
+    portENTER_CRITICAL(&_mux);
+    bool woken = wakeups != _fillerWakeups;
+    bool othersQueued = false;
+    for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+      othersQueued |= i != index && _slots[i].queued;
+    }
+    if (!woken && othersQueued) {
+      slot.queued = false;
+      slot.parked = true;
+      portEXIT_CRITICAL(&_mux);
+      return true;
+    }
+    portEXIT_CRITICAL(&_mux);
+    
+    if (!woken) {
+      break;
+    }
+  }
+  
+  if (length > 0) {
+    // Only clear what is left over from a longer previous response
+    if (slot.txLength > length) {
+      memset(slot.txBuffer + length, 0, slot.txLength - length);
+    }
+    slot.txLength = length;
+    slot.txGeneration = _txGeneration - 1;  // Staged response must be copied in again next time
+    slot.streamFilled = true;
+    portENTER_CRITICAL(&_mux);
+    _streamSlotsQueued++;
+    portEXIT_CRITICAL(&_mux);
+  } else {
+    refreshSlot(slot);
+  }
+  
+  memset(&slot.transaction, 0, sizeof(slot.transaction));
+  slot.transaction.length = _transactionLength * 8; // Length in bits, the master may clock less
+  slot.transaction.tx_buffer = slot.txBuffer;
+  slot.transaction.rx_buffer = slot.rxBuffer;
+  slot.transaction.user = (void*)(uintptr_t)index;
+  
+  esp_err_t ret = spi_slave_queue_trans(HSPI_HOST, &slot.transaction, ticksToWait);
+  if (ret != ESP_OK) {
+    portENTER_CRITICAL(&_mux);
+    bool wasStreamFilled = slot.streamFilled;
+    if (slot.streamFilled) {
+      slot.streamFilled = false;
+      _streamSlotsQueued--;
+    }
+    slot.queued = false;
+    portEXIT_CRITICAL(&_mux);
+    
+    // Another slot may have raised the pin for this one meanwhile
+    if (wasStreamFilled) {
+      updateHandshake();
+    }
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to queue transaction slot %d: %d", index, ret);
+    return false;
+  }
+  
+  // Tell the master stream data is waiting
+  if (slot.streamFilled) {
+    updateHandshake();
+  }
+  
+  return true;
+}
+
+void SPISlaveHandler::updateHandshake() {
+  if (_handshakePin < 0) {
+    return;
+  }
+  
+  // Read the count and set the level under the lock the ISR lowers the pin with,
+  // otherwise a completion in between leaves the pin high with nothing to stream
+  portENTER_CRITICAL(&_mux);
+  gpio_set_level((gpio_num_t)_handshakePin, _streamSlotsQueued > 0 ? 1 : 0);
+  portEXIT_CRITICAL(&_mux);
+}
+
 bool SPISlaveHandler::init(int sckPin, int misoPin, int mosiPin, int csPin, uint8_t mode) {
   if (_initialized) {
-    _logger->warning("SPISlaveHandler: Already initialized");
+    LOG_WARNING(SPI, "SPISlaveHandler: Already initialized");
     return true;
   }
   
@@ -209,7 +446,7 @@ bool SPISlaveHandler::init(int sckPin, int misoPin, int mosiPin, int csPin, uint
   _mosiPin = (mosiPin != -1) ? mosiPin : SPI_MOSI_PIN;
   _csPin = (csPin != -1) ? csPin : SPI_ESP32_SS;
   
-  _logger->info("SPISlaveHandler: Initializing with SCK=%d, MISO=%d, MOSI=%d, CS=%d", 
+  LOG_INFO(SPI, "SPISlaveHandler: Initializing with SCK=%d, MISO=%d, MOSI=%d, CS=%d", 
                _sckPin, _misoPin, _mosiPin, _csPin);
   
   // Configure SPI bus
@@ -226,164 +463,306 @@ bool SPISlaveHandler::init(int sckPin, int misoPin, int mosiPin, int csPin, uint
   _slaveConfig.mode = _mode;
   _slaveConfig.spics_io_num = _csPin;
   _slaveConfig.flags = 0;
-  _slaveConfig.queue_size = 5;  // Increased queue size to 5 transactions
+  _slaveConfig.queue_size = SPI_TRANSACTION_SLOTS;  // Room for every slot of the ring
   _slaveConfig.post_setup_cb = onSpiPreTransaction;
   _slaveConfig.post_trans_cb = onSpiTransaction;
   
   // Initialize SPI slave driver
   esp_err_t ret = spi_slave_initialize(HSPI_HOST, &_busConfig, &_slaveConfig, SPI_DMA_CH_AUTO);
   if (ret != ESP_OK) {
-    _logger->error("SPISlaveHandler: Failed to initialize SPI slave driver: %d", ret);
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to initialize SPI slave driver: %d", ret);
     return false;
   }
   
-  // Set up initial transaction
-  memset(&_transaction, 0, sizeof(_transaction));
-  _transaction.length = _bufferSize * 8; // Length in bits
-  _transaction.tx_buffer = _txBuffer;
-  _transaction.rx_buffer = _rxBuffer;
-  
-  // Queue more transactions for faster response
-  for (int i = 0; i < 3; i++) {
-    ret = spi_slave_queue_trans(HSPI_HOST, &_transaction, portMAX_DELAY);
-    if (ret != ESP_OK) {
-      _logger->error("SPISlaveHandler: Failed to queue transaction %d: %d", i, ret);
+  // Start the task that keeps the ring queued, it preempts everything but the driver
+  if (!_recycleTaskHandle) {
+    if (xTaskCreatePinnedToCore(recycleTask, "spi_recycle", 3072, this, configMAX_PRIORITIES - 2,
+                                &_recycleTaskHandle, xPortGetCoreID()) != pdPASS) {
+      LOG_ERROR(SPI, "SPISlaveHandler: Failed to create transaction recycle task");
+      spi_slave_free(HSPI_HOST);
       return false;
     }
   }
   
+  // Queue every slot of the ring so the master never clocks into an empty queue
   _initialized = true;
-  _logger->info("SPISlaveHandler: Initialized successfully with %d transactions queued", 3);
+  if (!queueRing()) {
+    _initialized = false;
+    spi_slave_free(HSPI_HOST);
+    return false;
+  }
+  
+  LOG_INFO(SPI, "SPISlaveHandler: Initialized successfully with %d transactions queued", SPI_TRANSACTION_SLOTS);
+  return true;
+}
+
+bool SPISlaveHandler::queueRing() {
+  // Drop slot indices left over from before a reset
+  xQueueReset(_completedSlots);
+  
+  // Nothing queued holds stream data yet, the slot flags are only changed under the lock
+  portENTER_CRITICAL(&_mux);
+  _streamSlotsQueued = 0;
+  for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+    _slots[i].queued = false;
+    _slots[i].streamFilled = false;
+    _slots[i].parked = false;
+  }
+  portEXIT_CRITICAL(&_mux);
+  updateHandshake();
+  
+  for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+    if (!queueSlot(i, portMAX_DELAY)) {
+      return false;
+    }
+  }
   return true;
 }
 
 bool SPISlaveHandler::prepareDataToSend(const uint8_t* txData, size_t length) {
+  return prepareDataToSend(txData, length, nullptr, 0);
+}
+
+bool SPISlaveHandler::prepareDataToSend(const uint8_t* header, size_t headerLength,
+                                        const uint8_t* payload, size_t payloadLength) {
+  const SPISegment segments[2] = {{header, headerLength}, {payload, payloadLength}};
+  return prepareDataToSend(segments, payloadLength > 0 ? 2 : 1);
+}
+
+bool SPISlaveHandler::prepareDataToSend(const SPISegment* segments, size_t count) {
   if (!_initialized) {
-    _logger->error("SPISlaveHandler: Not initialized");
+    LOG_ERROR(SPI, "SPISlaveHandler: Not initialized");
     return false;
   }
   
-  if (!txData || length == 0 || length > _bufferSize) {
-    _logger->error("SPISlaveHandler: Invalid data or length");
+  size_t length = 0;
+  bool valid = segments && count > 0 && segments[0].data && segments[0].length > 0;
+  for (size_t i = 0; valid && i < count; i++) {
+    valid = segments[i].length == 0 || segments[i].data;
+    length += segments[i].length;
+  }
+  if (!valid || length > _transactionLength) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Invalid data or length");
     return false;
   }
   
-  // Critical section to avoid race condition with ISR
-  portENTER_CRITICAL(&_mux);
+  // Only the slot copy reads the staging buffer, the driver and the ISR never do
+  xSemaphoreTake(_txMutex, portMAX_DELAY);
   
-  // Clear tx buffer first
-  memset(_txBuffer, 0, _bufferSize);
+  // Copy every part straight into the staging buffer
+  size_t offset = 0;
+  for (size_t i = 0; i < count; i++) {
+    memcpy(_txBuffer + offset, segments[i].data, segments[i].length);
+    offset += segments[i].length;
+  }
+  
+  // Only clear what is left over from a longer previous response
+  if (_txLength > length) {
+    memset(_txBuffer + length, 0, _txLength - length);
+  }
   
-  // Copy provided data to tx buffer
-  memcpy(_txBuffer, txData, length);
   _txLength = length;
-  _dataReady = true;
+  _txGeneration++;
+  xSemaphoreGive(_txMutex);
   
-  portEXIT_CRITICAL(&_mux);
+  // Picked up by each slot as it is queued again
+  _dataReady = true;
   
-  _logger->debug("SPISlaveHandler: Data prepared for sending (%d bytes)", length);
+  LOG_DEBUG(SPI, "SPISlaveHandler: Data prepared for sending (%d bytes)", length);
   return true;
 }
 
 bool SPISlaveHandler::processNextReceive() {
-  if (_receiveQueue.empty()) {
-    return false;
+  // Report drops here, the ISR can't log
+  uint32_t dropped = _droppedPackets;
+  if (dropped != _reportedDrops) {
+    LOG_WARNING(SPI, "SPISlaveHandler: Dropped %u packets, receive queue full", dropped - _reportedDrops);
+    _reportedDrops = dropped;
   }
   
-  // Acquire semaphore for thread-safe queue access
-  if (xSemaphoreTake(_queueSemaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
-    _logger->error("SPISlaveHandler: Failed to acquire semaphore for queue access");
+  SPIDataPacket packet;
+  if (!_receiveQueue.pop(packet)) {
     return false;
   }
   
-  // Check again after acquiring semaphore (queue could have been emptied by another thread)
-  if (_receiveQueue.empty()) {
-    xSemaphoreGive(_queueSemaphore);
-    return false;
+  // The ISR took the last spare buffer, add one before a packet arriving meanwhile is dropped
+  if (_freeBuffers.empty()) {
+    growBufferPool();
   }
   
-  SPIDataPacket* packet = _receiveQueue.front();
-  _receiveQueue.pop();
+  // Process the received data in place
+  _receiveTime = packet.receiveTime;
+  _sentGeneration = packet.txGeneration;
+  handleReceivedData(_bufferPool[packet.bufferIndex].data, packet.length);
   
-  // Release semaphore after modifying queue
-  xSemaphoreGive(_queueSemaphore);
-  
-  // Process the received data
-  handleReceivedData(packet->data, packet->length);
-  
-  // Clean up
-  delete packet;
+  // Give the buffer back to the ISR
+  _freeBuffers.push(packet.bufferIndex);
   return true;
 }
 
 void SPISlaveHandler::handleReceivedData(const uint8_t* data, size_t length) {
-  _logger->debug("SPISlaveHandler: Processing received data, %d bytes", length);
+  LOG_DEBUG(SPI, "SPISlaveHandler: Processing received data, %d bytes", length);
   
   // If a callback is registered, call it
   if (_receiveCallback) {
     _receiveCallback(data, length);
   } else {
-    // Basic handling when no callback is registered
-    // Just log the first few bytes for debugging
-    if (length > 0) {
-      _logger->debug("SPISlaveHandler: First byte: 0x%02X", data[0]);
-      
-      // If it's a command byte, log it
-      if (data[0] < 0xFF) {
-        SPICommand cmd = static_cast<SPICommand>(data[0]);
-        switch (cmd) {
-          case SPICommand::PING: {
-            _logger->debug("SPISlaveHandler: Received PING");
-            // Auto-respond to PING with PONG
-            uint8_t response[4] = {
-              static_cast<uint8_t>(SPICommand::PONG), 
-              0x00, 
-              static_cast<uint8_t>(getBufferStatus()),  // Include buffer status
-              0x00
-            };
-            prepareDataToSend(response, sizeof(response));
-            break;
-          }
-          case SPICommand::CAMERA_DATA_REQUEST:
-            _logger->debug("SPISlaveHandler: Received CAMERA_DATA_REQUEST");
-            break;
-          case SPICommand::CAMERA_DATA_BLOCK_REQUEST:
-            _logger->debug("SPISlaveHandler: Received CAMERA_DATA_BLOCK_REQUEST");
-            break;
-          case SPICommand::ACK:
-            _logger->debug("SPISlaveHandler: Received ACK");
-            break;
-          case SPICommand::NACK:
-            _logger->debug("SPISlaveHandler: Received NACK");
-            break;
-          default:
-            _logger->debug("SPISlaveHandler: Received command 0x%02X", static_cast<uint8_t>(cmd));
-            break;
-        }
-      }
-    }
+    _dispatcher.dispatch(data, length);
   }
 }
 
+void SPISlaveHandler::respondToPing(const uint8_t* data, size_t length) {
+  SPISlaveHandler& handler = getInstance();
+  uint8_t response[4] = {
+    static_cast<uint8_t>(SPICommand::PONG), 
+    0x00, 
+    static_cast<uint8_t>(handler.getBufferStatus()),  // Include buffer status
+    0x00
+  };
+  handler.prepareDataToSend(response, sizeof(response));
+}
+
+void SPISlaveHandler::rejectShortPacket(const uint8_t* data, size_t length) {
+  LOG_ERROR(SPI, "SPISlaveHandler: Command 0x%02X too short, %d bytes", data[0], length);
+  uint8_t response[2] = {
+    static_cast<uint8_t>(SPICommand::NACK),
+    static_cast<uint8_t>(SPIResponseCode::INVALID_FORMAT)
+  };
+  getInstance().prepareDataToSend(response, sizeof(response));
+}
+
+CommandDispatcher& SPISlaveHandler::getDispatcher() {
+  return _dispatcher;
+}
+
 uint8_t SPISlaveHandler::getBufferStatus() {
   size_t queueSize = pendingReceiveCount();
-  return (queueSize * 100) / _maxQueueSize;  // Convert to percentage of capacity
+  // Every pool buffer not bound to a slot can hold a queued packet
+  return (queueSize * 100) / (SPI_BUFFER_POOL_SIZE - SPI_TRANSACTION_SLOTS);  // Convert to percentage of capacity
+}
+
+uint32_t SPISlaveHandler::getDroppedPacketCount() const {
+  return _droppedPackets;
+}
+
+uint32_t SPISlaveHandler::getTransactionCount() const {
+  return _transactionCount;
+}
+
+uint32_t SPISlaveHandler::getRecoveryAttempts() const {
+  return _recoveryAttempts;
+}
+
+const Utils::Histogram& SPISlaveHandler::getIsrTimeHistogram() const {
+  return _isrTime;
+}
+
+int64_t SPISlaveHandler::getReceiveTime() const {
+  return _receiveTime;
+}
+
+uint32_t SPISlaveHandler::getStagedGeneration() const {
+  return _txGeneration;
+}
+
+uint32_t SPISlaveHandler::getSentGeneration() const {
+  return _sentGeneration;
+}
+
+size_t SPISlaveHandler::getReceiveQueueHighWater() const {
+  return _receiveQueueHighWater;
+}
+
+bool SPISlaveHandler::setTransactionLength(size_t length) {
+  if (length < SPI_MIN_TRANSACTION_SIZE || length > _bufferSize) {
+    LOG_ERROR(SPI, "SPISlaveHandler: Invalid transaction length %d", length);
+    return false;
+  }
+  
+  _transactionLength = length;
+  LOG_INFO(SPI, "SPISlaveHandler: Transaction length set to %d bytes", length);
+  return true;
+}
+
+size_t SPISlaveHandler::getTransactionLength() const {
+  return _transactionLength;
+}
+
+size_t SPISlaveHandler::getMaxTransactionLength() const {
+  return _bufferSize;
 }
 
 void SPISlaveHandler::setReceiveCallback(ReceiveCallback callback) {
   _receiveCallback = callback;
 }
 
-size_t SPISlaveHandler::pendingReceiveCount() {
-  size_t count = 0;
+void SPISlaveHandler::setTransmitFiller(TransmitFiller filler) {
+  _transmitFiller = filler;
+  
+  // Parked slots carry the staged response again once streaming stops
+  wakeTransmitFiller();
+}
+
+void SPISlaveHandler::wakeTransmitFiller() {
+  uint8_t parked[SPI_TRANSACTION_SLOTS];
+  uint8_t count = 0;
+  
+  portENTER_CRITICAL(&_mux);
+  _fillerWakeups++;
+  for (uint8_t i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+    if (_slots[i].parked) {
+      _slots[i].parked = false;
+      parked[count++] = i;
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+  
+  // The recycle task fills them in order, the queue has room for every slot
+  for (uint8_t i = 0; i < count; i++) {
+    if (xQueueSend(_completedSlots, &parked[i], 0) != pdTRUE) {
+      _needsNewTransaction = true;
+    }
+  }
+}
+
+void SPISlaveHandler::setHandshakePin(int pin) {
+  _handshakePin = pin;
+  if (_handshakePin >= 0) {
+    pinMode(_handshakePin, OUTPUT);
+    updateHandshake();
+  }
+}
+
+void SPISlaveHandler::setConsumerTask(TaskHandle_t task) {
+  _consumerTask = task;
+}
+
+bool SPISlaveHandler::startProtocolTask(BaseType_t core, UBaseType_t priority, uint32_t stackSize) {
+  if (_protocolTaskHandle) {
+    LOG_WARNING(SPI, "SPISlaveHandler: Protocol task already running");
+    return true;
+  }
   
-  // Acquire semaphore for thread-safe queue access
-  if (xSemaphoreTake(_queueSemaphore, pdMS_TO_TICKS(100)) == pdTRUE) {
-    count = _receiveQueue.size();
-    xSemaphoreGive(_queueSemaphore);
+  if (xTaskCreatePinnedToCore(protocolTask, "spi_protocol", stackSize, this, priority,
+                              &_protocolTaskHandle, core) != pdPASS) {
+    _protocolTaskHandle = nullptr;
+    LOG_ERROR(SPI, "SPISlaveHandler: Failed to create protocol task");
+    return false;
   }
   
-  return count;
+  // The ISR wakes the protocol task from now on
+  setConsumerTask(_protocolTaskHandle);
+  
+  LOG_INFO(SPI, "SPISlaveHandler: Protocol task started on core %d with priority %d", core, priority);
+  return true;
+}
+
+bool SPISlaveHandler::isProtocolTaskRunning() const {
+  return _protocolTaskHandle != nullptr;
+}
+
+size_t SPISlaveHandler::pendingReceiveCount() {
+  return _receiveQueue.size();
 }
 
 bool SPISlaveHandler::isReadyToSend() {
@@ -396,22 +775,24 @@ bool SPISlaveHandler::ensureTransactionQueued() {
   }
   
   if (_needsNewTransaction) {
-    // Reset the transaction
-    memset(&_transaction, 0, sizeof(_transaction));
-    _transaction.length = _bufferSize * 8; // Length in bits
-    _transaction.tx_buffer = _txBuffer;
-    _transaction.rx_buffer = _rxBuffer;
+    _needsNewTransaction = false;
     
-    // Queue a new transaction
-    esp_err_t ret = spi_slave_queue_trans(HSPI_HOST, &_transaction, 500);
-    if (ret != ESP_OK) {
-      _logger->error("SPISlaveHandler: Failed to queue transaction: %d", ret);
-      return false;
+    // The recycle task normally keeps the ring queued, pick up any slot it missed
+    bool queued = false;
+    for (int i = 0; i < SPI_TRANSACTION_SLOTS; i++) {
+      if (!_slots[i].queued) {
+        if (!queueSlot(i, 500)) {
+          _needsNewTransaction = true;
+          return false;
+        }
+        queued = true;
+      }
     }
     
-    _needsNewTransaction = false;
-    _logger->debug("SPISlaveHandler: New transaction queued");
-    return true;
+    if (queued) {
+      LOG_DEBUG(SPI, "SPISlaveHandler: New transaction queued");
+    }
+    return queued;
   }
   
   return false;
@@ -430,8 +811,8 @@ bool SPISlaveHandler::checkAndRecoverFromStalledTransaction() {
   // 1. It's been active for longer than the timeout period
   // 2. No transaction activity has occurred in the timeout period
   if (_transactionActive && timeSinceLastTransaction > _transactionTimeout) {
-    _logger->warning("SPISlaveHandler: Detected stalled transaction, attempting recovery");
-    _logger->warning("SPISlaveHandler: Transaction active for %lu ms", timeSinceLastTransaction);
+    LOG_WARNING(SPI, "SPISlaveHandler: Detected stalled transaction, attempting recovery");
+    LOG_WARNING(SPI, "SPISlaveHandler: Transaction active for %lu ms", timeSinceLastTransaction);
     
     // Reset the SPI interface
     return resetSPIInterface();
@@ -442,7 +823,7 @@ bool SPISlaveHandler::checkAndRecoverFromStalledTransaction() {
   if (timeSinceLastTransaction > _transactionTimeout * 2) {
     // Only attempt recovery if we've been initialized and had at least one transaction
     if (_initialized && _transactionCount > 0) {
-      _logger->warning("SPISlaveHandler: No SPI activity for %lu ms, attempting recovery", 
+      LOG_WARNING(SPI, "SPISlaveHandler: No SPI activity for %lu ms, attempting recovery", 
                      timeSinceLastTransaction);
       
       // Reset the SPI interface
@@ -460,52 +841,93 @@ bool SPISlaveHandler::checkAndRecoverFromStalledTransaction() {
 }
 
 bool SPISlaveHandler::resetSPIInterface() {
-  _logger->warning("SPISlaveHandler: Resetting SPI interface (recovery attempt %d)", 
-                 ++_recoveryAttempts);
-  
-  // Free the existing SPI slave driver
-  if (_initialized) {
-    spi_slave_free(HSPI_HOST);
-    _initialized = false;
+  // Counted outside the log call, it is compiled out below LOG_MIN_LEVEL
+  _recoveryAttempts++;
+  LOG_WARNING(SPI, "SPISlaveHandler: Resetting SPI interface (recovery attempt %d)", 
+                 _recoveryAttempts);
+  
+  // Keep the bus and the DMA channel, only the transactions start over
+  bool result = _initialized && requeueTransactions();
+  
+  if (!result) {
+    // Free the existing SPI slave driver
+    if (_initialized) {
+      spi_slave_free(HSPI_HOST);
+      _initialized = false;
+    }
+    
+    // The ISR is gone, drop pending packets and rebind the receive buffers
+    resetBufferPool();
+    
+    // Wait a moment to ensure everything is reset
+    delay(100);
+    
+    // Reinitialize with the same parameters
+    result = init(_sckPin, _misoPin, _mosiPin, _csPin, _mode);
   }
   
-  // Wait a moment to ensure everything is reset
-  delay(100);
-  
-  // Reinitialize with the same parameters
-  bool result = init(_sckPin, _misoPin, _mosiPin, _csPin, _mode);
-  
   if (result) {
-    _logger->info("SPISlaveHandler: SPI interface reset successful");
+    LOG_INFO(SPI, "SPISlaveHandler: SPI interface reset successful");
     
     // Reset transaction tracking
     _transactionActive = false;
     _lastTransactionTime = millis();
     
     // Clear any pending data
+    xSemaphoreTake(_txMutex, portMAX_DELAY);
     memset(_txBuffer, 0, _bufferSize);
-    memset(_rxBuffer, 0, _bufferSize);
     _txLength = 0;
+    _txGeneration++;
+    xSemaphoreGive(_txMutex);
     _dataReady = false;
     
-    // Clean up receive queue
-    if (xSemaphoreTake(_queueSemaphore, pdMS_TO_TICKS(1000)) == pdTRUE) {
-      while (!_receiveQueue.empty()) {
-        SPIDataPacket* packet = _receiveQueue.front();
-        _receiveQueue.pop();
-        delete packet;
-      }
-      xSemaphoreGive(_queueSemaphore);
-    }
-    
     // Send a recognizable pattern
     uint8_t initialData[4] = {0xAA, 0x55, 0xAA, 0x55};
     prepareDataToSend(initialData, sizeof(initialData));
   } else {
-    _logger->error("SPISlaveHandler: SPI interface reset failed");
+    LOG_ERROR(SPI, "SPISlaveHandler: SPI interface reset failed");
   }
   
   return result;
 }
 
+bool SPISlaveHandler::requeueTransactions() {
+#if SPI_SLAVE_SOFT_RECOVERY
+  // The recycle task skips the slots the ISR hands back from here on
+  _initialized = false;
+  
+  // Stops the master's transactions from reaching the queue, the bus pins stay configured
+  esp_err_t ret = spi_slave_disable(HSPI_HOST);
+  if (ret == ESP_OK) {
+    ret = spi_slave_queue_reset(HSPI_HOST);
+  }
+  if (ret != ESP_OK) {
+    LOG_WARNING(SPI, "SPISlaveHandler: Failed to drop queued transactions: %d, reinitializing", ret);
+    _initialized = true;  // The driver is still installed and has to be freed
+    return false;
+  }
+  
+  // Nothing completes while disabled, drop pending packets and rebind the receive buffers
+  resetBufferPool();
+  _needsNewTransaction = false;
+  
+  ret = spi_slave_enable(HSPI_HOST);
+  if (ret != ESP_OK) {
+    LOG_WARNING(SPI, "SPISlaveHandler: Failed to resume SPI slave: %d, reinitializing", ret);
+    _initialized = true;
+    return false;
+  }
+  
+  _initialized = true;
+  if (!queueRing()) {
+    return false;
+  }
+  
+  LOG_INFO(SPI, "SPISlaveHandler: %d transactions queued again on the running bus", SPI_TRANSACTION_SLOTS);
+  return true;
+#else
+  return false;
+#endif
+}
+
 } // namespace Communication
@@ -4,72 +4,76 @@
 #include <SPI.h>
 #include "Config.h"
 #include "lib/Utils/Logger.h"
-#include <queue>
+#include "lib/Utils/SpscQueue.h"
+#include "lib/Utils/Histogram.h"
+#include "lib/Utils/Memory.h"
+#include "SPIProtocol.h"
+#include "CommandDispatcher.h"
 #include <driver/spi_slave.h>
+#include <esp_idf_version.h>
 #include <freertos/semphr.h>
+#include <freertos/queue.h>
 
-// Added buffer pool size constant
-#define SPI_BUFFER_POOL_SIZE 6  // Number of pre-allocated buffers in the pool
+// Number of receive buffers, one per transaction slot plus the packets waiting to be handled
+#ifndef SPI_BUFFER_POOL_SIZE
+#define SPI_BUFFER_POOL_SIZE 6
+#endif
 
-namespace Communication {
+// Number of transactions kept queued in the SPI slave driver, each with its own DMA buffers
+#ifndef SPI_TRANSACTION_SLOTS
+#define SPI_TRANSACTION_SLOTS 3
+#endif
 
-/**
- * @brief Command codes for SPI communication
- * These must match with the master device
- */
-enum class SPICommand : uint8_t {
-  PING = 0x01,
-  PONG = 0x02,
-  CAMERA_DATA_REQUEST = 0x20,        // New command for requesting camera data
-  CAMERA_DATA_RESPONSE = 0x21,       // Response with camera data
-  CAMERA_DATA_BLOCK_REQUEST = 0x22,  // Request for a specific block of camera data
-  CAMERA_DATA_BLOCK_RESPONSE = 0x23, // Response with a specific block of camera data
-  BUFFER_STATUS_REQUEST = 0x30,      // New command to check buffer status
-  BUFFER_STATUS_RESPONSE = 0x31,     // Response with buffer status
-  ACK = 0xAA,
-  NACK = 0xFF
-};
+// Capacity of the ISR-to-task receive queue, power of two and at least SPI_BUFFER_POOL_SIZE
+#define SPI_RECEIVE_QUEUE_SIZE 8
 
-// Enhanced response codes
-enum class SPIResponseCode : uint8_t {
-  OK = 0x00,
-  INCOMPLETE_PACKET = 0x10,
-  LENGTH_MISMATCH = 0x11,
-  CHECKSUM_ERROR = 0x12,
-  BUFFER_FULL = 0x20,     // Added for flow control
-  NOT_READY = 0x21,       // Added for flow control
-  CAMERA_NOT_AVAILABLE = 0x30,
-  CAMERA_CAPTURE_FAILED = 0x31,
-  INVALID_BLOCK_INDEX = 0x32,
-  MEMORY_ERROR = 0x40,
-};
+// The driver can be paused and its queue dropped since IDF 5.3, recovery then keeps the bus configured
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#define SPI_SLAVE_SOFT_RECOVERY 1
+#else
+#define SPI_SLAVE_SOFT_RECOVERY 0
+#endif
+
+// Shortest transaction length setTransactionLength() accepts, applications raise it to fit their longest response
+#define SPI_MIN_TRANSACTION_SIZE 64
+
+namespace Communication {
 
-// Struct to store SPI data for the receive queue
+// Entry of the receive queue, the data stays in the pooled buffer it was received into
 struct SPIDataPacket {
-  uint8_t* data;
+  uint8_t bufferIndex;  // Index into the buffer pool
+  size_t length;
+  int64_t receiveTime;  // esp_timer time the transaction ended, in microseconds
+  uint32_t txGeneration; // Staged response the transaction clocked out, 0 for stream data or none
+};
+
+// Part of a response, a list of them is gathered into the transmit buffer in order
+struct SPISegment {
+  const uint8_t* data;
   size_t length;
-  bool processed;
-  
-  SPIDataPacket(const uint8_t* srcData, size_t len) {
-    length = len;
-    processed = false;
-    data = new uint8_t[length];
-    memcpy(data, srcData, length);
-  }
-  
-  ~SPIDataPacket() {
-    if (data) {
-      delete[] data;
-    }
-  }
 };
 
 // New buffer pool structure
 struct SPIBuffer {
   uint8_t* data;
-  bool inUse;
   
-  SPIBuffer() : data(nullptr), inUse(false) {}
+  SPIBuffer() : data(nullptr) {}
+};
+
+// One entry of the transaction ring handed to the SPI slave driver
+struct SPITransactionSlot {
+  spi_slave_transaction_t transaction;
+  uint8_t* txBuffer;
+  uint8_t* rxBuffer;        // Pooled buffer the next transaction receives into
+  uint8_t rxBufferIndex;    // Index of rxBuffer in the buffer pool
+  size_t txLength;          // Bytes of the staged response currently in txBuffer
+  uint32_t txGeneration;    // Generation of the staged response copied into txBuffer
+  volatile bool queued;     // Owned by the driver, txBuffer must not change
+  volatile bool streamFilled; // txBuffer holds stream data from the transmit filler
+  volatile bool parked;     // Kept out of the driver queue until the filler has data again
+  
+  SPITransactionSlot() : txBuffer(nullptr), rxBuffer(nullptr), rxBufferIndex(0), txLength(0),
+                         txGeneration(0), queued(false), streamFilled(false), parked(false) {}
 };
 
 /**
@@ -102,12 +106,38 @@ public:
 
   /**
    * @brief Prepare data to be sent to master when it initiates a transaction
+   * The response is staged and copied into each slot as it is queued again. Slots
+   * already queued belong to the driver and keep what they hold, so the master
+   * sees the response after at most SPI_TRANSACTION_SLOTS transactions.
    * @param txData Pointer to data to prepare for sending
    * @param length Length of data to send in bytes
    * @return true if preparation was successful, false otherwise
    */
   bool prepareDataToSend(const uint8_t* txData, size_t length);
 
+  /**
+   * @brief Prepare a header followed by a payload to be sent to master
+   * Both parts are written straight into the transmit buffer, so callers
+   * don't need to assemble the response in a temporary buffer first.
+   * @param header Pointer to the response header
+   * @param headerLength Length of the header in bytes
+   * @param payload Pointer to the payload (may be nullptr if payloadLength is 0)
+   * @param payloadLength Length of the payload in bytes
+   * @return true if preparation was successful, false otherwise
+   */
+  bool prepareDataToSend(const uint8_t* header, size_t headerLength,
+                         const uint8_t* payload, size_t payloadLength);
+
+  /**
+   * @brief Prepare a response gathered from several parts to be sent to master
+   * The parts are copied one after the other straight into the transmit buffer,
+   * so a response made of many headers and payloads needs no assembly buffer.
+   * @param segments Parts of the response in order, the first one must not be empty
+   * @param count Number of parts
+   * @return true if preparation was successful, false otherwise
+   */
+  bool prepareDataToSend(const SPISegment* segments, size_t count);
+
   /**
    * @brief Process the next pending receive data packet
    * @return true if a packet was processed, false if queue is empty
@@ -116,11 +146,81 @@ public:
   
   /**
    * @brief Register a callback function for received data
+   * The callback replaces the command dispatch, call getDispatcher().dispatch() from it
+   * to handle the packet after logging or locking around it
    * @param callback Function to call when data is received
    */
   typedef void (*ReceiveCallback)(const uint8_t* data, size_t length);
   void setReceiveCallback(ReceiveCallback callback);
   
+  /**
+   * @brief Get the command table received packets are dispatched through
+   * PING is answered out of the box and short packets get NACK INVALID_FORMAT,
+   * registering a handler for PING replaces the built-in one
+   * @return CommandDispatcher& Reference to the command table
+   */
+  CommandDispatcher& getDispatcher();
+  
+  /**
+   * @brief Callback that writes the next chunk of a stream into a transaction
+   * Called from the recycle task every time a slot is queued again, so slots are
+   * filled in the order the master clocks them. It must not block, it returns 0 when
+   * it has nothing yet and wakeTransmitFiller() asks again once it has.
+   * @param buffer Transmit buffer of the slot
+   * @param capacity Size of the buffer in bytes
+   * @return Number of bytes written, 0 to send the staged response instead
+   */
+  typedef size_t (*TransmitFiller)(uint8_t* buffer, size_t capacity);
+  
+  /**
+   * @brief Set the stream source for queued transactions
+   * Slots it filled go out as they are, staged responses only reach slots it leaves empty
+   * @param filler Filler callback, or nullptr to go back to staged responses
+   */
+  void setTransmitFiller(TransmitFiller filler);
+  
+  /**
+   * @brief Ask the transmit filler again for the slots it left empty
+   * While streaming, slots the filler had nothing for are kept out of the driver
+   * queue, except the last one so the slave still receives commands.
+   * Call this from the stream source when new data is there.
+   */
+  void wakeTransmitFiller();
+  
+  /**
+   * @brief Set the handshake GPIO
+   * The pin is driven high while at least one queued transaction holds stream data,
+   * so the master knows when clocking will return something
+   * @param pin GPIO number, or -1 to disable
+   */
+  void setHandshakePin(int pin);
+  
+  /**
+   * @brief Set the task that consumes received packets
+   * The task is notified from the ISR every time a packet is queued,
+   * so it can block in ulTaskNotifyTake() instead of polling
+   * @param task Task handle, or nullptr to disable notifications
+   */
+  void setConsumerTask(TaskHandle_t task);
+  
+  /**
+   * @brief Start a dedicated task that runs the protocol instead of the main loop
+   * The task blocks until the ISR queues a packet and dispatches it right away.
+   * It also keeps transactions queued and runs the stalled transaction watchdog,
+   * so processNextReceive() must not be called from anywhere else once it runs.
+   * @param core Core to pin the task to
+   * @param priority FreeRTOS priority of the task
+   * @param stackSize Stack size in bytes
+   * @return true if the task is running
+   */
+  bool startProtocolTask(BaseType_t core, UBaseType_t priority, uint32_t stackSize = 8192);
+  
+  /**
+   * @brief Check if the dedicated protocol task is running
+   * @return true if the protocol task owns packet processing
+   */
+  bool isProtocolTaskRunning() const;
+  
   /**
    * @brief Check if there are pending receive packets
    * @return Number of pending packets
@@ -148,7 +248,9 @@ public:
   
   /**
    * @brief Reset the SPI interface in case of errors
-   * This will reinitialize the SPI interface with the same parameters
+   * With SPI_SLAVE_SOFT_RECOVERY the queued transactions are dropped and the ring
+   * is queued again on the running bus, otherwise or if that fails the driver is
+   * reinitialized with the same parameters
    * @return true if reset was successful
    */
   bool resetSPIInterface();
@@ -158,6 +260,79 @@ public:
    * @return percentage of receive queue filled (0-100)
    */
   uint8_t getBufferStatus();
+  
+  /**
+   * @brief Get the number of received packets dropped because no buffer was free
+   * @return Number of dropped packets since boot
+   */
+  uint32_t getDroppedPacketCount() const;
+  
+  /**
+   * @brief Get the number of completed transactions
+   * @return Number of transactions since boot
+   */
+  uint32_t getTransactionCount() const;
+  
+  /**
+   * @brief Get the number of watchdog recovery attempts
+   * @return Number of recovery attempts since boot
+   */
+  uint32_t getRecoveryAttempts() const;
+  
+  /**
+   * @brief Get the run time of the transaction-done ISR
+   * @return Histogram in microseconds, written by the ISR only
+   */
+  const Utils::Histogram& getIsrTimeHistogram() const;
+  
+  /**
+   * @brief Get when the packet being handled was received
+   * Only meaningful inside the receive callback or a command handler
+   * @return esp_timer time in microseconds at the end of the packet's transaction
+   */
+  int64_t getReceiveTime() const;
+  
+  /**
+   * @brief Get the generation of the last staged response
+   * Bumped by every prepareDataToSend(), compare it with getSentGeneration()
+   * @return Generation of the response staged last
+   */
+  uint32_t getStagedGeneration() const;
+  
+  /**
+   * @brief Get which staged response went out with the packet being handled
+   * Responses reach a slot only when it is queued again, so this trails getStagedGeneration()
+   * by up to SPI_TRANSACTION_SLOTS transactions. Only meaningful inside the receive callback or a command handler
+   * @return Generation the transaction clocked out, 0 if it carried stream data or nothing was staged yet
+   */
+  uint32_t getSentGeneration() const;
+  
+  /**
+   * @brief Get the most packets that were waiting in the receive queue at once
+   * @return High-water mark since boot
+   */
+  size_t getReceiveQueueHighWater() const;
+  
+  /**
+   * @brief Set the length of the transactions queued for the master
+   * Applies to slots queued from now on. The master may still clock shorter
+   * transactions, e.g. for control responses, but never longer ones.
+   * @param length Transaction length in bytes, SPI_MIN_TRANSACTION_SIZE up to getMaxTransactionLength()
+   * @return true if the length was accepted
+   */
+  bool setTransactionLength(size_t length);
+  
+  /**
+   * @brief Get the negotiated transaction length
+   * @return Transaction length in bytes
+   */
+  size_t getTransactionLength() const;
+  
+  /**
+   * @brief Get the largest transaction the DMA buffers can hold
+   * @return Maximum transaction length in bytes
+   */
+  size_t getMaxTransactionLength() const;
 
 private:
   SPISlaveHandler();  // Private constructor for singleton
@@ -173,36 +348,100 @@ private:
   static void IRAM_ATTR onSpiTransaction(spi_slave_transaction_t *trans);
   static void IRAM_ATTR onSpiPreTransaction(spi_slave_transaction_t *trans);
   
+  /**
+   * @brief Task that re-queues completed transaction slots as soon as the driver hands them back
+   * @param parameter SPISlaveHandler instance
+   */
+  static void recycleTask(void* parameter);
+  
+  /**
+   * @brief Task that dispatches received packets as soon as the ISR queues them
+   * @param parameter SPISlaveHandler instance
+   */
+  static void protocolTask(void* parameter);
+  
+  /**
+   * @brief Queue a transaction slot with the latest staged response
+   * @param index Slot index in the transaction ring
+   * @param ticksToWait Ticks to wait for room in the driver queue
+   * @param useFiller Ask the transmit filler for the slot content first
+   * @return true if the slot was queued
+   */
+  bool queueSlot(uint8_t index, TickType_t ticksToWait, bool useFiller = false);
+  
+  /**
+   * @brief Drive the handshake pin from the number of queued stream slots
+   * Takes _mux, must not be called with it held
+   */
+  void updateHandshake();
+  
+  /**
+   * @brief Copy the staged response into a slot if it holds an older one
+   * Only for a slot the driver doesn't own, takes _txMutex
+   * @param slot Slot to refresh
+   */
+  void refreshSlot(SPITransactionSlot& slot);
+  
+  /**
+   * @brief Queue every slot of the ring on a driver with an empty queue
+   * @return true if every slot was queued
+   */
+  bool queueRing();
+  
+  /**
+   * @brief Drop the queued transactions and queue the ring again without freeing the bus
+   * @return true if the ring is queued again, false if the driver has to be reinitialized
+   */
+  bool requeueTransactions();
+  
   // Mutex for thread safety
   portMUX_TYPE _mux;
 
   /**
-   * @brief Handle received data internally or through callback
+   * @brief Handle received data through the callback or the command table
    * @param data Pointer to received data
    * @param length Length of received data
    */
   void handleReceivedData(const uint8_t* data, size_t length);
-
+  
+  /**
+   * @brief Built-in PING handler, answers PONG with the buffer status
+   */
+  static void respondToPing(const uint8_t* data, size_t length);
+  
   /**
-   * @brief Get a buffer from the pool or allocate a new one
-   * @return Pointer to available buffer, or nullptr if none available
+   * @brief Built-in handler of packets shorter than their command requires
    */
-  uint8_t* getBuffer();
+  static void rejectShortPacket(const uint8_t* data, size_t length);
 
   /**
-   * @brief Return buffer to pool when done
-   * @param buffer Pointer to buffer to return
+   * @brief Give every slot a receive buffer and put the rest of the pool on the free list
+   * Drops all pending packets, only call while the driver is not running
+   */
+  void resetBufferPool();
+  
+  /**
+   * @brief Add a receive buffer to the free list of the ISR
+   * Called by the consumer when the ISR took the last one
+   * @return true if a buffer was added, false if the pool is full or out of memory
    */
-  void returnBuffer(uint8_t* buffer);
+  bool growBufferPool();
 
   // Buffer management
-  uint8_t* _txBuffer;
-  uint8_t* _rxBuffer;
+  uint8_t* _txBuffer;                  // Staged response, copied into each slot before it is clocked out
   size_t _bufferSize;
+  volatile size_t _transactionLength;  // Negotiated with the master, at most _bufferSize
   volatile size_t _txLength;
+  volatile uint32_t _txGeneration;     // Bumped every time a new response is staged
   volatile bool _dataReady;
+  SemaphoreHandle_t _txMutex;          // Guards the staged response while it is written or copied into a slot
   volatile bool _needsNewTransaction;  // Flag to indicate a new transaction needs to be queued
   
+  // Transaction ring
+  SPITransactionSlot _slots[SPI_TRANSACTION_SLOTS];
+  QueueHandle_t _completedSlots;       // Slot indices handed back by the driver
+  TaskHandle_t _recycleTaskHandle;
+  
   // Transaction watchdog variables
   unsigned long _lastTransactionTime;  // Time of last transaction activity
   unsigned long _transactionTimeout;   // Timeout in milliseconds
@@ -210,29 +449,40 @@ private:
   uint32_t _transactionCount;          // Counter for completed transactions
   uint32_t _recoveryAttempts;          // Counter for recovery attempts
   
-  // Queue for received data packets
-  std::queue<SPIDataPacket*> _receiveQueue;
+  // Queue for received data packets, filled by the ISR and drained by the consumer task
+  Utils::SpscQueue<SPIDataPacket, SPI_RECEIVE_QUEUE_SIZE> _receiveQueue;
   
-  // Semaphore for controlling queue access
-  SemaphoreHandle_t _queueSemaphore;
+  // Pool buffers free to receive into, returned by the consumer task and taken by the ISR
+  Utils::SpscQueue<uint8_t, SPI_RECEIVE_QUEUE_SIZE> _freeBuffers;
   
   // Buffer pool
   SPIBuffer _bufferPool[SPI_BUFFER_POOL_SIZE];
+  Utils::BlockPool _dmaBuffers;        // Transmit buffers of the slots and the receive buffers of the pool, grows with the load
   
-  // Max queue size for flow control
-  const size_t _maxQueueSize = 10;  // Limit receive queue size for flow control
+  // Flow control accounting
+  volatile uint32_t _droppedPackets;   // Packets dropped by the ISR because no buffer was free
+  volatile size_t _receiveQueueHighWater; // Most packets queued at once, updated by the ISR
+  Utils::Histogram _isrTime;           // Run time of onSpiTransaction in microseconds
+  int64_t _receiveTime;                // Receive time of the packet being handled
+  uint32_t _sentGeneration;            // Staged response the packet being handled clocked out
+  uint32_t _reportedDrops;             // Drops already logged by the consumer
   
   // Callback for receive events
   ReceiveCallback _receiveCallback;
+  CommandDispatcher _dispatcher;
+  TaskHandle_t _consumerTask;
+  
+  // Streaming
+  volatile TransmitFiller _transmitFiller;
+  volatile uint8_t _streamSlotsQueued;  // Queued slots holding stream data
+  volatile uint32_t _fillerWakeups;     // Bumped by wakeTransmitFiller(), a slot is only parked if it didn't change
+  int _handshakePin;
+  TaskHandle_t _protocolTaskHandle;
   
   // SPI hardware handle
-  spi_slave_transaction_t _transaction;
   spi_slave_interface_config_t _slaveConfig;
   spi_bus_config_t _busConfig;
   
-  // Logger instance
-  Utils::Logger* _logger;
-
   // Flag to track initialization state
   bool _initialized;
   
@@ -3,16 +3,38 @@
 
 namespace Sensors {
 
-Camera::Camera() : _resolution(CAMERA_FRAME_SIZE), _initialized(false), _streamingInterval(200) {
+namespace {
+
+// Presets the master switches between with CAMERA_CONFIG, all JPEG so switching needs no restart
+const CameraProfile PRESETS[] = {
+    {"default", CAMERA_FRAME_SIZE, PIXFORMAT_JPEG, CAMERA_QUALITY, 2, CAMERA_XCLK_FREQ_HZ},
+    {"fast-QQVGA", FRAMESIZE_QQVGA, PIXFORMAT_JPEG, 20, 2, CAMERA_XCLK_FREQ_HZ},
+    {"balanced-QVGA", FRAMESIZE_QVGA, PIXFORMAT_JPEG, 12, 2, CAMERA_XCLK_FREQ_HZ},
+    {"quality-VGA", FRAMESIZE_VGA, PIXFORMAT_JPEG, 8, 2, CAMERA_XCLK_FREQ_HZ},
+};
+
+} // namespace
+
+Camera::Camera()
+    : _profile(PRESETS[0]), _bufferFrameSize(FRAMESIZE_INVALID), _quality(PRESETS[0].jpegQuality),
+      _initialized(false), _down(false), _streamingInterval(200) {
+    _sensorMutex = xSemaphoreCreateMutex();
 }
 
 Camera::~Camera() {
     if (_initialized) {
         esp_camera_deinit();
     }
+    if (_sensorMutex) {
+        vSemaphoreDelete(_sensorMutex);
+    }
 }
 
 bool Camera::init() {
+    return start(_profile);
+}
+
+bool Camera::start(const CameraProfile& profile) {
     #if CAMERA_ENABLED == false
     return false;
     #else
@@ -35,16 +57,20 @@ bool Camera::init() {
     config.pin_sccb_scl = SIOC_GPIO_NUM;
     config.pin_pwdn = PWDN_GPIO_NUM;
     config.pin_reset = RESET_GPIO_NUM;
-    config.xclk_freq_hz = 25000000;
-    config.pixel_format = PIXFORMAT_JPEG;
-    config.jpeg_quality = CAMERA_QUALITY;  // 0-63, lower is better quality
+    config.xclk_freq_hz = profile.xclkFreqHz;
+    config.pixel_format = profile.pixelFormat;
+    config.jpeg_quality = profile.jpegQuality;  // 0-63, lower is better quality
     
     // PSRAM configuration
     if (psramFound()) {
-        config.frame_size = _resolution;
+        // JPEG buffers fit every preset, uncompressed ones are too large for that
+        config.frame_size = profile.frameSize;
+        if (profile.pixelFormat == PIXFORMAT_JPEG && getLargestPresetSize() > profile.frameSize) {
+            config.frame_size = getLargestPresetSize();
+        }
         config.fb_location = CAMERA_FB_IN_PSRAM;
         config.grab_mode = CAMERA_GRAB_LATEST;
-        config.fb_count = 1;
+        config.fb_count = profile.fbCount;  // Two keep one frame in transfer while the next one is captured
     } else {
         config.frame_size = FRAMESIZE_SVGA;
         config.fb_location = CAMERA_FB_IN_DRAM;
@@ -59,10 +85,137 @@ bool Camera::init() {
     }
     
     _initialized = true;
+    _bufferFrameSize = config.frame_size;
+    _profile = profile;
+    _profile.fbCount = config.fb_count;
+    _quality = profile.jpegQuality;
+    
+    // The buffers may be larger than the frames of this profile
+    if (config.frame_size != profile.frameSize) {
+        sensor_t* sensor = esp_camera_sensor_get();
+        if (sensor) {
+            sensor->set_framesize(sensor, profile.frameSize);
+        }
+    }
     return true;
     #endif
 }
 
+bool Camera::applyProfile(const CameraProfile& profile) {
+    // A camera that went down in a restart comes back with the new settings
+    if (_down) {
+        _down = !start(profile);
+        return !_down;
+    }
+    
+    if (!_initialized) {
+        _profile = profile;
+        _quality = profile.jpegQuality;
+        return true;
+    }
+    
+    if (needsRestart(profile)) {
+        CameraProfile previous = _profile;
+        esp_camera_deinit();
+        _initialized = false;
+        if (start(profile)) {
+            return true;
+        }
+        
+        // Keep a working camera
+        Serial.printf("Camera restart with profile %s failed\n", profile.name);
+        if (!start(previous)) {
+            Serial.printf("Camera restart with previous profile %s failed, camera is down\n", previous.name);
+            _down = true;
+        }
+        return false;
+    }
+    
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) {
+        return false;
+    }
+    
+    // Only write the registers of settings that differ
+    xSemaphoreTake(_sensorMutex, portMAX_DELAY);
+    bool applied = true;
+    if (profile.frameSize != _profile.frameSize) {
+        applied = sensor->set_framesize(sensor, profile.frameSize) == 0;
+        if (applied) {
+            _profile.frameSize = profile.frameSize;
+        }
+    }
+    if (applied && profile.jpegQuality != _quality) {
+        applied = sensor->set_quality(sensor, profile.jpegQuality) == 0;
+        if (applied) {
+            _quality = profile.jpegQuality;
+        }
+    }
+    if (applied) {
+        _profile.jpegQuality = profile.jpegQuality;
+        _profile.name = profile.name;
+    }
+    xSemaphoreGive(_sensorMutex);
+    return applied;
+}
+
+bool Camera::setQuality(uint8_t quality) {
+    if (!_initialized || quality == _quality) {
+        return _initialized;
+    }
+    
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) {
+        return false;
+    }
+    
+    xSemaphoreTake(_sensorMutex, portMAX_DELAY);
+    bool applied = sensor->set_quality(sensor, quality) == 0;
+    if (applied) {
+        _quality = quality;
+    }
+    xSemaphoreGive(_sensorMutex);
+    return applied;
+}
+
+uint8_t Camera::getQuality() const {
+    return _quality;
+}
+
+bool Camera::needsRestart(const CameraProfile& profile) const {
+    // Starting a camera that isn't running is a restart as well
+    if (!_initialized) {
+        return true;
+    }
+    
+    uint8_t fbCount = psramFound() ? profile.fbCount : 1;
+    return profile.pixelFormat != _profile.pixelFormat || fbCount != _profile.fbCount ||
+           profile.xclkFreqHz != _profile.xclkFreqHz || profile.frameSize > _bufferFrameSize;
+}
+
+const CameraProfile& Camera::getProfile() const {
+    return _profile;
+}
+
+size_t Camera::getPresetCount() {
+    return sizeof(PRESETS) / sizeof(PRESETS[0]);
+}
+
+const CameraProfile& Camera::getPreset(size_t index) {
+    return PRESETS[index < getPresetCount() ? index : 0];
+}
+
+framesize_t Camera::getLargestPresetSize() {
+    // Frame sizes are ordered by size, as far as the presets go
+    framesize_t largest = PRESETS[0].frameSize;
+    for (size_t i = 1; i < getPresetCount(); i++) {
+        if (PRESETS[i].frameSize > largest) {
+            largest = PRESETS[i].frameSize;
+        }
+    }
+    return largest;
+}
+
 camera_fb_t* Camera::captureFrame() {
     if (!_initialized) {
         return nullptr;
@@ -78,19 +231,25 @@ void Camera::returnFrame(camera_fb_t* fb) {
 
 void Camera::setResolution(framesize_t resolution) {
     if (!_initialized) {
-        _resolution = resolution;
+        _profile.frameSize = resolution;
         return;
     }
     
     sensor_t* sensor = esp_camera_sensor_get();
     if (sensor) {
+        xSemaphoreTake(_sensorMutex, portMAX_DELAY);
         sensor->set_framesize(sensor, resolution);
-        _resolution = resolution;
+        _profile.frameSize = resolution;
+        xSemaphoreGive(_sensorMutex);
     }
 }
 
 framesize_t Camera::getResolution() const {
-    return _resolution;
+    return _profile.frameSize;
+}
+
+bool Camera::isInitialized() const {
+    return _initialized;
 }
 
 uint32_t Camera::getStreamingInterval() const {
@@ -104,9 +263,11 @@ void Camera::setStreamingInterval(uint32_t interval) {
 void Camera::adjustSettings(int brightness, int contrast, int saturation) {
     sensor_t * s = esp_camera_sensor_get();
     if (s) {
+        xSemaphoreTake(_sensorMutex, portMAX_DELAY);
         s->set_brightness(s, brightness);
         s->set_contrast(s, contrast);
         s->set_saturation(s, saturation);
+        xSemaphoreGive(_sensorMutex);
     }
 }
 
@@ -6,6 +6,18 @@
 
 namespace Sensors {
 
+/**
+ * Camera settings that are switched as a whole
+ */
+struct CameraProfile {
+    const char* name;
+    framesize_t frameSize;
+    pixformat_t pixelFormat;
+    uint8_t jpegQuality;    // 0-63, lower is better quality
+    uint8_t fbCount;        // Frame buffers, always 1 without PSRAM
+    uint32_t xclkFreqHz;    // Sensor clock
+};
+
 /**
  * Camera class for ESP32-CAM
  * Handles camera initialization, configuration, and frame capture
@@ -16,11 +28,74 @@ public:
     ~Camera();
 
     /**
-     * Initialize the camera with the specified configuration
+     * Initialize the camera with the active profile
+     * With PSRAM the frame buffers are sized for the largest preset, so switching
+     * between presets later only writes sensor registers
      * @return true if initialization was successful, false otherwise
      */
     bool init();
 
+    /**
+     * Switch to other settings
+     * Only the sensor registers of settings that differ are written. If needsRestart()
+     * the camera is restarted instead, no frame buffer may be held then.
+     * A failed restart falls back to the previous settings. If that fails too the
+     * camera is down, isInitialized() is false and the next call starts it again.
+     * @param profile Settings to switch to
+     * @return true if the settings are active, false if the previous ones are or the camera is down
+     */
+    bool applyProfile(const CameraProfile& profile);
+
+    /**
+     * Check if the camera is running
+     * @return false before init() and after a failed restart
+     */
+    bool isInitialized() const;
+
+    /**
+     * Check if switching to a profile restarts the camera
+     * True for another pixel format, frame buffer count or clock, a frame size
+     * larger than the frame buffers, or a camera that isn't running
+     * @param profile Settings to check
+     * @return true if applyProfile() would restart the camera
+     */
+    bool needsRestart(const CameraProfile& profile) const;
+
+    /**
+     * Set the JPEG quality without changing the profile
+     * The register is only written if the quality differs, frames already
+     * captured keep the quality they had
+     * @param quality 0-63, lower is better quality
+     * @return true if the sensor uses the quality now
+     */
+    bool setQuality(uint8_t quality);
+
+    /**
+     * Get the JPEG quality the sensor is set to
+     * Differs from the profile while setQuality() overrides it
+     * @return 0-63, lower is better quality
+     */
+    uint8_t getQuality() const;
+
+    /**
+     * Get the active settings
+     * @return The active profile
+     */
+    const CameraProfile& getProfile() const;
+
+    /**
+     * Get the number of preset profiles
+     * @return Number of presets, at least 1
+     */
+    static size_t getPresetCount();
+
+    /**
+     * Get a preset profile, preset 0 is the one from Config.h
+     * @param index Preset index, less than getPresetCount()
+     * @return The preset
+     */
+    static const CameraProfile& getPreset(size_t index);
+
     /**
      * Capture a frame from the camera
      * @return Pointer to the camera frame buffer, or NULL on failure
@@ -66,9 +141,16 @@ public:
     void adjustSettings(int brightness, int contrast, int saturation);
 
 private:
-    framesize_t _resolution;
+    CameraProfile _profile;         // Active settings
+    framesize_t _bufferFrameSize;   // Frame size the frame buffers were allocated for
+    volatile uint8_t _quality;      // JPEG quality the sensor is set to
+    SemaphoreHandle_t _sensorMutex; // Registers are written from the protocol handler and the capture task
     bool _initialized;
+    bool _down;                     // A restart and its fallback failed, applyProfile() starts it again
     uint32_t _streamingInterval;
+
+    bool start(const CameraProfile& profile);
+    static framesize_t getLargestPresetSize();
 };
 
 } // namespace Sensors
@@ -0,0 +1,138 @@
+#include "ChangeDetector.h"
+#include <img_converters.h>
+#include "lib/Utils/Memory.h"
+
+namespace Sensors {
+
+ChangeDetector::ChangeDetector()
+    : _rgb(nullptr), _luma(nullptr), _reference(nullptr), _capacity(0), _samples(0), _referenceTime(0),
+      _refreshInterval(0), _lastDifference(0), _unchangedCount(0), _threshold(0), _enabled(true) {
+}
+
+ChangeDetector::~ChangeDetector() {
+    Utils::Memory::release(_rgb);
+    Utils::Memory::release(_luma);
+    Utils::Memory::release(_reference);
+}
+
+void ChangeDetector::setEnabled(bool enabled) {
+    _enabled = enabled;
+}
+
+bool ChangeDetector::isEnabled() const {
+    return _enabled;
+}
+
+void ChangeDetector::setThreshold(uint8_t threshold) {
+    _threshold = threshold;
+}
+
+uint8_t ChangeDetector::getThreshold() const {
+    return _threshold;
+}
+
+void ChangeDetector::setRefreshInterval(uint32_t intervalMs) {
+    _refreshInterval = intervalMs;
+}
+
+bool ChangeDetector::compare(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height) {
+    // Frames compared after detection is turned on again must not match one from before
+    if (!_enabled) {
+        _samples = 0;
+        _lastDifference = 0;
+        return true;
+    }
+
+    size_t samples = (size_t)(width >> 3) * (height >> 3);
+    if (!jpeg || length == 0 || samples == 0 || !reserve(samples) ||
+        !jpg2rgb565(jpeg, length, _rgb, JPG_SCALE_8X)) {
+        _samples = 0;
+        _lastDifference = 0;
+        return true;
+    }
+    toLuma(samples);
+
+    // A new frame size has nothing to compare with
+    bool changed = samples != _samples;
+    if (!changed) {
+        uint32_t sum = sumOfDifferences(_luma, _reference, samples);
+        _lastDifference = sum / samples;
+        changed = sum > (uint32_t)_threshold * samples ||
+                  (_refreshInterval > 0 && millis() - _referenceTime >= _refreshInterval);
+    } else {
+        _lastDifference = 0;
+    }
+
+    if (!changed) {
+        _unchangedCount++;
+        return false;
+    }
+
+    // The changed frame is what later frames are compared with
+    uint8_t* previous = _reference;
+    _reference = _luma;
+    _luma = previous;
+    _samples = samples;
+    _referenceTime = millis();
+    return true;
+}
+
+uint32_t ChangeDetector::getLastDifference() const {
+    return _lastDifference;
+}
+
+uint32_t ChangeDetector::getUnchangedCount() const {
+    return _unchangedCount;
+}
+
+bool ChangeDetector::reserve(size_t samples) {
+    if (samples <= _capacity) {
+        return true;
+    }
+
+    // Planes of a UXGA frame are 30 KB, keep them out of the internal heap when possible
+    Utils::Memory::release(_rgb);
+    Utils::Memory::release(_luma);
+    Utils::Memory::release(_reference);
+    _rgb = (uint8_t*)Utils::Memory::allocate(samples * 2, Utils::MemoryPlacement::PsramFirst);
+    _luma = (uint8_t*)Utils::Memory::allocate(samples, Utils::MemoryPlacement::PsramFirst);
+    _reference = (uint8_t*)Utils::Memory::allocate(samples, Utils::MemoryPlacement::PsramFirst);
+
+    _samples = 0;
+    if (!_rgb || !_luma || !_reference) {
+        Utils::Memory::release(_rgb);
+        Utils::Memory::release(_luma);
+        Utils::Memory::release(_reference);
+        _rgb = nullptr;
+        _luma = nullptr;
+        _reference = nullptr;
+        _capacity = 0;
+        return false;
+    }
+
+    _capacity = samples;
+    return true;
+}
+
+void ChangeDetector::toLuma(size_t samples) {
+    // The decoder writes RGB565 high byte first
+    const uint8_t* rgb = _rgb;
+    for (size_t i = 0; i < samples; i++, rgb += 2) {
+        uint32_t r = rgb[0] & 0xF8;
+        uint32_t g = ((rgb[0] & 0x07) << 5) | ((rgb[1] & 0xE0) >> 3);
+        uint32_t b = (rgb[1] & 0x1F) << 3;
+        _luma[i] = (r * 77 + g * 150 + b * 29) >> 8;
+    }
+}
+
+uint32_t ChangeDetector::sumOfDifferences(const uint8_t* a, const uint8_t* b, size_t samples) {
+    // Straight loop over both planes, compilers turn it into SIMD where the target has it
+    uint32_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        int difference = (int)a[i] - (int)b[i];
+        sum += difference < 0 ? -difference : difference;
+    }
+    return sum;
+}
+
+} // namespace Sensors
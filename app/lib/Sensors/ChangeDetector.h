@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Sensors {
+
+/**
+ * ChangeDetector class
+ *
+ * Tells if a JPEG frame differs from the last frame that changed. Frames are
+ * decoded at 1/8 scale, where the JPEG decoder only uses the DC coefficient
+ * of each 8x8 block, and compared as a luma plane by their sum of absolute
+ * differences. Matching frames are compared with the same reference, so a
+ * slow drift still counts as a change eventually.
+ *
+ * Only one task may call compare(), the settings can be changed from any task.
+ *
+ * Usage example:
+ * ChangeDetector detector;
+ * detector.setThreshold(3);
+ * if (detector.compare(jpeg, length, 320, 240)) { ... }
+ */
+class ChangeDetector {
+public:
+    /**
+     * Constructor
+     * The planes are allocated by the first compared frame
+     */
+    ChangeDetector();
+
+    /**
+     * Destructor
+     */
+    ~ChangeDetector();
+
+    /**
+     * Turn detection on or off, while off every frame counts as changed
+     *
+     * @param enabled true to compare frames
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * Check if frames are compared
+     *
+     * @return true if enabled
+     */
+    bool isEnabled() const;
+
+    /**
+     * Set the mean luma difference per sample a changed frame exceeds
+     *
+     * @param threshold Difference in luma levels, 0-255
+     */
+    void setThreshold(uint8_t threshold);
+
+    /**
+     * Get the mean luma difference per sample a changed frame exceeds
+     *
+     * @return Difference in luma levels
+     */
+    uint8_t getThreshold() const;
+
+    /**
+     * Set how long frames may match the reference before one counts as changed anyway
+     *
+     * @param intervalMs Longest time in milliseconds, 0 to never force a change
+     */
+    void setRefreshInterval(uint32_t intervalMs);
+
+    /**
+     * Compare a frame with the reference, a changed frame becomes the new reference
+     * A frame that can't be decoded counts as changed
+     *
+     * @param jpeg The JPEG frame
+     * @param length Length of the frame
+     * @param width Width of the frame in pixels
+     * @param height Height of the frame in pixels
+     * @return true if the frame changed, false if it matches the reference
+     */
+    bool compare(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height);
+
+    /**
+     * Get the mean luma difference per sample of the last compared frame
+     *
+     * @return Difference in luma levels, 0 if there was nothing to compare with
+     */
+    uint32_t getLastDifference() const;
+
+    /**
+     * Get the number of frames that matched the reference
+     *
+     * @return Number of unchanged frames since construction
+     */
+    uint32_t getUnchangedCount() const;
+
+private:
+    uint8_t* _rgb;                  // Decoded frame, RGB565
+    uint8_t* _luma;                 // Luma plane of the compared frame
+    uint8_t* _reference;            // Luma plane of the last changed frame
+    size_t _capacity;               // Samples the planes have room for
+    size_t _samples;                // Samples in the reference, 0 without one
+    uint32_t _referenceTime;
+    uint32_t _refreshInterval;
+    uint32_t _lastDifference;
+    uint32_t _unchangedCount;
+    volatile uint8_t _threshold;
+    volatile bool _enabled;
+
+    bool reserve(size_t samples);
+    void toLuma(size_t samples);
+    static uint32_t sumOfDifferences(const uint8_t* a, const uint8_t* b, size_t samples);
+};
+
+} // namespace Sensors
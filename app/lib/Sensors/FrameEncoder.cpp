@@ -0,0 +1,96 @@
+#include "FrameEncoder.h"
+#include <img_converters.h>
+#include "lib/Utils/Memory.h"
+
+namespace Sensors {
+
+namespace {
+
+const jpg_scale_t SCALES[] = {JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X};
+
+// The encoder takes 1-100 with higher being better, the sensor's scale is the other way round
+uint8_t toEncoderQuality(uint8_t quality) {
+    uint32_t encoderQuality = quality < 63 ? 100 - (uint32_t)quality * 100 / 64 : 1;
+    return encoderQuality > 0 ? encoderQuality : 1;
+}
+
+} // namespace
+
+uint8_t* FrameEncoder::decode(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                              uint8_t scaleShift) {
+    if (!jpeg || length == 0 || scaleShift > 3) {
+        return nullptr;
+    }
+
+    // A full QVGA frame is 150 KB as RGB565, only PSRAM has room for it
+    size_t pixels = (size_t)(width >> scaleShift) * (height >> scaleShift);
+    uint8_t* rgb = (uint8_t*)Utils::Memory::allocate(pixels * 2, Utils::MemoryPlacement::PsramFirst);
+    if (!rgb) {
+        return nullptr;
+    }
+
+    if (!jpg2rgb565(jpeg, length, rgb, SCALES[scaleShift])) {
+        Utils::Memory::release(rgb);
+        return nullptr;
+    }
+    return rgb;
+}
+
+bool FrameEncoder::encodePreview(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                                 uint8_t scaleShift, uint8_t quality, uint8_t** out, size_t* outLength,
+                                 uint16_t& outWidth, uint16_t& outHeight) {
+    if (scaleShift < 1 || scaleShift > 3) {
+        return false;
+    }
+
+    uint8_t* rgb = decode(jpeg, length, width, height, scaleShift);
+    if (!rgb) {
+        return false;
+    }
+
+    outWidth = width >> scaleShift;
+    outHeight = height >> scaleShift;
+    bool encoded = fmt2jpg(rgb, (size_t)outWidth * outHeight * 2, outWidth, outHeight, PIXFORMAT_RGB565,
+                           toEncoderQuality(quality), out, outLength);
+    Utils::Memory::release(rgb);
+    if (encoded) {
+        // Allocated by the encoder, counted from here on like any other frame buffer
+        Utils::Memory::adopt(*out, *outLength);
+    }
+    return encoded;
+}
+
+bool FrameEncoder::encodeRegion(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                                const FrameRegion& region, uint8_t quality, uint8_t** out, size_t* outLength) {
+    if (!isValidRegion(region, width, height)) {
+        return false;
+    }
+
+    uint8_t* rgb = decode(jpeg, length, width, height, 0);
+    if (!rgb) {
+        return false;
+    }
+
+    // Pack the rows of the region at the start of the buffer, every row moves towards the front
+    size_t rowLength = (size_t)region.width * 2;
+    for (uint16_t row = 0; row < region.height; row++) {
+        const uint8_t* src = rgb + ((size_t)(region.y + row) * width + region.x) * 2;
+        memmove(rgb + row * rowLength, src, rowLength);
+    }
+
+    bool encoded = fmt2jpg(rgb, rowLength * region.height, region.width, region.height, PIXFORMAT_RGB565,
+                           toEncoderQuality(quality), out, outLength);
+    Utils::Memory::release(rgb);
+    if (encoded) {
+        // Allocated by the encoder, counted from here on like any other frame buffer
+        Utils::Memory::adopt(*out, *outLength);
+    }
+    return encoded;
+}
+
+bool FrameEncoder::isValidRegion(const FrameRegion& region, uint16_t width, uint16_t height) {
+    return region.width > 0 && region.height > 0 &&
+           (uint32_t)region.x + region.width <= width && (uint32_t)region.y + region.height <= height;
+}
+
+} // namespace Sensors
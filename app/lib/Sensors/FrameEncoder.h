@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+namespace Sensors {
+
+/**
+ * Rectangle of a frame in pixels
+ */
+struct FrameRegion {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+/**
+ * FrameEncoder class
+ *
+ * Builds smaller JPEGs out of a captured JPEG frame without touching the
+ * sensor: a downscaled preview, or a cropped region of interest. The frame
+ * is decoded to RGB565 in PSRAM and encoded again, the captured frame itself
+ * is left as it is.
+ *
+ * Usage example:
+ * uint8_t* preview;
+ * size_t previewLength;
+ * uint16_t width, height;
+ * if (FrameEncoder::encodePreview(jpeg, length, 320, 240, 2, 20, &preview, &previewLength, width, height)) {
+ *     ...
+ *     Utils::Memory::release(preview);
+ * }
+ */
+class FrameEncoder {
+public:
+    /**
+     * Encode a downscaled copy of a JPEG frame
+     * Decoding at 1/2, 1/4 or 1/8 scale is done by the JPEG decoder itself and costs
+     * less than a full decode
+     *
+     * @param jpeg The JPEG frame
+     * @param length Length of the frame
+     * @param width Width of the frame in pixels
+     * @param height Height of the frame in pixels
+     * @param scaleShift Scale down by 2^scaleShift, 1 to 3
+     * @param quality JPEG quality of the copy, 0-63, lower is better
+     * @param out Set to the encoded copy, release it with Utils::Memory::release()
+     * @param outLength Set to the length of the copy
+     * @param outWidth Set to the width of the copy
+     * @param outHeight Set to the height of the copy
+     * @return true if the copy was encoded, false otherwise
+     */
+    static bool encodePreview(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                              uint8_t scaleShift, uint8_t quality, uint8_t** out, size_t* outLength,
+                              uint16_t& outWidth, uint16_t& outHeight);
+
+    /**
+     * Encode a cropped part of a JPEG frame
+     *
+     * @param jpeg The JPEG frame
+     * @param length Length of the frame
+     * @param width Width of the frame in pixels
+     * @param height Height of the frame in pixels
+     * @param region Part to keep, must lie within the frame
+     * @param quality JPEG quality of the crop, 0-63, lower is better
+     * @param out Set to the encoded crop, release it with Utils::Memory::release()
+     * @param outLength Set to the length of the crop
+     * @return true if the crop was encoded, false otherwise
+     */
+    static bool encodeRegion(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                             const FrameRegion& region, uint8_t quality, uint8_t** out, size_t* outLength);
+
+    /**
+     * Check if a region lies within a frame and is not empty
+     *
+     * @param region Region to check
+     * @param width Width of the frame in pixels
+     * @param height Height of the frame in pixels
+     * @return true if the region can be encoded
+     */
+    static bool isValidRegion(const FrameRegion& region, uint16_t width, uint16_t height);
+
+private:
+    // Decode into a new RGB565 buffer, release it with Utils::Memory::release()
+    static uint8_t* decode(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, uint8_t scaleShift);
+};
+
+} // namespace Sensors
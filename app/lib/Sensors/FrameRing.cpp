@@ -0,0 +1,169 @@
+#include "FrameRing.h"
+#include "lib/Utils/Memory.h"
+
+namespace Sensors {
+
+FrameRing::FrameRing()
+    : _slots(nullptr), _capacity(0), _nextSequence(1), _newestSequence(0),
+      _overwrittenCount(0), _droppedCount(0), _mux(portMUX_INITIALIZER_UNLOCKED) {
+}
+
+FrameRing::~FrameRing() {
+    if (_slots) {
+        for (size_t i = 0; i < _capacity; i++) {
+            Utils::Memory::release(_slots[i].data);
+        }
+        free(_slots);
+    }
+}
+
+bool FrameRing::init(size_t capacity) {
+    if (_slots || capacity == 0) {
+        return _slots != nullptr;
+    }
+
+    _slots = (FrameSlot*)calloc(capacity, sizeof(FrameSlot));
+    if (!_slots) {
+        return false;
+    }
+
+    _capacity = capacity;
+    return true;
+}
+
+bool FrameRing::isReady() const {
+    return _slots != nullptr;
+}
+
+FrameSlot* FrameRing::beginWrite(size_t length) {
+    if (!_slots) {
+        return nullptr;
+    }
+
+    // Oldest slot nobody holds, empty slots first
+    portENTER_CRITICAL(&_mux);
+    FrameSlot* slot = nullptr;
+    for (size_t i = 0; i < _capacity; i++) {
+        FrameSlot& candidate = _slots[i];
+        if (candidate.readers > 0 || candidate.writing) {
+            continue;
+        }
+        if (!slot || candidate.sequence < slot->sequence) {
+            slot = &candidate;
+        }
+    }
+
+    if (!slot) {
+        _droppedCount++;
+        portEXIT_CRITICAL(&_mux);
+        return nullptr;
+    }
+
+    if (slot->sequence != 0 && !slot->fetched) {
+        _overwrittenCount++;
+    }
+    slot->sequence = 0;  // No longer available to acquire()
+    slot->writing = true;
+    portEXIT_CRITICAL(&_mux);
+
+    // Grow the buffer outside the lock, once it fits the usual frame size this never happens again
+    if (slot->capacity < length) {
+        uint8_t* data = (uint8_t*)Utils::Memory::reallocate(slot->data, length, Utils::MemoryPlacement::PsramFirst);
+        if (!data) {
+            portENTER_CRITICAL(&_mux);
+            _droppedCount++;
+            portEXIT_CRITICAL(&_mux);
+            abortWrite(slot);
+            return nullptr;
+        }
+        slot->data = data;
+        slot->capacity = length;
+    }
+
+    return slot;
+}
+
+uint32_t FrameRing::commitWrite(FrameSlot* slot) {
+    portENTER_CRITICAL(&_mux);
+    uint32_t sequence = _nextSequence++;
+    slot->sequence = sequence;
+    slot->fetched = false;
+    slot->writing = false;
+    _newestSequence = sequence;
+    portEXIT_CRITICAL(&_mux);
+
+    return sequence;
+}
+
+void FrameRing::abortWrite(FrameSlot* slot) {
+    portENTER_CRITICAL(&_mux);
+    slot->sequence = 0;
+    slot->writing = false;
+    portEXIT_CRITICAL(&_mux);
+}
+
+const FrameSlot* FrameRing::acquire(uint32_t sequence) {
+    if (!_slots || sequence == 0) {
+        return nullptr;
+    }
+
+    portENTER_CRITICAL(&_mux);
+    FrameSlot* slot = nullptr;
+    for (size_t i = 0; i < _capacity; i++) {
+        if (_slots[i].sequence == sequence) {
+            slot = &_slots[i];
+            slot->readers++;
+            slot->fetched = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    return slot;
+}
+
+void FrameRing::release(const FrameSlot* slot) {
+    if (!slot) {
+        return;
+    }
+
+    portENTER_CRITICAL(&_mux);
+    FrameSlot* held = const_cast<FrameSlot*>(slot);
+    if (held->readers > 0) {
+        held->readers--;
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+uint32_t FrameRing::getNewestSequence() const {
+    return _newestSequence;
+}
+
+uint32_t FrameRing::getOldestSequence() {
+    uint32_t oldest = 0;
+
+    portENTER_CRITICAL(&_mux);
+    for (size_t i = 0; i < _capacity; i++) {
+        uint32_t sequence = _slots[i].sequence;
+        if (sequence != 0 && (oldest == 0 || sequence < oldest)) {
+            oldest = sequence;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    return oldest;
+}
+
+uint32_t FrameRing::getOverwrittenCount() const {
+    return _overwrittenCount;
+}
+
+uint32_t FrameRing::getDroppedCount() const {
+    return _droppedCount;
+}
+
+size_t FrameRing::capacity() const {
+    return _capacity;
+}
+
+} // namespace Sensors
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Sensors {
+
+/**
+ * Microsecond timestamps of the stages a frame goes through, in esp_timer time
+ * A stage not reached yet is 0
+ */
+struct FrameTimestamps {
+    int64_t sensor;         // Sensor started the frame at VSYNC, fb->timestamp
+    int64_t captured;       // esp_camera_fb_get() returned the frame
+    int64_t stored;         // Copied and checksummed, ready to be requested
+    int64_t firstBlock;     // First block staged for the master
+    int64_t lastBlock;      // Last block clocked out by the master, queued while streaming
+};
+
+/**
+ * Frame held in the ring
+ * The buffer is reused for later frames and only grows when a frame doesn't fit
+ */
+struct FrameSlot {
+    uint8_t* data;          // Frame data, in PSRAM when available
+    size_t capacity;        // Size of the data buffer
+    size_t length;          // Length of the frame data
+    uint32_t sequence;      // Sequence number, 0 while empty or being written
+    uint16_t width;         // Width of the frame in pixels
+    uint16_t height;        // Height of the frame in pixels
+    uint32_t captureTime;   // Timestamp of when the frame was captured
+    uint32_t crc;           // CRC32 of the frame data
+    uint32_t unchangedSince; // Sequence of the last changed frame this one matches, 0 if it changed
+    uint8_t quality;        // JPEG quality the sensor was set to
+    FrameTimestamps timestamps; // Capture stages, the transfer stages stay 0
+    uint8_t readers;        // Number of holders, the slot is not overwritten while > 0
+    bool writing;           // Claimed by the writer
+    bool fetched;           // Acquired at least once since it was written
+};
+
+/**
+ * FrameRing class
+ *
+ * Fixed number of camera frames with increasing sequence numbers. The writer
+ * always overwrites the oldest frame nobody holds, so readers can fetch any
+ * frame still in the ring by its sequence number.
+ *
+ * Usage example:
+ * FrameSlot* slot = ring.beginWrite(fb->len);
+ * memcpy(slot->data, fb->buf, fb->len);
+ * slot->length = fb->len;
+ * uint32_t sequence = ring.commitWrite(slot);
+ *
+ * const FrameSlot* frame = ring.acquire(sequence);
+ * ...
+ * ring.release(frame);
+ */
+class FrameRing {
+public:
+    /**
+     * Constructor
+     */
+    FrameRing();
+
+    /**
+     * Destructor
+     */
+    ~FrameRing();
+
+    /**
+     * Allocate the ring
+     * Buffers are allocated by the first frames written into each slot
+     *
+     * @param capacity Number of frames kept
+     * @return true if the ring was allocated, false otherwise
+     */
+    bool init(size_t capacity);
+
+    /**
+     * Check if the ring is allocated
+     *
+     * @return true if frames can be written
+     */
+    bool isReady() const;
+
+    /**
+     * Claim the oldest free slot for a new frame
+     * Fill in data, length and the frame metadata, then call commitWrite()
+     *
+     * @param length Length of the frame that will be written
+     * @return Slot with room for the frame, or nullptr if the frame has to be dropped
+     */
+    FrameSlot* beginWrite(size_t length);
+
+    /**
+     * Publish a written frame
+     *
+     * @param slot Slot returned by beginWrite()
+     * @return Sequence number of the frame
+     */
+    uint32_t commitWrite(FrameSlot* slot);
+
+    /**
+     * Give back a claimed slot without publishing it
+     *
+     * @param slot Slot returned by beginWrite()
+     */
+    void abortWrite(FrameSlot* slot);
+
+    /**
+     * Hold a frame so it is not overwritten
+     *
+     * @param sequence Sequence number of the frame
+     * @return The frame, or nullptr if it is no longer in the ring
+     */
+    const FrameSlot* acquire(uint32_t sequence);
+
+    /**
+     * Let a held frame be overwritten again
+     *
+     * @param slot Frame returned by acquire()
+     */
+    void release(const FrameSlot* slot);
+
+    /**
+     * Get the sequence number of the newest frame
+     *
+     * @return Sequence number, 0 if no frame was written yet
+     */
+    uint32_t getNewestSequence() const;
+
+    /**
+     * Get the sequence number of the oldest frame still in the ring
+     *
+     * @return Sequence number, 0 if the ring is empty
+     */
+    uint32_t getOldestSequence();
+
+    /**
+     * Get the number of frames overwritten before anyone acquired them
+     *
+     * @return Number of overwritten frames since init
+     */
+    uint32_t getOverwrittenCount() const;
+
+    /**
+     * Get the number of frames that could not be stored
+     *
+     * @return Number of dropped frames since init
+     */
+    uint32_t getDroppedCount() const;
+
+    /**
+     * Get the number of frames the ring holds
+     *
+     * @return Ring capacity
+     */
+    size_t capacity() const;
+
+private:
+    FrameSlot* _slots;
+    size_t _capacity;
+    volatile uint32_t _nextSequence;
+    volatile uint32_t _newestSequence;
+    volatile uint32_t _overwrittenCount;
+    volatile uint32_t _droppedCount;
+    portMUX_TYPE _mux;
+};
+
+} // namespace Sensors
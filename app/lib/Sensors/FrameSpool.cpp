@@ -0,0 +1,331 @@
+#include "FrameSpool.h"
+#include <esp_crc.h>
+#include "lib/Utils/Memory.h"
+
+namespace Sensors {
+
+FrameSpool::FrameSpool(Utils::FileManager* fileManager)
+    : _fileManager(fileManager), _ring(nullptr), _entries(nullptr), _maxFrames(0), _segmentLimit(0), _segmentSize(0),
+      _count(0), _indexedCount(0), _flushed(0), _batch(nullptr), _batchLength(0), _lastAppendTime(0),
+      _lastSequence(0), _missedCount(0), _enabled(true), _clearRequested(false), _spooling(false),
+      _taskHandle(nullptr), _mux(portMUX_INITIALIZER_UNLOCKED) {
+}
+
+FrameSpool::~FrameSpool() {
+    if (_taskHandle) {
+        vTaskDelete(_taskHandle);
+    }
+    if (_entries) {
+        flushBatch();
+        _segment.close();
+        _index.close();
+    }
+    Utils::Memory::release(_entries);
+    Utils::Memory::release(_batch);
+}
+
+bool FrameSpool::init(const char* directory, size_t segmentSize, size_t maxFrames) {
+    if (_entries || !_fileManager || maxFrames == 0) {
+        return _entries != nullptr;
+    }
+
+    _segmentPath = String(directory) + "/segment.bin";
+    _indexPath = String(directory) + "/index.bin";
+
+    // The index can get large, the batch is written from often and stays internal
+    _entries = (SpoolEntry*)Utils::Memory::allocate(maxFrames * sizeof(SpoolEntry), Utils::MemoryPlacement::PsramFirst);
+    _batch = (uint8_t*)Utils::Memory::allocate(SPOOL_WRITE_BATCH, Utils::MemoryPlacement::Internal);
+    if (!_entries || !_batch) {
+        Utils::Memory::release(_entries);
+        Utils::Memory::release(_batch);
+        _entries = nullptr;
+        _batch = nullptr;
+        return false;
+    }
+    memset(_entries, 0, maxFrames * sizeof(SpoolEntry));
+    _maxFrames = maxFrames;
+
+    _segmentLimit = segmentSize;
+
+    if (!loadIndex()) {
+        resetFiles();
+    }
+    reserveSegment();
+
+    _segment = _fileManager->openFile(_segmentPath, "a");
+    _index = _fileManager->openFile(_indexPath, "a");
+    return _segment && _index;
+}
+
+bool FrameSpool::start(FrameRing* ring, UBaseType_t priority, BaseType_t core) {
+    if (_taskHandle) {
+        return true;
+    }
+    if (!_entries || !ring) {
+        return false;
+    }
+
+    _ring = ring;
+    if (xTaskCreatePinnedToCore(spoolTask, "frame_spool", 4096, this, priority, &_taskHandle, core) != pdPASS) {
+        _taskHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void FrameSpool::setEnabled(bool enabled) {
+    _enabled = enabled;
+}
+
+bool FrameSpool::isEnabled() const {
+    return _enabled;
+}
+
+void FrameSpool::clear() {
+    _clearRequested = true;
+}
+
+size_t FrameSpool::getFrameCount() const {
+    return _count;
+}
+
+bool FrameSpool::getEntry(size_t index, SpoolEntry& entry) const {
+    if (index >= _count) {
+        return false;
+    }
+
+    // Entries below _count are never modified, only clear() takes them away
+    entry = _entries[index];
+    return true;
+}
+
+bool FrameSpool::isReadable(const SpoolEntry& entry) const {
+    return entry.offset + entry.length <= _flushed;
+}
+
+bool FrameSpool::readFrame(const SpoolEntry& entry, uint8_t* buffer) {
+    if (!buffer || !isReadable(entry)) {
+        return false;
+    }
+
+    int count = _fileManager->readAt(_segmentPath, entry.offset, buffer, entry.length);
+    return count == (int)entry.length && esp_crc32_le(0, buffer, entry.length) == entry.crc;
+}
+
+size_t FrameSpool::getUsedBytes() const {
+    return _flushed + _batchLength;
+}
+
+size_t FrameSpool::getSegmentSize() const {
+    return _segmentSize;
+}
+
+uint32_t FrameSpool::getMissedCount() const {
+    return _missedCount;
+}
+
+void FrameSpool::spoolTask(void* parameter) {
+    FrameSpool* spool = static_cast<FrameSpool*>(parameter);
+
+    while (true) {
+        if (spool->_clearRequested) {
+            spool->resetFiles();
+            spool->_clearRequested = false;
+        }
+
+        // Frames captured while spooling was off are not missed, start at the oldest one left
+        if (spool->_enabled && !spool->_spooling) {
+            uint32_t oldest = spool->_ring->getOldestSequence();
+            spool->_lastSequence = oldest ? oldest - 1 : spool->_ring->getNewestSequence();
+        }
+        spool->_spooling = spool->_enabled;
+
+        if (spool->_spooling && spool->_ring->getNewestSequence() > spool->_lastSequence) {
+            spool->spoolNext();
+            continue;
+        }
+
+        // Idle, get the last frames onto flash so they can be fetched
+        if (spool->_batchLength > 0 && millis() - spool->_lastAppendTime >= SPOOL_FLUSH_INTERVAL_MS) {
+            spool->flushBatch();
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void FrameSpool::spoolNext() {
+    // Frames the ring already overwrote can't be spooled anymore
+    uint32_t next = _lastSequence + 1;
+    uint32_t oldest = _ring->getOldestSequence();
+    if (oldest > next) {
+        _missedCount += oldest - next;
+        next = oldest;
+    }
+    _lastSequence = next;
+
+    // Holding the slot keeps the ring from overwriting it while it is copied
+    const FrameSlot* slot = _ring->acquire(next);
+    if (!slot) {
+        _missedCount++;
+        return;
+    }
+
+    appendFrame(slot);
+    _ring->release(slot);
+}
+
+bool FrameSpool::appendFrame(const FrameSlot* slot) {
+    size_t offset = _flushed + _batchLength;
+    if (_count >= _maxFrames || offset + slot->length > _segmentSize) {
+        _missedCount++;
+        return false;
+    }
+
+    const uint8_t* data = slot->data;
+    size_t remaining = slot->length;
+    while (remaining > 0) {
+        // Batches end on sector boundaries, also after an early flush
+        size_t room = SPOOL_WRITE_BATCH - (_flushed + _batchLength) % SPOOL_WRITE_BATCH;
+        size_t count = remaining < room ? remaining : room;
+        memcpy(_batch + _batchLength, data, count);
+        _batchLength += count;
+        data += count;
+        remaining -= count;
+
+        if (count == room && !flushBatch()) {
+            _missedCount++;
+            return false;
+        }
+    }
+
+    SpoolEntry& entry = _entries[_count];
+    entry.offset = offset;
+    entry.length = slot->length;
+    entry.sequence = slot->sequence;
+    entry.captureTime = slot->captureTime;
+    entry.crc = slot->crc;
+    entry.width = slot->width;
+    entry.height = slot->height;
+
+    portENTER_CRITICAL(&_mux);
+    _count++;
+    portEXIT_CRITICAL(&_mux);
+
+    _lastAppendTime = millis();
+
+    // Frames that ended in a full batch are on flash already
+    return writeIndex();
+}
+
+bool FrameSpool::flushBatch() {
+    if (_batchLength == 0) {
+        return true;
+    }
+
+    size_t written = _segment.write(_batch, _batchLength);
+    _segment.flush();
+    bool complete = written == _batchLength;
+
+    portENTER_CRITICAL(&_mux);
+    _flushed += written;
+    if (!complete) {
+        // Frames that didn't make it to flash are gone, and so is the room for more
+        while (_count > _indexedCount && _entries[_count - 1].offset + _entries[_count - 1].length > _flushed) {
+            _count--;
+        }
+        _segmentSize = _flushed;
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    _batchLength = 0;
+    return writeIndex() && complete;
+}
+
+bool FrameSpool::writeIndex() {
+    size_t start = _indexedCount;
+    while (_indexedCount < _count && isReadable(_entries[_indexedCount])) {
+        if (_index.write((const uint8_t*)&_entries[_indexedCount], sizeof(SpoolEntry)) != sizeof(SpoolEntry)) {
+            return false;
+        }
+        _indexedCount++;
+    }
+
+    if (_indexedCount != start) {
+        _index.flush();
+    }
+    return true;
+}
+
+bool FrameSpool::loadIndex() {
+    int segmentBytes = _fileManager->exists(_segmentPath) ? _fileManager->getSize(_segmentPath) : 0;
+    int indexBytes = _fileManager->exists(_indexPath) ? _fileManager->getSize(_indexPath) : 0;
+    if (segmentBytes < 0 || indexBytes < 0) {
+        return false;
+    }
+
+    size_t records = indexBytes / sizeof(SpoolEntry);
+    if (records > _maxFrames) {
+        records = _maxFrames;
+    }
+    if (records > 0) {
+        int count = _fileManager->readAt(_indexPath, 0, (uint8_t*)_entries, records * sizeof(SpoolEntry));
+        if (count != (int)(records * sizeof(SpoolEntry))) {
+            return false;
+        }
+    }
+
+    // Records are only written once their data is on flash, anything else is a torn write
+    size_t valid = 0;
+    size_t end = 0;
+    while (valid < records && _entries[valid].offset >= end &&
+           _entries[valid].offset + _entries[valid].length <= (size_t)segmentBytes) {
+        end = _entries[valid].offset + _entries[valid].length;
+        valid++;
+    }
+
+    // Appending after a partial record would shift every later one, rewrite the good part
+    if (valid * sizeof(SpoolEntry) != (size_t)indexBytes) {
+        Utils::FileWriter writer;
+        if (!writer.open(_indexPath) ||
+            !writer.write((const uint8_t*)_entries, valid * sizeof(SpoolEntry)) ||
+            !writer.commit()) {
+            return false;
+        }
+    }
+
+    _count = valid;
+    _indexedCount = valid;
+    _flushed = segmentBytes;
+    return true;
+}
+
+void FrameSpool::reserveSegment() {
+    // SPIFFS can't preallocate, size the segment to the space left now so it doesn't run out half way
+    size_t indexReserve = (_maxFrames - _count) * sizeof(SpoolEntry);
+    size_t freeBytes = _fileManager->getFreeBytes();
+    size_t available = _flushed + (freeBytes > indexReserve ? freeBytes - indexReserve : 0);
+    _segmentSize = _segmentLimit < available ? _segmentLimit : available;
+}
+
+void FrameSpool::resetFiles() {
+    _segment.close();
+    _index.close();
+    _fileManager->deleteFile(_segmentPath);
+    _fileManager->deleteFile(_indexPath);
+
+    portENTER_CRITICAL(&_mux);
+    _count = 0;
+    _flushed = 0;
+    portEXIT_CRITICAL(&_mux);
+    _indexedCount = 0;
+    _batchLength = 0;
+
+    // Only reopen once init() did, it opens the files itself
+    if (_taskHandle) {
+        reserveSegment();
+        _segment = _fileManager->openFile(_segmentPath, "a");
+        _index = _fileManager->openFile(_indexPath, "a");
+    }
+}
+
+} // namespace Sensors
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FrameRing.h"
+#include "lib/Utils/FileManager.h"
+
+// Bytes collected before they are written to flash, a multiple of the 4 KB flash sector
+#ifndef SPOOL_WRITE_BATCH
+#define SPOOL_WRITE_BATCH 4096
+#endif
+
+// A partly filled batch is written once no frame arrived for this long
+#ifndef SPOOL_FLUSH_INTERVAL_MS
+#define SPOOL_FLUSH_INTERVAL_MS 500
+#endif
+
+namespace Sensors {
+
+/**
+ * Frame stored in the spool
+ * Also the record format of the index file
+ */
+struct SpoolEntry {
+    uint32_t offset;        // Position of the frame in the segment file
+    uint32_t length;        // Length of the frame data
+    uint32_t sequence;      // Sequence number the frame had in the ring
+    uint32_t captureTime;   // Timestamp of when the frame was captured
+    uint32_t crc;           // CRC32 of the frame data
+    uint16_t width;         // Width of the frame in pixels
+    uint16_t height;        // Height of the frame in pixels
+};
+
+/**
+ * FrameSpool class
+ *
+ * Copies every frame committed to a FrameRing into an append-only segment
+ * file on flash, so frames the master had no time for can be fetched later.
+ * A task of its own does the copying and all flash writes, the frames are
+ * collected into SPOOL_WRITE_BATCH sized writes on sector boundaries.
+ * The index of the frames is kept in memory and appended to an index file
+ * once their data is on flash, frames spooled before a reset stay available.
+ *
+ * The spool only grows, when the segment or the index is full new frames are
+ * counted as missed until clear() is called.
+ *
+ * Usage example:
+ * spool.init("/spool", 512 * 1024, 256);
+ * spool.start(&ring, 3, 1);
+ * ...
+ * SpoolEntry entry;
+ * if (spool.getEntry(0, entry) && spool.readFrame(entry, buffer)) { ... }
+ */
+class FrameSpool {
+public:
+    /**
+     * Constructor
+     *
+     * @param fileManager Initialized file manager the spool files are written through
+     */
+    FrameSpool(Utils::FileManager* fileManager);
+
+    /**
+     * Destructor
+     */
+    ~FrameSpool();
+
+    /**
+     * Open the spool files and load the index of frames spooled earlier
+     *
+     * @param directory Directory of the segment and index files
+     * @param segmentSize Largest size of the segment file, reduced to the free space
+     * @param maxFrames Number of frames the index holds
+     * @return true if the spool can be used, false otherwise
+     */
+    bool init(const char* directory, size_t segmentSize, size_t maxFrames);
+
+    /**
+     * Start spooling the frames of a ring on the spool task
+     *
+     * @param ring Ring the camera captures into
+     * @param priority FreeRTOS priority of the spool task
+     * @param core Core the spool task is pinned to
+     * @return true if the task is running, false otherwise
+     */
+    bool start(FrameRing* ring, UBaseType_t priority, BaseType_t core);
+
+    /**
+     * Turn spooling on or off, frames already spooled are kept
+     *
+     * @param enabled true to spool new frames
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * Check if new frames are spooled
+     *
+     * @return true if enabled
+     */
+    bool isEnabled() const;
+
+    /**
+     * Drop all spooled frames
+     * Done by the spool task, returns right away
+     */
+    void clear();
+
+    /**
+     * Get the number of spooled frames
+     *
+     * @return Number of frames in the index
+     */
+    size_t getFrameCount() const;
+
+    /**
+     * Get a spooled frame
+     *
+     * @param index Position of the frame, 0 is the oldest
+     * @param entry Entry to fill in
+     * @return true if there is such a frame
+     */
+    bool getEntry(size_t index, SpoolEntry& entry) const;
+
+    /**
+     * Check if the data of a spooled frame has been written to flash
+     *
+     * @param entry Entry returned by getEntry()
+     * @return true if readFrame() can read it
+     */
+    bool isReadable(const SpoolEntry& entry) const;
+
+    /**
+     * Read a spooled frame from flash and check its CRC
+     *
+     * @param entry Entry returned by getEntry()
+     * @param buffer Buffer of at least entry.length bytes
+     * @return true if the frame was read intact
+     */
+    bool readFrame(const SpoolEntry& entry, uint8_t* buffer);
+
+    /**
+     * Get the number of bytes in the segment file
+     *
+     * @return Bytes spooled, including data not written to flash yet
+     */
+    size_t getUsedBytes() const;
+
+    /**
+     * Get the largest size of the segment file
+     *
+     * @return Segment size in bytes
+     */
+    size_t getSegmentSize() const;
+
+    /**
+     * Get the number of frames that were not spooled
+     * The spool was full, or the ring overwrote them before the spool got to them
+     *
+     * @return Number of missed frames since init
+     */
+    uint32_t getMissedCount() const;
+
+private:
+    Utils::FileManager* _fileManager;
+    FrameRing* _ring;
+    String _segmentPath;
+    String _indexPath;
+    File _segment;
+    File _index;
+
+    SpoolEntry* _entries;
+    size_t _maxFrames;
+    size_t _segmentLimit;           // Segment size asked for in init()
+    size_t _segmentSize;            // What the file system had room for
+    volatile size_t _count;         // Entries readers may look at
+    size_t _indexedCount;           // Entries written to the index file
+    volatile size_t _flushed;       // Bytes written to the segment file
+
+    uint8_t* _batch;
+    size_t _batchLength;
+    uint32_t _lastAppendTime;
+
+    uint32_t _lastSequence;         // Newest ring sequence looked at
+    volatile uint32_t _missedCount;
+    volatile bool _enabled;
+    volatile bool _clearRequested;
+    bool _spooling;
+    TaskHandle_t _taskHandle;
+    portMUX_TYPE _mux;
+
+    static void spoolTask(void* parameter);
+    void spoolNext();
+    bool appendFrame(const FrameSlot* slot);
+    bool flushBatch();
+    bool writeIndex();
+    bool loadIndex();
+    void reserveSegment();
+    void resetFiles();
+};
+
+} // namespace Sensors
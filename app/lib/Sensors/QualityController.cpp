@@ -0,0 +1,80 @@
+#include "QualityController.h"
+
+namespace Sensors {
+
+namespace {
+
+// Largest quality change for one frame
+const uint32_t MAX_STEP = 8;
+
+} // namespace
+
+QualityController::QualityController()
+    : _target(0), _best(4), _worst(63), _settleFrames(2), _framesSinceChange(0), _overBudgetCount(0) {
+}
+
+void QualityController::setTarget(size_t bytes) {
+    _target = bytes;
+}
+
+size_t QualityController::getTarget() const {
+    return _target;
+}
+
+bool QualityController::isEnabled() const {
+    return _target > 0;
+}
+
+void QualityController::setLimits(uint8_t best, uint8_t worst) {
+    _best = best;
+    _worst = worst > best ? worst : best;
+}
+
+void QualityController::setSettleFrames(uint8_t frames) {
+    _settleFrames = frames;
+}
+
+uint8_t QualityController::update(size_t length, uint8_t quality) {
+    size_t target = _target;
+    if (target == 0) {
+        return quality;
+    }
+
+    if (length > target) {
+        _overBudgetCount++;
+    }
+
+    // Frames captured before the last change say nothing about the new quality
+    if (_framesSinceChange < _settleFrames) {
+        _framesSinceChange++;
+        return quality;
+    }
+
+    // Higher values are lower quality. Getting back under the budget is what matters,
+    // so the controller backs off fast and creeps back up one step at a time
+    uint32_t next = quality;
+    if (length > target) {
+        uint32_t step = 1 + (uint32_t)((length - target) * 8 / target);
+        next += step < MAX_STEP ? step : MAX_STEP;
+    } else if (length < target - target / 8 && next > 0) {
+        next--;
+    }
+
+    if (next < _best) {
+        next = _best;
+    }
+    if (next > _worst) {
+        next = _worst;
+    }
+
+    if (next != quality) {
+        _framesSinceChange = 0;
+    }
+    return next;
+}
+
+uint32_t QualityController::getOverBudgetCount() const {
+    return _overBudgetCount;
+}
+
+} // namespace Sensors
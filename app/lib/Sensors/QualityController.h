@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Sensors {
+
+/**
+ * QualityController class
+ *
+ * Closed-loop JPEG quality control that keeps captured frames under a byte
+ * budget. Every frame size is fed back and the quality for the next frames
+ * is returned. A frame over the budget lowers the quality right away, more
+ * steps the further it is over. A frame well under it raises the quality
+ * one step. After a change the frames already in the camera's buffers are
+ * not looked at, they were compressed with the old quality.
+ *
+ * Only one task may call update(), the target can be set from any task.
+ *
+ * Usage example:
+ * QualityController controller;
+ * controller.setTarget(8 * blockSize);
+ * camera->setQuality(controller.update(fb->len, camera->getQuality()));
+ */
+class QualityController {
+public:
+    /**
+     * Constructor
+     * Starts disabled, setTarget() turns it on
+     */
+    QualityController();
+
+    /**
+     * Set the byte budget of a frame
+     *
+     * @param bytes Largest frame length wanted, 0 disables the controller
+     */
+    void setTarget(size_t bytes);
+
+    /**
+     * Get the byte budget of a frame
+     *
+     * @return Target frame length, 0 while disabled
+     */
+    size_t getTarget() const;
+
+    /**
+     * Check if the quality is controlled
+     *
+     * @return true if a target is set
+     */
+    bool isEnabled() const;
+
+    /**
+     * Limit the quality the controller picks
+     *
+     * @param best Best quality allowed, lowest value
+     * @param worst Worst quality allowed, highest value
+     */
+    void setLimits(uint8_t best, uint8_t worst);
+
+    /**
+     * Set the number of frames skipped after a change
+     *
+     * @param frames Frames captured before the new quality applies, usually the frame buffer count
+     */
+    void setSettleFrames(uint8_t frames);
+
+    /**
+     * Feed back the length of a captured frame
+     *
+     * @param length Length of the frame
+     * @param quality Quality the sensor is set to now, 0-63
+     * @return Quality for the next frames, quality itself while disabled
+     */
+    uint8_t update(size_t length, uint8_t quality);
+
+    /**
+     * Get the number of frames that were over the budget
+     *
+     * @return Frames over the target since construction
+     */
+    uint32_t getOverBudgetCount() const;
+
+private:
+    volatile size_t _target;
+    uint8_t _best;
+    uint8_t _worst;
+    uint8_t _settleFrames;
+    uint8_t _framesSinceChange;
+    uint32_t _overBudgetCount;
+};
+
+} // namespace Sensors
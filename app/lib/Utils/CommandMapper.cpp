@@ -3,13 +3,63 @@
 
 namespace Utils {
 
+namespace {
+
+bool isNameChar(char c) {
+    return (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool isParamChar(char c) {
+    return (c >= '0' && c <= '9') || c == 'm' || c == 's' || c == 'h';
+}
+
+// Match [A-Z_]+(=[0-9msh]+)?] right after the '[' at start
+bool matchCommandAt(SstringView text, size_t start, CommandToken& token) {
+    size_t length = text.length();
+    size_t pos = start + 1;
+
+    size_t nameStart = pos;
+    while (pos < length && isNameChar(text[pos])) {
+        pos++;
+    }
+    if (pos == nameStart) {
+        return false;
+    }
+    SstringView name = text.substring(nameStart, pos - nameStart);
+
+    SstringView param;
+    if (pos < length && text[pos] == '=') {
+        size_t paramStart = ++pos;
+        while (pos < length && isParamChar(text[pos])) {
+            pos++;
+        }
+        if (pos == paramStart) {
+            return false;
+        }
+        param = text.substring(paramStart, pos - paramStart);
+    }
+
+    if (pos >= length || text[pos] != ']') {
+        return false;
+    }
+
+    token.text = text.substring(start, pos + 1 - start);
+    token.name = name;
+    token.param = param;
+    return true;
+}
+
+} // namespace
+
 CommandMapper::CommandMapper(Utils::Logger *logger) {
     _logger = logger;
     initCommandHandlers();
 }
 
 void CommandMapper::initCommandHandlers() {
-    // _commandHandlers["LOOK_AROUND"] = [this](const String& param) -> bool {
+    // registerCommand("LOOK_AROUND", &CommandMapper::lookAround);
+    //
+    // bool CommandMapper::lookAround(SstringView param) {
     //     if (_screen && _screen->getFace()) {
     //         _screen->getFace()->LookLeft();
     //         delay(500);
@@ -24,134 +74,185 @@ void CommandMapper::initCommandHandlers() {
     //         return true;
     //     }
     //     return false;
-    // };
+    // }
 }
 
-bool CommandMapper::executeCommand(const String& commandStr) {
-    // Extract command and parameter using regex
-    std::regex cmdRegex("\\[([A-Z_]+)(?:=([0-9msh]+))?\\]");
-    std::cmatch matches;
-    std::string cmdStrStd = commandStr.c_str();
-    
-    if (std::regex_match(cmdStrStd.c_str(), matches, cmdRegex)) {
-        String command = String(matches[1].str().c_str());
-        String parameter = matches.size() > 2 ? String(matches[2].str().c_str()) : "";
-        
-        _logger->debug("Executing command: " + command + (parameter.isEmpty() ? "" : " with param: " + parameter));
-        
-        // Look up command handler
-        if (_commandHandlers.count(command.c_str()) > 0) {
-            return _commandHandlers[command.c_str()](parameter);
+bool CommandMapper::registerCommand(const char* name, CommandHandler handler) {
+    SstringView entryName(name);
+    if (_commandCount >= MAX_COMMANDS || findCommand(entryName)) {
+        return false;
+    }
+
+    // Insertion keeps the table sorted, this only runs at construction
+    size_t index = _commandCount;
+    while (index > 0 && entryName.compareTo(_commands[index - 1].name) < 0) {
+        _commands[index] = _commands[index - 1];
+        index--;
+    }
+    _commands[index] = {entryName, handler};
+    _commandCount++;
+    return true;
+}
+
+CommandMapper::CommandHandler CommandMapper::findCommand(SstringView name) const {
+    size_t low = 0;
+    size_t high = _commandCount;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = name.compareTo(_commands[mid].name);
+        if (order == 0) {
+            return _commands[mid].handler;
+        }
+        if (order < 0) {
+            high = mid;
         } else {
-            _logger->warning("Unknown command: " + command);
+            low = mid + 1;
+        }
+    }
+    return nullptr;
+}
+
+bool CommandMapper::nextCommand(SstringView text, size_t& pos, CommandToken& token) {
+    // Only a '[' can start a command, a failed match resumes right after it
+    while (pos < text.length()) {
+        int start = text.indexOf('[', pos);
+        if (start < 0) {
+            pos = text.length();
             return false;
         }
+
+        if (matchCommandAt(text, start, token)) {
+            pos = start + token.text.length();
+            return true;
+        }
+        pos = start + 1;
     }
-    
-    _logger->warning("Invalid command format: " + commandStr);
+    return false;
+}
+
+bool CommandMapper::execute(const CommandToken& token) {
+    SstringView name = token.name;
+    if (!token.param.isEmpty()) {
+        _logger->debug("Executing command: %.*s with param: %.*s",
+                       (int)name.length(), name.data(), (int)token.param.length(), token.param.data());
+    } else {
+        _logger->debug("Executing command: %.*s", (int)name.length(), name.data());
+    }
+
+    // Look up command handler
+    CommandHandler handler = findCommand(name);
+    if (!handler) {
+        _logger->warning("Unknown command: %.*s", (int)name.length(), name.data());
+        return false;
+    }
+
+    return (this->*handler)(token.param);
+}
+
+bool CommandMapper::executeCommand(const String& commandStr) {
+    return executeCommand(SstringView(commandStr));
+}
+
+bool CommandMapper::executeCommand(SstringView command) {
+    // The whole string has to be exactly one command
+    CommandToken token;
+    if (command.startsWith("[") && matchCommandAt(command, 0, token) &&
+        token.text.length() == command.length()) {
+        return execute(token);
+    }
+
+    _logger->warning("Invalid command format: %.*s", (int)command.length(), command.data());
     return false;
 }
 
 int CommandMapper::executeCommandString(const String& multiCommandStr) {
-    // Extract all commands from string
-    std::regex cmdRegex("\\[([A-Z_]+)(?:=([0-9msh]+))?\\]");
-    std::string multiCmdStd = multiCommandStr.c_str();
-    std::sregex_iterator it(multiCmdStd.begin(), multiCmdStd.end(), cmdRegex);
-    std::sregex_iterator end;
-    
+    return executeCommandString(SstringView(multiCommandStr));
+}
+
+int CommandMapper::executeCommandString(SstringView text) {
     int successCount = 0;
-    
+
     // Execute each command
-    for (; it != end; ++it) {
-        std::smatch match = *it;
-        String cmdStr = match.str(0).c_str();
-        
-        if (executeCommand(cmdStr)) {
+    size_t pos = 0;
+    CommandToken token;
+    while (nextCommand(text, pos, token)) {
+        if (execute(token)) {
             successCount++;
         }
     }
-    
+
     return successCount;
 }
 
 String CommandMapper::extractCommands(const String& gptResponse) {
-    // Extract all commands from GPT response
-    std::regex cmdRegex("\\[([A-Z_]+)(?:=([0-9msh]+))?\\]");
-    std::string responseStd = gptResponse.c_str();
-    
-    std::string result;
-    std::sregex_iterator it(responseStd.begin(), responseStd.end(), cmdRegex);
-    std::sregex_iterator end;
-    
+    SstringView text(gptResponse);
+
     // Concatenate all commands
-    for (; it != end; ++it) {
-        std::smatch match = *it;
-        result += match.str(0);
+    String result;
+    size_t pos = 0;
+    CommandToken token;
+    while (nextCommand(text, pos, token)) {
+        result.concat(token.text.data(), token.text.length());
     }
-    
-    return String(result.c_str());
+
+    return result;
 }
 
 String CommandMapper::extractText(const String& gptResponse) {
-    // Remove all commands from GPT response to get just the text
-    std::regex cmdRegex("\\[([A-Z_]+)(?:=([0-9msh]+))?\\]");
-    std::string responseStd = gptResponse.c_str();
-    
-    // Replace all commands with empty string
-    std::string result = std::regex_replace(responseStd, cmdRegex, "");
-    
+    SstringView text(gptResponse);
+
+    // Keep everything between the commands
+    String result;
+    result.reserve(text.length());
+    size_t copied = 0;
+    size_t pos = 0;
+    CommandToken token;
+    while (nextCommand(text, pos, token)) {
+        result.concat(text.data() + copied, token.text.data() - (text.data() + copied));
+        copied = pos;
+    }
+    result.concat(text.data() + copied, text.length() - copied);
+
     // Trim leading/trailing whitespace
-    result.erase(0, result.find_first_not_of(" \t\n\r"));
-    result.erase(result.find_last_not_of(" \t\n\r") + 1);
-    
-    return String(result.c_str());
+    return SstringView(result).trim().toString();
 }
 
-int CommandMapper::parseTimeParam(const String& param) {
+int CommandMapper::parseTimeParam(SstringView param) {
     int duration = 0;
-    
+
     // Default if parsing fails
     if (param.isEmpty()) {
         return _defaultMoveDuration;
     }
-    
-    String numPart = "";
-    String unit = "s";  // Default to seconds
-    
+
     // Extract number and unit
-    for (size_t i = 0; i < param.length(); i++) {
-        if (isDigit(param[i])) {
-            numPart += param[i];
-        } else {
-            unit = param.substring(i);
-            break;
-        }
+    int value = param.toInt();
+    size_t i = 0;
+    while (i < param.length() && isDigit(param[i])) {
+        i++;
     }
-    
-    // Parse number
-    int value = numPart.toInt();
+    SstringView unit = param.substring(i);
+
     if (value == 0) {
         value = 1;  // Default if parsing fails
     }
-    
-    // Convert to milliseconds based on unit
-    if (unit.equals("s")) {
-        duration = value * 1000;
-    } else if (unit.equals("m")) {
+
+    // Convert to milliseconds based on unit, seconds without one
+    if (unit == "m") {
         duration = value * 60000;
-    } else if (unit.equals("h")) {
+    } else if (unit == "h") {
         duration = value * 3600000;
-    } else if (unit.equals("ms")) {
+    } else if (unit == "ms") {
         duration = value;
     } else {
         duration = value * 1000;  // Default to seconds
     }
-    
+
     // Enforce a minimum duration to prevent very short actions
     if (duration < 100) {
         duration = 100;  // Minimum 100 ms
     }
-    
+
     return duration;
 }
 
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <Arduino.h>
-#include <functional>
-#include <map>
-#include <regex>
 #include "Logger.h"
+#include "SstringView.h"
 
 namespace Utils {
 
+// Command found in a string, all views point into the parsed text
+struct CommandToken {
+    SstringView text;           // From the '[' up to and including the ']'
+    SstringView name;
+    SstringView param;          // Empty without "=PARAM"
+};
+
 class CommandMapper {
 public:
     // Constructor with all required subsystems
@@ -15,35 +20,57 @@ public:
 
     // Execute a command string (format: [COMMAND] or [COMMAND=PARAM])
     bool executeCommand(const String& commandStr);
-    
+    bool executeCommand(SstringView command);
+
     // Execute a series of commands in a single string
     int executeCommandString(const String& multiCommandStr);
-    
+    int executeCommandString(SstringView text);
+
     // Extract expression commands from GPT response
     String extractCommands(const String& gptResponse);
-    
+
     // Extract the natural language text (after commands)
     String extractText(const String& gptResponse);
 
+    // Find the next [COMMAND=PARAM] at or after pos, single pass and without allocating
+    // On success pos is moved past the command
+    static bool nextCommand(SstringView text, size_t& pos, CommandToken& token);
+
 private:
+    // Commands and handlers, the parameter is a view into the command string
+    typedef bool (CommandMapper::*CommandHandler)(SstringView param);
+
+    struct CommandEntry {
+        SstringView name;
+        CommandHandler handler;
+    };
+
+    static const size_t MAX_COMMANDS = 16;
+
     Utils::Logger* _logger;
-    
+
     // Motor control durations
     int _defaultMoveDuration = 500;  // milliseconds
     int _defaultTurnDuration = 400;  // milliseconds
-    
+
     // Parse time parameters (e.g., "10s", "1m")
-    int parseTimeParam(const String& param);
-    
-    // Commands and handlers
-    typedef std::function<bool(const String&)> CommandHandler;
-    std::map<String, CommandHandler> _commandHandlers;
-    
+    int parseTimeParam(SstringView param);
+
+    // Registered handlers, kept sorted by name for binary search
+    CommandEntry _commands[MAX_COMMANDS];
+    size_t _commandCount = 0;
+
     // Initialize all command handlers
     void initCommandHandlers();
-    
-    // Command regex pattern
-    const String _cmdPattern = "\\[([A-Z_]+)(?:=([0-9msh]+))?\\]";
+
+    // Add a handler to the sorted table, name must be a string literal
+    bool registerCommand(const char* name, CommandHandler handler);
+
+    // Look up the handler of a command name
+    CommandHandler findCommand(SstringView name) const;
+
+    // Run the handler of a parsed command
+    bool execute(const CommandToken& token);
 };
 
 } // namespace Utils
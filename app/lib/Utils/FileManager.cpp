@@ -1,12 +1,139 @@
 #include "FileManager.h"
+#include "Memory.h"
 
 namespace Utils {
 
-FileManager::FileManager() : _initialized(false) {
+namespace {
+
+// Data being written, and data that is complete but not yet in place
+const char* TEMP_SUFFIX = ".tmp";
+const char* COMPLETE_SUFFIX = ".new";
+
+bool appendChunk(const uint8_t* data, size_t length, void* context) {
+    return static_cast<String*>(context)->concat(reinterpret_cast<const char*>(data), length);
+}
+
+} // namespace
+
+FileWriter::FileWriter() : _written(0), _open(false), _failed(false) {
+}
+
+FileWriter::~FileWriter() {
+    abort();
+}
+
+bool FileWriter::open(const String& path) {
+    abort();
+
+    _path = path;
+    _tempPath = path + TEMP_SUFFIX;
+    _file = SPIFFS.open(_tempPath, "w");
+    if (!_file) {
+        Serial.println("Failed to open file for writing: " + _tempPath);
+        return false;
+    }
+
+    _written = 0;
+    _failed = false;
+    _open = true;
+    return true;
+}
+
+bool FileWriter::write(const uint8_t* data, size_t length) {
+    if (!_open || _failed) {
+        return false;
+    }
+
+    size_t count = _file.write(data, length);
+    _written += count;
+    if (count != length) {
+        // Keep the old file, commit() will refuse the partial one
+        _failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool FileWriter::commit() {
+    if (!_open) {
+        return false;
+    }
+
+    _file.close();
+    _open = false;
+    if (_failed) {
+        SPIFFS.remove(_tempPath);
+        return false;
+    }
+
+    // SPIFFS can't rename over an existing file. Marking the data complete
+    // first lets FileManager::init() finish the swap after a reset
+    String completePath = _path + COMPLETE_SUFFIX;
+    if (!SPIFFS.rename(_tempPath, completePath)) {
+        Serial.println("Failed to rename " + _tempPath + " to " + completePath);
+        SPIFFS.remove(_tempPath);
+        return false;
+    }
+    if (SPIFFS.exists(_path)) {
+        SPIFFS.remove(_path);
+    }
+    if (!SPIFFS.rename(completePath, _path)) {
+        Serial.println("Failed to rename " + completePath + " to " + _path);
+        return false;
+    }
+    return true;
+}
+
+void FileWriter::abort() {
+    if (!_open) {
+        return;
+    }
+
+    _file.close();
+    _open = false;
+    SPIFFS.remove(_tempPath);
+}
+
+FileManager::FileManager() : _initialized(false), _chunkBuffer(nullptr) {
 }
 
 FileManager::~FileManager() {
-    // Clean up resources if needed
+    Memory::release(_chunkBuffer);
+}
+
+void FileManager::recoverTempFiles() {
+    File root = SPIFFS.open("/");
+    if (!root) {
+        return;
+    }
+
+    std::vector<String> tempPaths;
+    std::vector<String> completePaths;
+    File file = root.openNextFile();
+    while (file) {
+        SstringView filePath(file.path());
+        if (filePath.endsWith(TEMP_SUFFIX)) {
+            tempPaths.push_back(file.path());
+        } else if (filePath.endsWith(COMPLETE_SUFFIX)) {
+            completePaths.push_back(file.path());
+        }
+        file = root.openNextFile();
+    }
+    root.close();
+
+    // Writes that never committed are dropped
+    for (const String& tempPath : tempPaths) {
+        SPIFFS.remove(tempPath);
+    }
+
+    // A commit interrupted before or after removing the old file
+    for (const String& completePath : completePaths) {
+        String path = completePath.substring(0, completePath.length() - strlen(COMPLETE_SUFFIX));
+        if (SPIFFS.exists(path)) {
+            SPIFFS.remove(path);
+        }
+        SPIFFS.rename(completePath, path);
+    }
 }
 
 bool FileManager::init() {
@@ -15,6 +142,9 @@ bool FileManager::init() {
         return false;
     }
     
+    if (!_initialized) {
+        recoverTempFiles();
+    }
     _initialized = true;
     return true;
 }
@@ -24,15 +154,78 @@ String FileManager::readFile(const String& path) {
         return "";
     }
     
+    int size = getSize(path);
+    if (size < 0) {
+        Serial.println("Failed to open file for reading: " + path);
+        return "";
+    }
+
+    // One allocation of the final size instead of growing while reading
+    String content;
+    if (!content.reserve(size) || !readChunks(path, appendChunk, &content)) {
+        return "";
+    }
+    return content;
+}
+
+bool FileManager::readChunks(const String& path, uint8_t* buffer, size_t bufferSize,
+                             FileChunkCallback callback, void* context) {
+    if (!_initialized || !buffer || bufferSize == 0 || !callback) {
+        return false;
+    }
+
     File file = SPIFFS.open(path, "r");
     if (!file) {
         Serial.println("Failed to open file for reading: " + path);
-        return "";
+        return false;
     }
-    
-    String content = file.readString();
+
+    bool complete = true;
+    while (file.available()) {
+        size_t count = file.read(buffer, bufferSize);
+        if (count == 0) {
+            complete = false;
+            break;
+        }
+        if (!callback(buffer, count, context)) {
+            complete = false;
+            break;
+        }
+    }
+
     file.close();
-    return content;
+    return complete;
+}
+
+bool FileManager::readChunks(const String& path, FileChunkCallback callback, void* context) {
+    if (!_chunkBuffer) {
+        _chunkBuffer = static_cast<uint8_t*>(Memory::allocate(FILE_CHUNK_SIZE, MemoryPlacement::Internal));
+        if (!_chunkBuffer) {
+            return false;
+        }
+    }
+
+    return readChunks(path, _chunkBuffer, FILE_CHUNK_SIZE, callback, context);
+}
+
+int FileManager::readAt(const String& path, size_t offset, uint8_t* buffer, size_t length) {
+    if (!_initialized || !buffer) {
+        return -1;
+    }
+
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    if (offset > file.size() || !file.seek(offset)) {
+        file.close();
+        return -1;
+    }
+
+    size_t count = file.read(buffer, length);
+    file.close();
+    return count;
 }
 
 bool FileManager::writeFile(const String& path, const String& content) {
@@ -40,21 +233,16 @@ bool FileManager::writeFile(const String& path, const String& content) {
         return false;
     }
 
-    if (exists(path)) {
-        deleteFile(path);
-        vTaskDelay(pdMS_TO_TICKS(7));
+    FileWriter writer;
+    if (!writer.open(path)) {
+        return false;
     }
-    
-    File file = SPIFFS.open(path, "w");
-    if (!file) {
-        Serial.println("Failed to open file for writing: " + path);
+
+    if (!writer.write(reinterpret_cast<const uint8_t*>(content.c_str()), content.length())) {
+        writer.abort();
         return false;
     }
-    
-    size_t written = file.print(content);
-    file.close();
-    
-    return written == content.length();
+    return writer.commit();
 }
 
 bool FileManager::appendFile(const String& path, const String& content) {
@@ -108,6 +296,24 @@ int FileManager::getSize(const String& path) {
     return size;
 }
 
+File FileManager::openFile(const String& path, const char* mode) {
+    if (!_initialized) {
+        return File();
+    }
+
+    return SPIFFS.open(path, mode);
+}
+
+size_t FileManager::getFreeBytes() {
+    if (!_initialized) {
+        return 0;
+    }
+
+    size_t total = SPIFFS.totalBytes();
+    size_t used = SPIFFS.usedBytes();
+    return total > used ? total - used : 0;
+}
+
 std::vector<FileManager::FileInfo> FileManager::listFiles(String path) {
     std::vector<FileInfo> files;
     std::vector<FileInfo> directories;
@@ -123,19 +329,18 @@ std::vector<FileManager::FileInfo> FileManager::listFiles(String path) {
     }
 
     String dir = path;
-    if (dir != "/" && dir.end() != "/") 
+    if (!SstringView(dir).endsWith("/"))
         dir += "/";
 
     File file = root.openNextFile();
     while (file)
     {
         FileInfo info;
-        Sstring fullpath = file.path();
-        Sstring tempname = fullpath.substring(path.length());
-        int isDir = tempname.indexOf("/");
+        SstringView fullpath(file.path());
+        SstringView tempname = fullpath.substring(path.length());
+        int isDir = tempname.indexOf('/');
         if (isDir > 0) {
-            tempname = tempname.substring(0, isDir);
-            info.name = tempname.toString();
+            info.name = tempname.substring(0, isDir).toString();
             info.dir = dir;
             info.size = 0;
             info.isDirectory = isDir > 0;
@@ -6,8 +6,93 @@
 #include <algorithm>
 #include "Sstring.h"
 
+// Size of the buffer FileManager reuses for chunked reads and copies
+#ifndef FILE_CHUNK_SIZE
+#define FILE_CHUNK_SIZE 1024
+#endif
+
 namespace Utils {
 
+/**
+ * Called for every chunk read from a file
+ * @param data The chunk, only valid during the call
+ * @param length Number of bytes in the chunk
+ * @param context Pointer passed to readChunks
+ * @return true to continue reading, false to stop
+ */
+typedef bool (*FileChunkCallback)(const uint8_t* data, size_t length, void* context);
+
+/**
+ * Streams a file to SPIFFS without holding it in memory
+ *
+ * Data goes to "<path>.tmp" and replaces the target only on commit(),
+ * so a reset or failed write never leaves a truncated file behind.
+ * FileManager::init() completes commits that a reset interrupted.
+ * Destroying an uncommitted writer discards the temporary file.
+ *
+ * Usage example:
+ * FileWriter writer;
+ * if (writer.open("/config.bin")) {
+ *     writer.write(header, sizeof(header));
+ *     writer.write(payload, payloadLength);
+ *     writer.commit();
+ * }
+ */
+class FileWriter {
+public:
+    FileWriter();
+    ~FileWriter();
+
+    /**
+     * Start writing a file, an existing file stays untouched until commit()
+     * @param path The file path
+     * @return true if the temporary file could be created
+     */
+    bool open(const String& path);
+
+    /**
+     * Append data to the file
+     * @param data The data to write
+     * @param length Number of bytes
+     * @return true if all bytes were written
+     */
+    bool write(const uint8_t* data, size_t length);
+
+    /**
+     * Replace the target with the written data
+     * @return true if the file was written completely and renamed
+     */
+    bool commit();
+
+    /**
+     * Discard the written data and keep the old file
+     */
+    void abort();
+
+    /**
+     * Check if a file is being written
+     * @return true between open() and commit() or abort()
+     */
+    bool isOpen() const { return _open; }
+
+    /**
+     * Get the number of bytes written so far
+     * @return Bytes written since open()
+     */
+    size_t written() const { return _written; }
+
+private:
+    File _file;
+    String _path;
+    String _tempPath;
+    size_t _written;
+    bool _open;
+    bool _failed;
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+};
+
 class FileManager {
 public:
     struct FileInfo {
@@ -33,6 +118,38 @@ public:
      */
     String readFile(const String& path);
 
+    /**
+     * Read a file in chunks into a caller-provided buffer
+     * @param path The file path
+     * @param buffer Buffer the chunks are read into
+     * @param bufferSize Size of the buffer, the largest chunk passed to callback
+     * @param callback Called for every chunk
+     * @param context Passed through to callback
+     * @return true if the whole file was read and callback never stopped it
+     */
+    bool readChunks(const String& path, uint8_t* buffer, size_t bufferSize,
+                    FileChunkCallback callback, void* context = nullptr);
+
+    /**
+     * Read a file in chunks of FILE_CHUNK_SIZE using the internal buffer
+     * Not reentrant, callback must not read another file the same way
+     * @param path The file path
+     * @param callback Called for every chunk
+     * @param context Passed through to callback
+     * @return true if the whole file was read and callback never stopped it
+     */
+    bool readChunks(const String& path, FileChunkCallback callback, void* context = nullptr);
+
+    /**
+     * Read part of a file
+     * @param path The file path
+     * @param offset Position of the first byte
+     * @param buffer Destination buffer
+     * @param length Number of bytes to read at most
+     * @return Number of bytes read, or -1 if the file can't be read
+     */
+    int readAt(const String& path, size_t offset, uint8_t* buffer, size_t length);
+
     /**
      * Write to a file
      * @param path The file path
@@ -70,6 +187,20 @@ public:
      */
     int getSize(const String& path);
 
+    /**
+     * Open a file for direct access, e.g. to keep appending to it
+     * @param path The file path
+     * @param mode "r", "w" or "a"
+     * @return The open file, false when converted to bool on failure
+     */
+    File openFile(const String& path, const char* mode);
+
+    /**
+     * Get the space left on the file system
+     * @return Free bytes, 0 if not initialized
+     */
+    size_t getFreeBytes();
+
     /**
      * List files in a directory
      * @param path The directory path
@@ -93,6 +224,10 @@ public:
 
 private:
     bool _initialized;
+    uint8_t* _chunkBuffer;
+
+    // Finish FileWriter commits that a reset interrupted
+    void recoverTempFiles();
 };
 
 } // namespace Utils
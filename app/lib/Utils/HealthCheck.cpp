@@ -1,8 +1,11 @@
 #include "HealthCheck.h"
+#include <esp_timer.h>
+#include "Logger.h"
 
 namespace Utils {
 
-HealthCheck::HealthCheck() : _overallStatus(HEALTHY), _checkInterval(10000), _lastCheckTime(0), _initialized(false) {
+HealthCheck::HealthCheck()
+    : _overallStatus(HEALTHY), _checkInterval(10000), _startTime(0), _totalCheckTime(0), _initialized(false) {
 }
 
 HealthCheck::~HealthCheck() {
@@ -11,50 +14,75 @@ HealthCheck::~HealthCheck() {
 
 bool HealthCheck::init(unsigned long checkIntervalMs) {
     _checkInterval = checkIntervalMs;
-    _lastCheckTime = millis();
+    _startTime = esp_timer_get_time();
+    _totalCheckTime = 0;
     _initialized = true;
     return true;
 }
 
-bool HealthCheck::addCheck(const String& name, std::function<Status()> checkFunction) {
-    if (!_initialized) {
+bool HealthCheck::addCheck(const char* name, std::function<Status()> checkFunction, unsigned long intervalMs) {
+    if (!_initialized || !name || !checkFunction) {
         return false;
     }
-    
-    Check check;
+
+    Check check = {};
     check.name = name;
-    check.checkFunction = checkFunction;
+    check.checkFunction = std::move(checkFunction);
     check.lastStatus = HEALTHY;
-    check.message = "Initial state";
-    
-    _checks.push_back(check);
+    check.intervalMs = intervalMs ? intervalMs : _checkInterval;
+
+    _checks.push_back(std::move(check));
     return true;
 }
 
-void HealthCheck::runChecks() {
-    if (!_initialized) {
-        return;
+void HealthCheck::runCheck(Check& check) {
+    Status previousStatus = check.lastStatus;
+
+    int64_t start = esp_timer_get_time();
+    check.lastStatus = check.checkFunction();
+    uint32_t duration = esp_timer_get_time() - start;
+
+    check.lastRunTime = millis();
+    check.lastDurationUs = duration;
+    check.totalDurationUs += duration;
+    check.runCount++;
+    if (duration > check.maxDurationUs) {
+        check.maxDurationUs = duration;
     }
-    
+    _totalCheckTime += duration;
+
+    // Only report the transition, not every slow run
+    bool slow = duration > HEALTH_CHECK_SLOW_US;
+    if (slow && !check.slow) {
+        LOG_WARNING(HEALTH, "Health check %s is slow: %u us", check.name, duration);
+    }
+    check.slow = slow;
+
+    // Notify on status change
+    if (check.lastStatus != previousStatus && _statusChangeCallback) {
+        _statusChangeCallback(check.name, previousStatus, check.lastStatus);
+    }
+}
+
+void HealthCheck::updateOverallStatus() {
     Status worstStatus = HEALTHY;
-    
-    for (auto& check : _checks) {
-        Status previousStatus = check.lastStatus;
-        check.lastStatus = check.checkFunction();
-        
-        // Update worst status
+    for (const auto& check : _checks) {
         if (check.lastStatus > worstStatus) {
             worstStatus = check.lastStatus;
         }
-        
-        // Notify on status change
-        if (check.lastStatus != previousStatus && _statusChangeCallback) {
-            _statusChangeCallback(check.name, previousStatus, check.lastStatus);
-        }
     }
-    
     _overallStatus = worstStatus;
-    _lastCheckTime = millis();
+}
+
+void HealthCheck::runChecks() {
+    if (!_initialized) {
+        return;
+    }
+
+    for (auto& check : _checks) {
+        runCheck(check);
+    }
+    updateOverallStatus();
 }
 
 HealthCheck::Status HealthCheck::getOverallStatus() const {
@@ -65,22 +93,54 @@ const std::vector<HealthCheck::Check>& HealthCheck::getChecks() const {
     return _checks;
 }
 
-void HealthCheck::setStatusChangeCallback(std::function<void(const String&, Status, Status)> callback) {
-    _statusChangeCallback = callback;
+void HealthCheck::setStatusChangeCallback(std::function<void(const char*, Status, Status)> callback) {
+    _statusChangeCallback = std::move(callback);
 }
 
-void HealthCheck::update() {
+bool HealthCheck::update() {
     if (!_initialized) {
-        return;
+        return false;
     }
-    
+
+    // Pick the check furthest past its interval, checks that never ran come first
     unsigned long currentTime = millis();
-    if (currentTime - _lastCheckTime >= _checkInterval) {
-        runChecks();
+    Check* due = nullptr;
+    unsigned long dueFor = 0;
+    for (auto& check : _checks) {
+        if (check.runCount == 0) {
+            due = &check;
+            break;
+        }
+
+        unsigned long elapsed = currentTime - check.lastRunTime;
+        if (elapsed >= check.intervalMs && (!due || elapsed - check.intervalMs >= dueFor)) {
+            due = &check;
+            dueFor = elapsed - check.intervalMs;
+        }
+    }
+
+    if (!due) {
+        return false;
+    }
+
+    runCheck(*due);
+    updateOverallStatus();
+    return true;
+}
+
+uint64_t HealthCheck::getTotalCheckTime() const {
+    return _totalCheckTime;
+}
+
+uint32_t HealthCheck::getCpuUsage() const {
+    int64_t elapsed = esp_timer_get_time() - _startTime;
+    if (!_initialized || elapsed <= 0) {
+        return 0;
     }
+    return (uint32_t)(_totalCheckTime * 1000000ULL / (uint64_t)elapsed);
 }
 
-String HealthCheck::statusToString(Status status) const {
+const char* HealthCheck::statusToString(Status status) {
     switch (status) {
         case HEALTHY:
             return "HEALTHY";
@@ -4,8 +4,22 @@
 #include <vector>
 #include <functional>
 
+// A check running longer than this is flagged as slow, in microseconds
+#ifndef HEALTH_CHECK_SLOW_US
+#define HEALTH_CHECK_SLOW_US 2000
+#endif
+
 namespace Utils {
 
+/**
+ * Periodic health checks with a result cache
+ *
+ * Every check has its own interval and update() runs at most one due check per
+ * call, the most overdue one, so a slow check never delays the others by more
+ * than its own run. Results are cached with the time they were taken, and the
+ * run time of every check is recorded so the cost of health monitoring can be
+ * read back with getCpuUsage().
+ */
 class HealthCheck {
 public:
     enum Status {
@@ -16,10 +30,16 @@ public:
     };
 
     struct Check {
-        String name;
+        const char* name;
         std::function<Status()> checkFunction;
         Status lastStatus;
-        String message;
+        unsigned long intervalMs;     // Time between runs
+        unsigned long lastRunTime;    // millis() of the cached result, 0 before the first run
+        uint32_t lastDurationUs;      // Run time of the last run
+        uint32_t maxDurationUs;       // Longest run so far
+        uint64_t totalDurationUs;     // Run time of all runs
+        uint32_t runCount;
+        bool slow;                    // Last run took longer than HEALTH_CHECK_SLOW_US
     };
 
     HealthCheck();
@@ -27,27 +47,28 @@ public:
 
     /**
      * Initialize health check
-     * @param checkIntervalMs Interval between checks in milliseconds
+     * @param checkIntervalMs Interval of checks added without one, in milliseconds
      * @return true if initialization was successful, false otherwise
      */
     bool init(unsigned long checkIntervalMs = 10000);
 
     /**
      * Add a check
-     * @param name The name of the check
+     * @param name The name of the check, must stay valid (e.g. a string literal)
      * @param checkFunction The function to call for the check
+     * @param intervalMs Interval of this check, 0 for the one given to init()
      * @return true if the check was added successfully, false otherwise
      */
-    bool addCheck(const String& name, std::function<Status()> checkFunction);
+    bool addCheck(const char* name, std::function<Status()> checkFunction, unsigned long intervalMs = 0);
 
     /**
-     * Run all checks
+     * Run all checks now, regardless of their intervals
      */
     void runChecks();
 
     /**
      * Get the overall status
-     * @return The most severe status from all checks
+     * @return The most severe cached status of all checks
      */
     Status getOverallStatus() const;
 
@@ -59,26 +80,50 @@ public:
 
     /**
      * Set callback for status change
-     * @param callback The callback function
+     * @param callback Called with the check name, the previous and the new status
      */
-    void setStatusChangeCallback(std::function<void(const String&, Status, Status)> callback);
+    void setStatusChangeCallback(std::function<void(const char*, Status, Status)> callback);
 
     /**
      * Update in the main loop
-     * Runs checks at the specified interval
+     * Runs the most overdue check, if any is due
+     * @return true if a check was run
+     */
+    bool update();
+
+    /**
+     * Get the time spent in checks
+     * @return Microseconds spent running checks since init
+     */
+    uint64_t getTotalCheckTime() const;
+
+    /**
+     * Get the share of CPU time spent in checks
+     * @return Time in checks per million microseconds since init
+     */
+    uint32_t getCpuUsage() const;
+
+    /**
+     * Convert status to string
+     * @param status The status
+     * @return Name of the status
      */
-    void update();
+    static const char* statusToString(Status status);
 
 private:
     std::vector<Check> _checks;
     Status _overallStatus;
     unsigned long _checkInterval;
-    unsigned long _lastCheckTime;
+    int64_t _startTime;
+    uint64_t _totalCheckTime;
     bool _initialized;
-    std::function<void(const String&, Status, Status)> _statusChangeCallback;
-    
-    // Convert status to string
-    String statusToString(Status status) const;
+    std::function<void(const char*, Status, Status)> _statusChangeCallback;
+
+    // Run a check and update its cached result
+    void runCheck(Check& check);
+
+    // Worst cached status
+    void updateOverallStatus();
 };
 
 } // namespace Utils
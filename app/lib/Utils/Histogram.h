@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Utils {
+
+/**
+ * @brief Lock-free histogram of latencies with power-of-two buckets
+ *
+ * Bucket 0 counts zeros, bucket n counts values from 2^(n-1) up to 2^n - 1
+ * and the last bucket everything above. Recording is a handful of
+ * instructions without locks or allocation, so it is safe in an ISR. There
+ * must only be one writer, readers get a snapshot that may be a sample
+ * or two behind but never blocks the writer.
+ *
+ * Usage example:
+ * Histogram isrTime;
+ * isrTime.record(elapsedMicros);   // Writer (e.g. ISR)
+ * isrTime.writeTo(response);       // Reader (e.g. telemetry)
+ */
+class Histogram {
+public:
+    static const size_t BUCKETS = 16;
+
+    // Bytes written by writeTo(): count, max and the buckets, 4 bytes each
+    static const size_t SERIALIZED_SIZE = (2 + BUCKETS) * 4;
+
+    Histogram() : _count(0), _max(0) {
+        for (size_t i = 0; i < BUCKETS; i++) {
+            _buckets[i] = 0;
+        }
+    }
+
+    /**
+     * @brief Count a value, writer side only
+     * Always inlined so an IRAM ISR doesn't call into flash
+     * @param value Value to count, in the unit the histogram is kept in
+     */
+    inline __attribute__((always_inline)) void record(uint32_t value) {
+        size_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+        if (bucket >= BUCKETS) {
+            bucket = BUCKETS - 1;
+        }
+        _buckets[bucket] = _buckets[bucket] + 1;
+        _count = _count + 1;
+        if (value > _max) {
+            _max = value;
+        }
+    }
+
+    /**
+     * @brief Get the number of recorded values
+     * @return Values recorded since construction
+     */
+    uint32_t count() const {
+        return _count;
+    }
+
+    /**
+     * @brief Get the largest recorded value
+     * @return Largest value, 0 if none was recorded
+     */
+    uint32_t maxValue() const {
+        return _max;
+    }
+
+    /**
+     * @brief Get the number of values in a bucket
+     * @param bucket Bucket index, less than BUCKETS
+     * @return Number of values
+     */
+    uint32_t bucket(size_t bucket) const {
+        return _buckets[bucket];
+    }
+
+    /**
+     * @brief Write count, max and the buckets big-endian
+     * @param buffer Destination of at least SERIALIZED_SIZE bytes
+     * @return Number of bytes written
+     */
+    size_t writeTo(uint8_t* buffer) const {
+        size_t pos = 0;
+        pos += writeField(buffer + pos, _count);
+        pos += writeField(buffer + pos, _max);
+        for (size_t i = 0; i < BUCKETS; i++) {
+            pos += writeField(buffer + pos, _buckets[i]);
+        }
+        return pos;
+    }
+
+private:
+    volatile uint32_t _buckets[BUCKETS];
+    volatile uint32_t _count;
+    volatile uint32_t _max;
+
+    static size_t writeField(uint8_t* buffer, uint32_t value) {
+        buffer[0] = (value >> 24) & 0xFF;
+        buffer[1] = (value >> 16) & 0xFF;
+        buffer[2] = (value >> 8) & 0xFF;
+        buffer[3] = value & 0xFF;
+        return 4;
+    }
+};
+
+} // namespace Utils
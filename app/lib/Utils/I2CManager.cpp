@@ -2,6 +2,10 @@
 
 namespace Utils {
 
+// Worker task of a bus, the callbacks run on it too
+static const uint32_t I2C_WORKER_STACK_SIZE = 3072;
+static const UBaseType_t I2C_WORKER_PRIORITY = 2;  // Below the SPI tasks, the bus waits in the driver anyway
+
 // Static instance for singleton pattern
 I2CManager& I2CManager::getInstance() {
     static I2CManager instance;
@@ -25,6 +29,8 @@ bool I2CManager::initBus(const char* busName, int sda, int scl, uint32_t frequen
     bus.sclPin = scl;
     bus.frequency = frequency;
     bus.isDefault = useWire;
+    bus.queue = nullptr;
+    bus.worker = nullptr;
 
     if (useWire) {
         bus.wire = &Wire;
@@ -54,11 +60,21 @@ bool I2CManager::initBus(const char* busName, int sda, int scl, uint32_t frequen
     Serial.printf("Initialized I2C bus '%s' on pins SDA=%d, SCL=%d at %dkHz\n", 
                  busName, sda, scl, frequency / 1000);
 
-    // Add to map
-    _buses[busName] = bus;
+    // Add to map, the name points at the key so it lives as long as the entry
+    auto it = _buses.emplace(busName, bus).first;
+    it->second.name = it->first.c_str();
     return true;
 }
 
+I2CManager::BusHandle I2CManager::getBusHandle(const char* busName) {
+    auto it = _buses.find(busName);
+    if (it != _buses.end()) {
+        return &(it->second);
+    }
+    Serial.printf("I2C bus '%s' not found\n", busName);
+    return nullptr;
+}
+
 TwoWire* I2CManager::getBus(const char* busName) {
     auto it = _buses.find(busName);
     if (it != _buses.end()) {
@@ -69,7 +85,11 @@ TwoWire* I2CManager::getBus(const char* busName) {
 }
 
 bool I2CManager::devicePresent(const char* busName, byte address) {
-    BusInfo* bus = takeBus(busName);
+    return devicePresent(getBusHandle(busName), address);
+}
+
+bool I2CManager::devicePresent(BusHandle handle, byte address) {
+    BusInfo* bus = takeBus(handle);
     if (!bus) {
         return false;
     }
@@ -83,121 +103,108 @@ bool I2CManager::devicePresent(const char* busName, byte address) {
 
 bool I2CManager::writeRegister(const char* busName, byte deviceAddress, 
                               uint8_t registerAddress, uint8_t data) {
-    BusInfo* bus = takeBus(busName);
+    return writeRegister(getBusHandle(busName), deviceAddress, registerAddress, data);
+}
+
+bool I2CManager::writeRegister(BusHandle handle, byte deviceAddress,
+                              uint8_t registerAddress, uint8_t data) {
+    BusInfo* bus = takeBus(handle);
     if (!bus) {
         return false;
     }
 
-    bus->wire->beginTransmission(deviceAddress);
-    
-    if (bus->wire->write(registerAddress) != 1) {
-        Serial.printf("Failed to write register address 0x%02X to device 0x%02X on bus '%s'\n", 
-                     registerAddress, deviceAddress, busName);
-        bus->wire->endTransmission();
-        releaseBus(bus);
-        return false;
-    }
-    
-    if (bus->wire->write(data) != 1) {
-        Serial.printf("Failed to write data 0x%02X to register 0x%02X on device 0x%02X on bus '%s'\n", 
-                     data, registerAddress, deviceAddress, busName);
-        bus->wire->endTransmission();
-        releaseBus(bus);
-        return false;
-    }
-    
-    uint8_t error = bus->wire->endTransmission();
+    bool success = transferWrite(bus, deviceAddress, registerAddress, data);
     releaseBus(bus);
-    
-    if (error != 0) {
-        Serial.printf("I2C transmission error %d when writing to device 0x%02X on bus '%s'\n", 
-                     error, deviceAddress, busName);
-        return false;
-    }
-    
-    return true;
+    return success;
 }
 
 bool I2CManager::readRegister(const char* busName, byte deviceAddress, 
                              uint8_t registerAddress, uint8_t &result) {
-    BusInfo* bus = takeBus(busName);
+    return readRegister(getBusHandle(busName), deviceAddress, registerAddress, result);
+}
+
+bool I2CManager::readRegister(BusHandle handle, byte deviceAddress,
+                             uint8_t registerAddress, uint8_t &result) {
+    BusInfo* bus = takeBus(handle);
     if (!bus) {
         return false;
     }
 
-    bus->wire->beginTransmission(deviceAddress);
-    
-    if (bus->wire->write(registerAddress) != 1) {
-        Serial.printf("Failed to write register address 0x%02X to device 0x%02X on bus '%s'\n",
-                     registerAddress, deviceAddress, busName);
-        bus->wire->endTransmission();
-        releaseBus(bus);
-        return false;
-    }
-    
-    if (bus->wire->endTransmission(false) != 0) {
-        Serial.printf("I2C transmission failed on bus '%s' when setting register\n", busName);
-        releaseBus(bus);
-        return false;
-    }
-    
-    if (bus->wire->requestFrom(deviceAddress, (uint8_t)1) != 1) {
-        Serial.printf("Failed to request data from device 0x%02X on bus '%s'\n", deviceAddress, busName);
-        releaseBus(bus);
-        return false;
-    }
-    
-    if (bus->wire->available()) {
-        result = bus->wire->read();
-        releaseBus(bus);
-        return true;
-    }
-    
-    Serial.printf("No data available from device 0x%02X on bus '%s'\n", deviceAddress, busName);
+    // A single byte either arrives or the read failed
+    bool success = transferRead(bus, deviceAddress, registerAddress, &result, 1);
     releaseBus(bus);
-    return false;
+    return success;
 }
 
 bool I2CManager::readRegisters(const char* busName, byte deviceAddress, 
                               uint8_t registerAddress, uint8_t *buffer, uint8_t length) {
+    return readRegisters(getBusHandle(busName), deviceAddress, registerAddress, buffer, length);
+}
+
+bool I2CManager::readRegisters(BusHandle handle, byte deviceAddress,
+                              uint8_t registerAddress, uint8_t *buffer, uint8_t length) {
     if (!buffer) {
-        Serial.printf("Buffer is NULL for readRegisters call on bus '%s'\n", busName);
+        Serial.printf("Buffer is NULL for readRegisters call on bus '%s'\n", handle ? handle->name : "?");
         return false;
     }
 
-    BusInfo* bus = takeBus(busName);
+    BusInfo* bus = takeBus(handle);
     if (!bus) {
         return false;
     }
 
-    bus->wire->beginTransmission(deviceAddress);
-    
-    if (bus->wire->write(registerAddress) != 1) {
-        Serial.printf("Failed to write register address 0x%02X to device 0x%02X on bus '%s'\n",
-                     registerAddress, deviceAddress, busName);
-        bus->wire->endTransmission();
-        releaseBus(bus);
-        return false;
-    }
-    
-    if (bus->wire->endTransmission(false) != 0) {
-        Serial.printf("I2C transmission failed on bus '%s' when setting register\n", busName);
-        releaseBus(bus);
+    bool success = transferRead(bus, deviceAddress, registerAddress, buffer, length);
+    releaseBus(bus);
+    return success;
+}
+
+bool I2CManager::queueRead(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t *buffer,
+                           uint8_t length, TransactionCallback callback, void* context) {
+    RegisterRead read = {registerAddress, buffer, length};
+    return queueBatchRead(bus, deviceAddress, &read, 1, callback, context);
+}
+
+bool I2CManager::queueBatchRead(BusHandle bus, byte deviceAddress, const RegisterRead* reads, uint8_t count,
+                                TransactionCallback callback, void* context) {
+    if (!reads || count == 0 || count > I2C_BATCH_MAX_READS) {
+        Serial.printf("Invalid batch of %d reads on bus '%s'\n", count, bus ? bus->name : "?");
         return false;
     }
-    
-    uint8_t bytesReceived = bus->wire->requestFrom(deviceAddress, length);
-    if (bytesReceived != length) {
-        Serial.printf("Requested %d bytes, received %d from device 0x%02X on bus '%s'\n", 
-                     length, bytesReceived, deviceAddress, busName);
+
+    Transaction transaction = {};
+    transaction.callback = callback;
+    transaction.context = context;
+    transaction.deviceAddress = deviceAddress;
+    transaction.isWrite = false;
+    transaction.count = count;
+    for (uint8_t i = 0; i < count; i++) {
+        if (!reads[i].buffer) {
+            Serial.printf("Buffer is NULL for queued read on bus '%s'\n", bus ? bus->name : "?");
+            return false;
+        }
+        transaction.reads[i] = reads[i];
     }
-    
-    for (uint8_t i = 0; i < bytesReceived && bus->wire->available(); i++) {
-        buffer[i] = bus->wire->read();
+    return enqueue(bus, transaction);
+}
+
+bool I2CManager::queueWrite(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t data,
+                            TransactionCallback callback, void* context) {
+    Transaction transaction = {};
+    transaction.callback = callback;
+    transaction.context = context;
+    transaction.deviceAddress = deviceAddress;
+    transaction.isWrite = true;
+    transaction.data = data;
+    transaction.count = 1;
+    transaction.reads[0].registerAddress = registerAddress;
+    return enqueue(bus, transaction);
+}
+
+uint8_t I2CManager::getPendingCount(BusHandle bus) const {
+    if (!bus || !bus->queue) {
+        return 0;
     }
-    
-    releaseBus(bus);
-    return bytesReceived > 0;
+    return uxQueueMessagesWaiting(bus->queue);
 }
 
 void I2CManager::scanBus(const char* busName) {
@@ -233,17 +240,18 @@ void I2CManager::scanBus(const char* busName) {
 }
 
 I2CManager::BusInfo* I2CManager::takeBus(const char* busName, uint32_t timeoutMs) {
-    auto it = _buses.find(busName);
-    if (it == _buses.end()) {
-        Serial.printf("I2C bus '%s' not found\n", busName);
+    return takeBus(getBusHandle(busName), timeoutMs);
+}
+
+I2CManager::BusInfo* I2CManager::takeBus(BusHandle bus, uint32_t timeoutMs) {
+    if (!bus) {
         return nullptr;
     }
     
-    BusInfo* bus = &(it->second);
-    
     if (bus->mutex) {
-        if (xSemaphoreTake(bus->mutex, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
-            Serial.printf("Failed to take mutex for I2C bus '%s', timeout occurred\n", busName);
+        TickType_t ticks = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+        if (xSemaphoreTake(bus->mutex, ticks) != pdTRUE) {
+            Serial.printf("Failed to take mutex for I2C bus '%s', timeout occurred\n", bus->name);
             return nullptr;
         }
     }
@@ -257,4 +265,125 @@ void I2CManager::releaseBus(BusInfo* bus) {
     }
 }
 
+bool I2CManager::transferWrite(BusInfo* bus, byte deviceAddress, uint8_t registerAddress, uint8_t data) {
+    bus->wire->beginTransmission(deviceAddress);
+    
+    if (bus->wire->write(registerAddress) != 1) {
+        Serial.printf("Failed to write register address 0x%02X to device 0x%02X on bus '%s'\n", 
+                     registerAddress, deviceAddress, bus->name);
+        bus->wire->endTransmission();
+        return false;
+    }
+    
+    if (bus->wire->write(data) != 1) {
+        Serial.printf("Failed to write data 0x%02X to register 0x%02X on device 0x%02X on bus '%s'\n", 
+                     data, registerAddress, deviceAddress, bus->name);
+        bus->wire->endTransmission();
+        return false;
+    }
+    
+    uint8_t error = bus->wire->endTransmission();
+    if (error != 0) {
+        Serial.printf("I2C transmission error %d when writing to device 0x%02X on bus '%s'\n", 
+                     error, deviceAddress, bus->name);
+        return false;
+    }
+    
+    return true;
+}
+
+bool I2CManager::transferRead(BusInfo* bus, byte deviceAddress, uint8_t registerAddress,
+                              uint8_t *buffer, uint8_t length) {
+    bus->wire->beginTransmission(deviceAddress);
+    
+    if (bus->wire->write(registerAddress) != 1) {
+        Serial.printf("Failed to write register address 0x%02X to device 0x%02X on bus '%s'\n",
+                     registerAddress, deviceAddress, bus->name);
+        bus->wire->endTransmission();
+        return false;
+    }
+    
+    if (bus->wire->endTransmission(false) != 0) {
+        Serial.printf("I2C transmission failed on bus '%s' when setting register\n", bus->name);
+        return false;
+    }
+    
+    uint8_t bytesReceived = bus->wire->requestFrom(deviceAddress, length);
+    if (bytesReceived != length) {
+        Serial.printf("Requested %d bytes, received %d from device 0x%02X on bus '%s'\n", 
+                     length, bytesReceived, deviceAddress, bus->name);
+    }
+    
+    for (uint8_t i = 0; i < bytesReceived && bus->wire->available(); i++) {
+        buffer[i] = bus->wire->read();
+    }
+    
+    return bytesReceived > 0;
+}
+
+bool I2CManager::enqueue(BusHandle bus, const Transaction& transaction) {
+    if (!bus) {
+        return false;
+    }
+
+    // Start the worker on first use, under the bus mutex so two callers don't both create one
+    if (!bus->worker) {
+        if (!takeBus(bus)) {
+            return false;
+        }
+        if (!bus->queue) {
+            bus->queue = xQueueCreate(I2C_TRANSACTION_QUEUE_SIZE, sizeof(Transaction));
+        }
+        if (bus->queue && !bus->worker &&
+            xTaskCreate(workerTask, "i2c_worker", I2C_WORKER_STACK_SIZE, bus, I2C_WORKER_PRIORITY,
+                        &bus->worker) != pdPASS) {
+            bus->worker = nullptr;
+        }
+        releaseBus(bus);
+
+        if (!bus->worker) {
+            Serial.printf("Failed to start the worker of I2C bus '%s'\n", bus->name);
+            return false;
+        }
+    }
+
+    // Never wait, the caller is the one that must not block on the bus
+    if (xQueueSend(bus->queue, &transaction, 0) != pdTRUE) {
+        Serial.printf("Transaction queue of I2C bus '%s' is full\n", bus->name);
+        return false;
+    }
+    return true;
+}
+
+void I2CManager::workerTask(void* parameter) {
+    BusInfo* bus = static_cast<BusInfo*>(parameter);
+    I2CManager& manager = getInstance();
+    Transaction transaction;
+
+    while (true) {
+        if (xQueueReceive(bus->queue, &transaction, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Synchronous calls on the same bus go in between transactions, never in the middle of a batch
+        manager.takeBus(bus, portMAX_DELAY);
+        bool success = true;
+        if (transaction.isWrite) {
+            success = manager.transferWrite(bus, transaction.deviceAddress, transaction.reads[0].registerAddress,
+                                            transaction.data);
+        } else {
+            for (uint8_t i = 0; success && i < transaction.count; i++) {
+                const RegisterRead& read = transaction.reads[i];
+                success = manager.transferRead(bus, transaction.deviceAddress, read.registerAddress,
+                                               read.buffer, read.length);
+            }
+        }
+        manager.releaseBus(bus);
+
+        if (transaction.callback) {
+            transaction.callback(success, transaction.context);
+        }
+    }
+}
+
 } // namespace Utils
@@ -4,17 +4,64 @@
 #include <Wire.h>
 #include <map>
 #include <string>
+#include <freertos/queue.h>
+
+// Transactions a bus holds queued before queueRead() and friends fail
+#ifndef I2C_TRANSACTION_QUEUE_SIZE
+#define I2C_TRANSACTION_QUEUE_SIZE 8
+#endif
+
+// Most register reads in one batch
+#define I2C_BATCH_MAX_READS 8
 
 namespace Utils {
 
 /**
  * @brief A centralized I2C bus management system
- * 
+ *
  * This class provides methods for managing multiple I2C buses,
  * synchronizing access with mutexes, and handling common I2C operations.
+ *
+ * Every operation takes either the bus name or a handle from getBusHandle().
+ * The handle skips the name lookup and stays valid for the lifetime of the program.
+ *
+ * Transfers can also be queued. Each bus then gets a worker task that runs
+ * them in order and calls the completion callback from that task, so the
+ * caller does not wait for the bus and the worker sleeps in the driver while
+ * the transfer is on the wire.
+ *
+ * Usage example:
+ * I2CManager::BusHandle bus = I2CManager::getInstance().getBusHandle("sensors");
+ * I2CManager::RegisterRead reads[2] = {{0x00, status, 1}, {0x10, sample, 6}};
+ * I2CManager::getInstance().queueBatchRead(bus, 0x68, reads, 2, onSampleRead, nullptr);
  */
 class I2CManager {
+private:
+    struct BusInfo;
+
 public:
+    /**
+     * @brief Resolved bus, returned by getBusHandle()
+     */
+    typedef BusInfo* BusHandle;
+
+    /**
+     * @brief One register read of a batch
+     */
+    struct RegisterRead {
+        uint8_t registerAddress;  // First register to read
+        uint8_t* buffer;          // Receives the data, must stay valid until the callback
+        uint8_t length;           // Number of bytes to read
+    };
+
+    /**
+     * @brief Callback of a queued transaction
+     * Called from the worker task of the bus, it must not block for long
+     * @param success true if every transfer of the transaction was successful
+     * @param context Context given when the transaction was queued
+     */
+    typedef void (*TransactionCallback)(bool success, void* context);
+
     /**
      * @brief Get the singleton instance of I2CManager
      * @return Reference to the I2CManager instance
@@ -23,7 +70,7 @@ public:
 
     /**
      * @brief Initialize an I2C bus
-     * 
+     *
      * @param busName Unique name to identify this I2C bus
      * @param sda SDA pin number
      * @param scl SCL pin number
@@ -33,9 +80,17 @@ public:
      */
     bool initBus(const char* busName, int sda, int scl, uint32_t frequency = 100000, bool useWire = true);
 
+    /**
+     * @brief Resolve a bus name once for the operations taking a handle
+     *
+     * @param busName Name of the I2C bus
+     * @return Handle of the bus, or nullptr if not found
+     */
+    BusHandle getBusHandle(const char* busName);
+
     /**
      * @brief Get a pointer to a TwoWire instance for a specific bus
-     * 
+     *
      * @param busName Name of the I2C bus
      * @return TwoWire* Pointer to the bus, or nullptr if not found
      */
@@ -43,16 +98,17 @@ public:
 
     /**
      * @brief Check if a device is present on a bus
-     * 
+     *
      * @param busName Name of the I2C bus
      * @param address Device address
      * @return true if device is detected
      */
     bool devicePresent(const char* busName, byte address);
+    bool devicePresent(BusHandle bus, byte address);
 
     /**
      * @brief Write a byte to a device register
-     * 
+     *
      * @param busName Name of the I2C bus
      * @param deviceAddress Device address
      * @param registerAddress Register address
@@ -60,10 +116,11 @@ public:
      * @return true if write was successful
      */
     bool writeRegister(const char* busName, byte deviceAddress, uint8_t registerAddress, uint8_t data);
+    bool writeRegister(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t data);
 
     /**
      * @brief Read a byte from a device register
-     * 
+     *
      * @param busName Name of the I2C bus
      * @param deviceAddress Device address
      * @param registerAddress Register address
@@ -71,10 +128,11 @@ public:
      * @return true if read was successful
      */
     bool readRegister(const char* busName, byte deviceAddress, uint8_t registerAddress, uint8_t &result);
+    bool readRegister(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t &result);
 
     /**
      * @brief Read multiple bytes from a device register
-     * 
+     *
      * @param busName Name of the I2C bus
      * @param deviceAddress Device address
      * @param registerAddress Register address
@@ -82,12 +140,66 @@ public:
      * @param length Number of bytes to read
      * @return true if read was successful
      */
-    bool readRegisters(const char* busName, byte deviceAddress, uint8_t registerAddress, 
+    bool readRegisters(const char* busName, byte deviceAddress, uint8_t registerAddress,
+                      uint8_t *buffer, uint8_t length);
+    bool readRegisters(BusHandle bus, byte deviceAddress, uint8_t registerAddress,
                       uint8_t *buffer, uint8_t length);
 
+    /**
+     * @brief Queue a read of multiple bytes from a device register
+     *
+     * @param bus Handle of the I2C bus
+     * @param deviceAddress Device address
+     * @param registerAddress Register address
+     * @param buffer Buffer to store the results, must stay valid until the callback
+     * @param length Number of bytes to read
+     * @param callback Called when the read is done, may be nullptr
+     * @param context Passed to the callback
+     * @return true if the read was queued, false if the queue is full
+     */
+    bool queueRead(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t *buffer, uint8_t length,
+                   TransactionCallback callback, void* context);
+
+    /**
+     * @brief Queue several register reads of one device as a single transaction
+     * The bus is taken once for all reads, the reads array itself is copied
+     *
+     * @param bus Handle of the I2C bus
+     * @param deviceAddress Device address
+     * @param reads Reads to run in order
+     * @param count Number of reads, up to I2C_BATCH_MAX_READS
+     * @param callback Called when every read is done or one failed, may be nullptr
+     * @param context Passed to the callback
+     * @return true if the batch was queued, false if the queue is full
+     */
+    bool queueBatchRead(BusHandle bus, byte deviceAddress, const RegisterRead* reads, uint8_t count,
+                        TransactionCallback callback, void* context);
+
+    /**
+     * @brief Queue a write of a byte to a device register
+     *
+     * @param bus Handle of the I2C bus
+     * @param deviceAddress Device address
+     * @param registerAddress Register address
+     * @param data Data byte to write
+     * @param callback Called when the write is done, may be nullptr
+     * @param context Passed to the callback
+     * @return true if the write was queued, false if the queue is full
+     */
+    bool queueWrite(BusHandle bus, byte deviceAddress, uint8_t registerAddress, uint8_t data,
+                    TransactionCallback callback, void* context);
+
+    /**
+     * @brief Get the number of queued transactions not yet done
+     *
+     * @param bus Handle of the I2C bus
+     * @return Transactions waiting for the worker task
+     */
+    uint8_t getPendingCount(BusHandle bus) const;
+
     /**
      * @brief Scan the bus for I2C devices and log their addresses
-     * 
+     *
      * @param busName Name of the I2C bus
      */
     void scanBus(const char* busName);
@@ -102,22 +214,47 @@ private:
 
     // Structure to hold bus information
     struct BusInfo {
+        const char* name;  // Key of the bus in _buses
         TwoWire* wire;
         SemaphoreHandle_t mutex;
         int sdaPin;
         int sclPin;
         uint32_t frequency;
         bool isDefault;  // Using default Wire object
+        QueueHandle_t queue;   // Queued transactions, created with the worker
+        TaskHandle_t worker;   // Runs the queued transactions
     };
 
-    // Map of bus names to bus info
+    // Queued transaction, copied into the queue of the bus
+    struct Transaction {
+        TransactionCallback callback;
+        void* context;
+        byte deviceAddress;
+        bool isWrite;
+        uint8_t data;      // Byte to write to reads[0].registerAddress
+        uint8_t count;     // Reads in the batch
+        RegisterRead reads[I2C_BATCH_MAX_READS];
+    };
+
+    // Map of bus names to bus info, the nodes never move so handles stay valid
     std::map<std::string, BusInfo> _buses;
 
     // Helper to get bus info and take mutex if available
     BusInfo* takeBus(const char* busName, uint32_t timeoutMs = 100);
-    
+    BusInfo* takeBus(BusHandle bus, uint32_t timeoutMs = 100);
+
     // Helper to release a bus mutex
     void releaseBus(BusInfo* bus);
+
+    // Transfers on a bus already taken
+    bool transferWrite(BusInfo* bus, byte deviceAddress, uint8_t registerAddress, uint8_t data);
+    bool transferRead(BusInfo* bus, byte deviceAddress, uint8_t registerAddress, uint8_t *buffer, uint8_t length);
+
+    // Queue a transaction, starting the worker of the bus on first use
+    bool enqueue(BusHandle bus, const Transaction& transaction);
+
+    // Task that runs the queued transactions of one bus
+    static void workerTask(void* parameter);
 };
 
 } // namespace Utils
@@ -1,11 +1,108 @@
 #include <SPIFFS.h>
 #include "lib/Utils/SpiAllocator.h"
 #include "Logger.h"
+#include <algorithm>
 
 namespace Utils {
 
-Logger::Logger() : _serialEnabled(true),
-                 _logLevel(LogLevel::INFO){
+namespace {
+
+// Conversion specification of a printf format
+struct FormatSpec {
+    const char* begin;      // The '%'
+    const char* end;        // Past the conversion character
+    char conversion;
+    uint8_t stars;          // '*' width or precision, each takes an int argument
+    bool isLong;            // l
+    bool isLongLong;        // ll, j, q
+    bool isSize;            // z, t
+    bool isLongDouble;      // L
+};
+
+// Parse the specification at '%', false for a conversion the logger doesn't know
+bool parseSpec(const char* p, FormatSpec& spec) {
+    spec = FormatSpec();
+    spec.begin = p++;
+
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        spec.stars++;
+        p++;
+    } else {
+        while (isdigit((unsigned char)*p)) p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec.stars++;
+            p++;
+        } else {
+            while (isdigit((unsigned char)*p)) p++;
+        }
+    }
+
+    switch (*p) {
+        case 'h':
+            p++;
+            if (*p == 'h') p++;
+            break;
+        case 'l':
+            p++;
+            if (*p == 'l') {
+                spec.isLongLong = true;
+                p++;
+            } else {
+                spec.isLong = true;
+            }
+            break;
+        case 'j':
+        case 'q':
+            spec.isLongLong = true;
+            p++;
+            break;
+        case 'z':
+        case 't':
+            spec.isSize = true;
+            p++;
+            break;
+        case 'L':
+            spec.isLongDouble = true;
+            p++;
+            break;
+    }
+
+    spec.conversion = *p;
+    if (!*p || !strchr("diouxXcsfFeEgGaApn", *p)) {
+        return false;
+    }
+    spec.end = p + 1;
+    return true;
+}
+
+bool isIntegerConversion(char conversion) {
+    return strchr("diouxX", conversion) != nullptr;
+}
+
+bool isFloatConversion(char conversion) {
+    return strchr("fFeEgGaA", conversion) != nullptr;
+}
+
+} // namespace
+
+Logger::Logger() : _enqueuePos(0),
+                 _dequeuePos(0),
+                 _droppedCount(0),
+                 _reportedDrops(0),
+                 _drainTaskHandle(nullptr),
+                 _serialEnabled(true){
+    for (size_t i = 0; i < (size_t)LogModule::COUNT; i++) {
+        _moduleLevels[i] = LogLevel::INFO;
+    }
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
 }
 
 Logger::~Logger() {
@@ -18,33 +115,274 @@ Logger& Logger::getInstance() {
 
 bool Logger::init(bool serialEnabled) {
     _serialEnabled = serialEnabled;
-    
+
     if (_serialEnabled) {
         Serial.begin(115200);
     }
-    
+
+    // Formatting and UART output happen here, below every task that logs
+    if (!_drainTaskHandle &&
+        xTaskCreate(drainTask, "logger", 4096, this, tskIDLE_PRIORITY + 1, &_drainTaskHandle) != pdPASS) {
+        _drainTaskHandle = nullptr;
+        return false;
+    }
+
     return true;
 }
 
 void Logger::setLogLevel(LogLevel level) {
-    _logLevel = level;
+    for (size_t i = 0; i < (size_t)LogModule::COUNT; i++) {
+        _moduleLevels[i] = level;
+    }
 }
 
-void Logger::log(LogLevel level, const String& message) {
-    if (level < _logLevel) {
+void Logger::setModuleLevel(LogModule module, LogLevel level) {
+    if (module < LogModule::COUNT) {
+        _moduleLevels[(size_t)module] = level;
+    }
+}
+
+LogLevel Logger::getModuleLevel(LogModule module) const {
+    return module < LogModule::COUNT ? _moduleLevels[(size_t)module] : LogLevel::CRITICAL;
+}
+
+void Logger::flush(uint32_t timeoutMs) {
+    // Without the drain task this is the only consumer
+    if (!_drainTaskHandle) {
+        drain();
         return;
     }
-    
-    unsigned long currentTime = millis();
-    String logMessage = String(currentTime) + " [" + logLevelToString(level) + "] " + message;
-    
-    // Always log to Serial and file synchronously for immediate feedback
-    if (_serialEnabled) {
-        Serial.println(logMessage);
+
+    xTaskNotifyGive(_drainTaskHandle);
+    unsigned long start = millis();
+    while (_dequeuePos != _enqueuePos.load(std::memory_order_acquire) && millis() - start < timeoutMs) {
+        vTaskDelay(1);
+    }
+}
+
+uint32_t Logger::getDroppedCount() const {
+    return _droppedCount.load(std::memory_order_relaxed);
+}
+
+bool Logger::enqueue(LogLevel level, const char* format, va_list args) {
+    // Claim a cell, producers on both cores and in ISRs only race on the position
+    uint32_t pos = _enqueuePos.load(std::memory_order_relaxed);
+    LogCell* cell;
+    while (true) {
+        cell = &_cells[pos & (LOG_RING_SIZE - 1)];
+        uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+
+        if (diff == 0) {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The drain task hasn't caught up
+            _droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    LogRecord& record = cell->record;
+    record.format = format;
+    record.timestamp = millis();
+    record.level = level;
+    record.argCount = 0;
+    record.stringBytes = 0;
+
+    // Capture the arguments the format asks for, the drain task formats them later
+    FormatSpec spec;
+    for (const char* p = strchr(format, '%'); p; p = strchr(p, '%')) {
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        if (!parseSpec(p, spec) || record.argCount + spec.stars + 1 > LOG_MAX_ARGS) {
+            break;
+        }
+        p = spec.end;
+
+        for (uint8_t i = 0; i < spec.stars; i++) {
+            record.args[record.argCount++].i = va_arg(args, int);
+        }
+
+        LogArgument& arg = record.args[record.argCount++];
+        char conversion = spec.conversion;
+        if (conversion == 'd' || conversion == 'i') {
+            if (spec.isLongLong) arg.i = va_arg(args, long long);
+            else if (spec.isLong) arg.i = va_arg(args, long);
+            else if (spec.isSize) arg.i = va_arg(args, ptrdiff_t);
+            else arg.i = va_arg(args, int);
+        } else if (isIntegerConversion(conversion)) {
+            if (spec.isLongLong) arg.u = va_arg(args, unsigned long long);
+            else if (spec.isLong) arg.u = va_arg(args, unsigned long);
+            else if (spec.isSize) arg.u = va_arg(args, size_t);
+            else arg.u = va_arg(args, unsigned int);
+        } else if (isFloatConversion(conversion)) {
+            arg.d = spec.isLongDouble ? (double)va_arg(args, long double) : va_arg(args, double);
+        } else if (conversion == 'c') {
+            arg.i = va_arg(args, int);
+        } else if (conversion == 's') {
+            // The string may be gone by the time it is printed, copy what fits
+            const char* str = va_arg(args, const char*);
+            if (!str) {
+                str = "(null)";
+            }
+            size_t room = LOG_STRING_BYTES - record.stringBytes;
+            if (room == 0) {
+                // Full, point at the terminator of the last string
+                arg.s.offset = LOG_STRING_BYTES - 1;
+                arg.s.length = 0;
+                continue;
+            }
+            size_t length = strnlen(str, room - 1);
+            arg.s.offset = record.stringBytes;
+            arg.s.length = length;
+            memcpy(record.strings + record.stringBytes, str, length);
+            record.strings[record.stringBytes + length] = '\0';
+            record.stringBytes += length + 1;
+        } else {
+            arg.p = va_arg(args, void*);
+        }
+    }
+
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool Logger::dequeue(LogRecord& record) {
+    LogCell& cell = _cells[_dequeuePos & (LOG_RING_SIZE - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != _dequeuePos + 1) {
+        return false;
+    }
+
+    record = cell.record;
+
+    // Hand the cell back to the producers for the next lap
+    cell.sequence.store(_dequeuePos + LOG_RING_SIZE, std::memory_order_release);
+    _dequeuePos = _dequeuePos + 1;
+    return true;
+}
+
+size_t Logger::formatRecord(const LogRecord& record, char* line, size_t size) {
+    int written = snprintf(line, size, "%lu [%s] ", (unsigned long)record.timestamp, logLevelToString(record.level));
+    size_t pos = written > 0 ? std::min((size_t)written, size - 1) : 0;
+
+    // Format one conversion at a time with the captured argument
+    uint8_t argIndex = 0;
+    const char* p = record.format;
+    FormatSpec spec;
+    while (*p && pos < size - 1) {
+        if (*p != '%') {
+            line[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            line[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Unknown conversion, print the rest as it is
+        if (!parseSpec(p, spec)) {
+            line[pos++] = *p++;
+            continue;
+        }
+
+        // Argument wasn't captured
+        if (argIndex + spec.stars + 1 > record.argCount) {
+            line[pos++] = '?';
+            p = spec.end;
+            continue;
+        }
+
+        // Rebuild the specification without its length modifier, integers are printed as 64 bit
+        char specText[32];
+        size_t specLength = 0;
+        for (const char* q = spec.begin; q < spec.end - 1 && specLength < sizeof(specText) - 12; q++) {
+            if (*q == '*') {
+                specLength += snprintf(specText + specLength, sizeof(specText) - specLength, "%d",
+                                       (int)record.args[argIndex++].i);
+            } else if (!strchr("hljztqL", *q)) {
+                specText[specLength++] = *q;
+            }
+        }
+        if (isIntegerConversion(spec.conversion)) {
+            specText[specLength++] = 'l';
+            specText[specLength++] = 'l';
+        }
+        specText[specLength++] = spec.conversion;
+        specText[specLength] = '\0';
+
+        const LogArgument& arg = record.args[argIndex++];
+        char* out = line + pos;
+        size_t room = size - pos;
+        char conversion = spec.conversion;
+        if (conversion == 'd' || conversion == 'i') {
+            written = snprintf(out, room, specText, (long long)arg.i);
+        } else if (isIntegerConversion(conversion)) {
+            written = snprintf(out, room, specText, (unsigned long long)arg.u);
+        } else if (isFloatConversion(conversion)) {
+            written = snprintf(out, room, specText, arg.d);
+        } else if (conversion == 'c') {
+            written = snprintf(out, room, specText, (int)arg.i);
+        } else if (conversion == 's') {
+            written = snprintf(out, room, specText, record.strings + arg.s.offset);
+        } else if (conversion == 'p') {
+            written = snprintf(out, room, specText, arg.p);
+        } else {
+            written = 0;  // %n
+        }
+
+        if (written > 0) {
+            pos = std::min(pos + written, size - 1);
+        }
+        p = spec.end;
+    }
+
+    line[pos] = '\0';
+    return pos;
+}
+
+void Logger::drain() {
+    LogRecord record;
+    char line[LOG_LINE_SIZE];
+
+    while (dequeue(record)) {
+        formatRecord(record, line, sizeof(line));
+        if (_serialEnabled) {
+            Serial.println(line);
+        }
+    }
+
+    // Tell about messages that never made it into the ring
+    uint32_t dropped = getDroppedCount();
+    if (dropped != _reportedDrops) {
+        if (_serialEnabled) {
+            Serial.printf("%lu [WARNING] %u log messages dropped\n", millis(), dropped - _reportedDrops);
+        }
+        _reportedDrops = dropped;
+    }
+}
+
+void Logger::drainTask(void* parameter) {
+    Logger* logger = static_cast<Logger*>(parameter);
+
+    while (true) {
+        // Errors wake the task right away, everything else waits for the next round
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+        logger->drain();
     }
 }
 
-String Logger::logLevelToString(LogLevel level) {
+void Logger::log(LogLevel level, const String& message) {
+    log(level, "%s", message.c_str());
+}
+
+const char* Logger::logLevelToString(LogLevel level) {
     switch (level) {
         case LogLevel::DEBUG:
             return "DEBUG";
@@ -78,93 +416,129 @@ String Logger::logLevelToLowerString(LogLevel level) {
     }
 }
 
-String Logger::formatString(const char* format, va_list args) {
-    char buffer[256]; // Buffer to hold formatted string
-    
-    // Format the string
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    
-    // Return as a String object
-    return String(buffer);
-}
-
 void Logger::debug(const String& format, ...) {
-    va_list args;
-    debug(format.c_str(), args);
+    log(LogLevel::DEBUG, format);
 }
 
 void Logger::debug(const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, LogLevel::DEBUG)) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(LogLevel::DEBUG, format, args);
     va_end(args);
-    
-    log(LogLevel::DEBUG, formattedMessage);
 }
 
 void Logger::info(const String& format, ...) {
-    va_list args;
-    info(format.c_str(), args);
+    log(LogLevel::INFO, format);
 }
 
 void Logger::info(const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, LogLevel::INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(LogLevel::INFO, format, args);
     va_end(args);
-    
-    log(LogLevel::INFO, formattedMessage);
 }
 
 void Logger::warning(const String& format, ...) {
-    va_list args;
-    warning(format.c_str(), args);
+    log(LogLevel::WARNING, format);
 }
 
 void Logger::warning(const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, LogLevel::WARNING)) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(LogLevel::WARNING, format, args);
     va_end(args);
-    
-    log(LogLevel::WARNING, formattedMessage);
 }
 
 void Logger::error(const String& format, ...) {
-    va_list args;
-    error(format.c_str(), args);
+    log(LogLevel::ERROR, format);
 }
 
 void Logger::error(const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, LogLevel::ERROR)) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(LogLevel::ERROR, format, args);
     va_end(args);
-    
-    log(LogLevel::ERROR, formattedMessage);
+
+    if (_drainTaskHandle) {
+        xTaskNotifyGive(_drainTaskHandle);
+    }
 }
 
 void Logger::critical(const String& format, ...) {
-    va_list args;
-    critical(format.c_str(), args);
+    log(LogLevel::CRITICAL, format);
 }
 
 void Logger::critical(const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, LogLevel::CRITICAL)) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(LogLevel::CRITICAL, format, args);
     va_end(args);
-    
-    log(LogLevel::CRITICAL, formattedMessage);
+
+    if (_drainTaskHandle) {
+        xTaskNotifyGive(_drainTaskHandle);
+    }
 }
 
 void Logger::log(LogLevel level, const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, level)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    enqueue(level, format, args);
+    va_end(args);
+
+    if (level >= LogLevel::ERROR && _drainTaskHandle) {
+        xTaskNotifyGive(_drainTaskHandle);
+    }
+}
+
+void Logger::log(LogModule module, LogLevel level, const char* format, ...) {
+    if (!isEnabled(module, level)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    enqueue(level, format, args);
+    va_end(args);
+
+    if (level >= LogLevel::ERROR && _drainTaskHandle) {
+        xTaskNotifyGive(_drainTaskHandle);
+    }
+}
+
+void Logger::logFromISR(LogLevel level, const char* format, ...) {
+    if (!isEnabled(LogModule::GENERAL, level)) {
+        return;
+    }
+
+    // Lock-free and never blocks, the drain task picks it up on its next round
     va_list args;
     va_start(args, format);
-    String formattedMessage = formatString(format, args);
+    enqueue(level, format, args);
     va_end(args);
-    
-    log(level, formattedMessage);
 }
 
 } // namespace Utils
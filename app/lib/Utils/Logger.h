@@ -4,7 +4,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
-#include <vector>
+#include <atomic>
 #include <cstdarg>
 
 namespace Utils {
@@ -17,13 +17,96 @@ enum class LogLevel {
     CRITICAL
 };
 
-// Structure to hold log messages in the queue
-struct LogMessage {
-    String message;
+// Part of the firmware a message belongs to, each has its own runtime level
+enum class LogModule : uint8_t {
+    GENERAL,
+    SPI,
+    CAMERA,
+    HEALTH,
+    COUNT
+};
+
+// Lowest level compiled in, 0 = DEBUG ... 4 = CRITICAL, follows CORE_DEBUG_LEVEL unless set
+#ifndef LOG_MIN_LEVEL
+#if !defined(CORE_DEBUG_LEVEL) || CORE_DEBUG_LEVEL >= 4
+#define LOG_MIN_LEVEL 0
+#elif CORE_DEBUG_LEVEL == 3
+#define LOG_MIN_LEVEL 1
+#elif CORE_DEBUG_LEVEL == 2
+#define LOG_MIN_LEVEL 2
+#elif CORE_DEBUG_LEVEL == 1
+#define LOG_MIN_LEVEL 3
+#else
+#define LOG_MIN_LEVEL 4
+#endif
+#endif
+
+// Whether a message would be logged, use it to guard work done only for a log line
+#define LOG_ENABLED(module, level) \
+    ((int)Utils::LogLevel::level >= LOG_MIN_LEVEL && \
+     Utils::Logger::getInstance().isEnabled(Utils::LogModule::module, Utils::LogLevel::level))
+
+// Below LOG_MIN_LEVEL these compile to nothing, the arguments are not evaluated either
+#define LOG_AT(module, level, ...) \
+    do { \
+        if (LOG_ENABLED(module, level)) { \
+            Utils::Logger::getInstance().log(Utils::LogModule::module, Utils::LogLevel::level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(module, ...) LOG_AT(module, DEBUG, __VA_ARGS__)
+#define LOG_INFO(module, ...) LOG_AT(module, INFO, __VA_ARGS__)
+#define LOG_WARNING(module, ...) LOG_AT(module, WARNING, __VA_ARGS__)
+#define LOG_ERROR(module, ...) LOG_AT(module, ERROR, __VA_ARGS__)
+#define LOG_CRITICAL(module, ...) LOG_AT(module, CRITICAL, __VA_ARGS__)
+
+// Number of records in the log ring, must be a power of two
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 64
+#endif
+
+#define LOG_MAX_ARGS 8          // Arguments kept per message, further ones print as '?'
+#define LOG_STRING_BYTES 96     // Room for copies of %s arguments per message
+#define LOG_LINE_SIZE 256       // Longest formatted line
+#define LOG_DRAIN_INTERVAL_MS 20
+
+// Argument captured from the variable argument list, its type follows from the format
+union LogArgument {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void* p;
+    struct {
+        uint16_t offset;        // Into LogRecord::strings
+        uint16_t length;
+    } s;
+};
+
+// Message waiting in the log ring, formatted later by the drain task
+struct LogRecord {
+    const char* format;         // Must outlive the record, string literals only
+    uint32_t timestamp;
     LogLevel level;
-    unsigned long timestamp;
+    uint8_t argCount;
+    uint8_t stringBytes;
+    LogArgument args[LOG_MAX_ARGS];
+    char strings[LOG_STRING_BYTES];
 };
 
+/**
+ * Logger class
+ *
+ * Callers only record the format pointer, the arguments and a timestamp in a
+ * lock-free ring. A low priority task formats the messages and writes them to
+ * Serial, so logging never waits on the UART. When the ring is full new
+ * messages are dropped and counted.
+ *
+ * Formats must be string literals, %s arguments are copied.
+ *
+ * Prefer the LOG_DEBUG(module, ...) style macros on hot paths, messages below
+ * LOG_MIN_LEVEL are removed at compile time and the rest are checked against
+ * the level of their module before any argument is evaluated.
+ */
 class Logger {
 public:
     /**
@@ -33,22 +116,55 @@ public:
     static Logger& getInstance();
     
     /**
-     * Initialize logger
+     * Initialize logger and start the drain task
      * @param serialEnabled Whether to log to Serial
-     * @param fileEnabled Whether to log to a file
-     * @param fileName The log file name
-     * @param batchSize Maximum number of log messages to process in a batch (default: 5)
-     * @param flushIntervalMs Interval in milliseconds to flush logs even if batch isn't full (default: 500ms)
      * @return true if initialization was successful, false otherwise
      */
     bool init(bool serialEnabled = true);
     
     /**
-     * Set minimum log level
+     * Wait until every recorded message has been written
+     * @param timeoutMs Longest time to wait
+     */
+    void flush(uint32_t timeoutMs = 1000);
+    
+    /**
+     * Get the number of messages dropped because the ring was full
+     * @return Number of dropped messages since boot
+     */
+    uint32_t getDroppedCount() const;
+    
+    /**
+     * Set minimum log level of every module
      * @param level The minimum log level to display
      */
     void setLogLevel(LogLevel level);
     
+    /**
+     * Set minimum log level of one module
+     * @param module The module
+     * @param level The minimum log level to display
+     */
+    void setModuleLevel(LogModule module, LogLevel level);
+    
+    /**
+     * Get minimum log level of one module
+     * @param module The module
+     * @return The minimum log level displayed
+     */
+    LogLevel getModuleLevel(LogModule module) const;
+    
+    /**
+     * Check if a message would be logged
+     * Inline so the LOG_* macros cost a single compare when the level is off
+     * @param module The module
+     * @param level The log level
+     * @return true if the message passes both the compile-time and the module level
+     */
+    bool isEnabled(LogModule module, LogLevel level) const {
+        return (int)level >= LOG_MIN_LEVEL && level >= _moduleLevels[(size_t)module];
+    }
+    
     /**
      * Log a formatted debug message (printf-style)
      * @param format The format string with placeholders like %d, %s, etc.
@@ -103,6 +219,24 @@ public:
      * @param ... Variable arguments to fill the format
      */
     void log(LogLevel level, const char* format, ...);
+    
+    /**
+     * Log a formatted message of a module (printf-style), used by the LOG_* macros
+     * @param module The module
+     * @param level The log level
+     * @param format The format string with placeholders like %d, %s, etc.
+     * @param ... Variable arguments to fill the format
+     */
+    void log(LogModule module, LogLevel level, const char* format, ...);
+    
+    /**
+     * Log a formatted message from an interrupt handler
+     * Never blocks. Not for ESP_INTR_FLAG_IRAM handlers, the format lives in flash.
+     * @param level The log level
+     * @param format The format string with placeholders like %d, %s, etc.
+     * @param ... Variable arguments to fill the format
+     */
+    void logFromISR(LogLevel level, const char* format, ...);
 
 private:
     Logger();
@@ -112,20 +246,61 @@ private:
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
     
+    // Slot of the log ring, the sequence tells producers and the drain task whose turn it is
+    struct LogCell {
+        std::atomic<uint32_t> sequence;
+        LogRecord record;
+    };
+    
     /**
-     * Helper method to format a string with variable arguments
-     * @param format The format string with placeholders
+     * Record a message in the ring
+     * @param level The log level
+     * @param format The format string, must outlive the record
      * @param args Variable argument list
-     * @return Formatted string
+     * @return true if recorded, false if the ring was full
      */
-    String formatString(const char* format, va_list args);
+    bool enqueue(LogLevel level, const char* format, va_list args);
+    
+    /**
+     * Take the oldest record out of the ring, drain task only
+     * @param record Reference to store the record
+     * @return true if a record was taken
+     */
+    bool dequeue(LogRecord& record);
+    
+    /**
+     * Format a record into a line
+     * @param record The record
+     * @param line Output buffer
+     * @param size Size of the output buffer
+     * @return Length of the line
+     */
+    size_t formatRecord(const LogRecord& record, char* line, size_t size);
+    
+    /**
+     * Write all recorded messages
+     */
+    void drain();
+    
+    /**
+     * Drain task entry point
+     * @param parameter Logger instance
+     */
+    static void drainTask(void* parameter);
+    
+    LogCell _cells[LOG_RING_SIZE];
+    std::atomic<uint32_t> _enqueuePos;
+    volatile uint32_t _dequeuePos;   // Only the drain task moves it
+    std::atomic<uint32_t> _droppedCount;
+    uint32_t _reportedDrops;
+    TaskHandle_t _drainTaskHandle;
     
     bool _serialEnabled;
     String _fileName;
-    LogLevel _logLevel;
+    volatile LogLevel _moduleLevels[(size_t)LogModule::COUNT];
     
     // Convert log level to string
-    String logLevelToString(LogLevel level);
+    const char* logLevelToString(LogLevel level);
     
     // Convert log level to lowercase string (for frontend display)
     String logLevelToLowerString(LogLevel level);
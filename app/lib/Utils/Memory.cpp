@@ -0,0 +1,370 @@
+#include "Memory.h"
+#include <esp_idf_version.h>
+
+// The address checks moved out of the SoC layout header in IDF 5.0
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+
+// The heap reports the size of a buffer since IDF 5.1, before that it is kept in a table here
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#define MEMORY_HEAP_KNOWS_SIZE 1
+#else
+#define MEMORY_HEAP_KNOWS_SIZE 0
+#endif
+
+namespace Utils {
+
+namespace {
+
+MemoryStats s_internal = {0, 0, 0};
+MemoryStats s_external = {0, 0, 0};
+portMUX_TYPE s_statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+BlockPool* s_firstPool = nullptr;
+portMUX_TYPE s_poolListMux = portMUX_INITIALIZER_UNLOCKED;
+
+#if !MEMORY_HEAP_KNOWS_SIZE
+// Open addressing table of counted buffers, under s_statsMux
+struct TrackedBuffer {
+    void* pointer;
+    size_t size;
+};
+TrackedBuffer s_tracked[MEMORY_TRACKED_BUFFERS];
+
+size_t homeIndex(const void* pointer) {
+    return ((uintptr_t)pointer >> 2) % MEMORY_TRACKED_BUFFERS;
+}
+
+// Remember the size of a buffer, false if the table is full
+bool trackSize(void* pointer, size_t size) {
+    size_t index = homeIndex(pointer);
+    for (size_t probe = 0; probe < MEMORY_TRACKED_BUFFERS; probe++) {
+        TrackedBuffer& entry = s_tracked[index];
+        if (!entry.pointer || entry.pointer == pointer) {
+            entry.pointer = pointer;
+            entry.size = size;
+            return true;
+        }
+        index = (index + 1) % MEMORY_TRACKED_BUFFERS;
+    }
+    return false;
+}
+
+// Forget a buffer, returns its size or 0 if it was not in the table
+size_t untrackSize(void* pointer) {
+    size_t hole = homeIndex(pointer);
+    size_t probe = 0;
+    while (probe < MEMORY_TRACKED_BUFFERS && s_tracked[hole].pointer != pointer) {
+        if (!s_tracked[hole].pointer) {
+            return 0;
+        }
+        hole = (hole + 1) % MEMORY_TRACKED_BUFFERS;
+        probe++;
+    }
+    if (probe == MEMORY_TRACKED_BUFFERS) {
+        return 0;
+    }
+    size_t size = s_tracked[hole].size;
+
+    // Move later entries of the chain into the hole, so lookups never stop short of them
+    size_t next = (hole + 1) % MEMORY_TRACKED_BUFFERS;
+    for (size_t step = 1; step < MEMORY_TRACKED_BUFFERS && s_tracked[next].pointer; step++) {
+        size_t home = homeIndex(s_tracked[next].pointer);
+        bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            s_tracked[hole] = s_tracked[next];
+            hole = next;
+        }
+        next = (next + 1) % MEMORY_TRACKED_BUFFERS;
+    }
+    s_tracked[hole].pointer = nullptr;
+    return size;
+}
+#endif
+
+// Heap capabilities of the first and the fallback region of a placement, 0 for none
+uint32_t primaryCaps(MemoryPlacement placement) {
+    switch (placement) {
+        case MemoryPlacement::Dma:
+            return MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL;
+        case MemoryPlacement::Internal:
+            return MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+        case MemoryPlacement::Psram:
+        case MemoryPlacement::PsramFirst:
+            return MALLOC_CAP_SPIRAM;
+    }
+    return MALLOC_CAP_DEFAULT;
+}
+
+uint32_t fallbackCaps(MemoryPlacement placement) {
+    return placement == MemoryPlacement::PsramFirst ? (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : 0;
+}
+
+void addUsage(MemoryStats& stats, size_t size) {
+    stats.used += size;
+    if (stats.used > stats.peak) {
+        stats.peak = stats.used;
+    }
+}
+
+void removeUsage(MemoryStats& stats, size_t size) {
+    stats.used = stats.used > size ? stats.used - size : 0;
+}
+
+void countFailure(MemoryPlacement placement) {
+    portENTER_CRITICAL(&s_statsMux);
+    if (placement == MemoryPlacement::Psram || placement == MemoryPlacement::PsramFirst) {
+        s_external.failures++;
+    } else {
+        s_internal.failures++;
+    }
+    portEXIT_CRITICAL(&s_statsMux);
+}
+
+} // namespace
+
+void* Memory::allocate(size_t size, MemoryPlacement placement) {
+    void* pointer = heap_caps_malloc(size, primaryCaps(placement));
+    uint32_t fallback = fallbackCaps(placement);
+    if (!pointer && fallback) {
+        pointer = heap_caps_malloc(size, fallback);
+    }
+
+    if (!pointer) {
+        countFailure(placement);
+        return nullptr;
+    }
+    count(pointer, size, true);
+    return pointer;
+}
+
+void* Memory::reallocate(void* pointer, size_t size, MemoryPlacement placement) {
+    if (!pointer) {
+        return allocate(size, placement);
+    }
+
+    // The old buffer is gone once realloc succeeds, count it out first and back in on failure
+    size_t previousSize = count(pointer, 0, false);
+    void* resized = heap_caps_realloc(pointer, size, primaryCaps(placement));
+    uint32_t fallback = fallbackCaps(placement);
+    if (!resized && fallback) {
+        resized = heap_caps_realloc(pointer, size, fallback);
+    }
+
+    if (!resized) {
+        count(pointer, previousSize, true);
+        countFailure(placement);
+        return nullptr;
+    }
+    count(resized, size, true);
+    return resized;
+}
+
+void Memory::release(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    count(pointer, 0, false);
+    heap_caps_free(pointer);
+}
+
+void Memory::adopt(void* pointer, size_t size) {
+    if (pointer) {
+        count(pointer, size, true);
+    }
+}
+
+MemoryStats Memory::getInternalStats() {
+    portENTER_CRITICAL(&s_statsMux);
+    MemoryStats stats = s_internal;
+    portEXIT_CRITICAL(&s_statsMux);
+    return stats;
+}
+
+MemoryStats Memory::getExternalStats() {
+    portENTER_CRITICAL(&s_statsMux);
+    MemoryStats stats = s_external;
+    portEXIT_CRITICAL(&s_statsMux);
+    return stats;
+}
+
+size_t Memory::count(void* pointer, size_t size, bool allocated) {
+    // The address tells the region and the heap knows the size, nothing is stored per buffer
+    MemoryStats& stats = esp_ptr_external_ram(pointer) ? s_external : s_internal;
+#if MEMORY_HEAP_KNOWS_SIZE
+    size = heap_caps_get_allocated_size(pointer);
+#endif
+
+    portENTER_CRITICAL(&s_statsMux);
+#if !MEMORY_HEAP_KNOWS_SIZE
+    // Older heaps can't tell, a buffer the full table has no room for stays uncounted
+    if (allocated) {
+        size = trackSize(pointer, size) ? size : 0;
+    } else {
+        size = untrackSize(pointer);
+    }
+#endif
+    if (allocated) {
+        addUsage(stats, size);
+    } else {
+        removeUsage(stats, size);
+    }
+    portEXIT_CRITICAL(&s_statsMux);
+    return size;
+}
+
+BlockPool::BlockPool(const char* name, size_t blockSize, uint8_t capacity, MemoryPlacement placement)
+    : _name(name), _blockSize(blockSize),
+      _capacity(capacity < BLOCK_POOL_MAX_BLOCKS ? capacity : BLOCK_POOL_MAX_BLOCKS),
+      _placement(placement), _allocatedCount(0), _inUseMask(0), _highWater(0), _failureCount(0),
+      _next(nullptr), _mux(portMUX_INITIALIZER_UNLOCKED) {
+    for (int i = 0; i < BLOCK_POOL_MAX_BLOCKS; i++) {
+        _blocks[i] = nullptr;
+    }
+
+    portENTER_CRITICAL(&s_poolListMux);
+    _next = s_firstPool;
+    s_firstPool = this;
+    portEXIT_CRITICAL(&s_poolListMux);
+}
+
+BlockPool::~BlockPool() {
+    portENTER_CRITICAL(&s_poolListMux);
+    BlockPool** link = &s_firstPool;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    portEXIT_CRITICAL(&s_poolListMux);
+
+    for (int i = 0; i < _allocatedCount; i++) {
+        Memory::release(_blocks[i]);
+        _blocks[i] = nullptr;
+    }
+}
+
+bool BlockPool::reserve(uint8_t count) {
+    if (count > _capacity) {
+        return false;
+    }
+
+    // Blocks are allocated outside the lock, the heap takes its own
+    while (true) {
+        portENTER_CRITICAL(&_mux);
+        bool reserved = _allocatedCount >= count;
+        portEXIT_CRITICAL(&_mux);
+        if (reserved) {
+            return true;
+        }
+
+        void* block = Memory::allocate(_blockSize, _placement);
+        if (!block) {
+            return false;
+        }
+
+        // Another task may have grown the pool in the meantime
+        portENTER_CRITICAL(&_mux);
+        if (_allocatedCount < _capacity) {
+            _blocks[_allocatedCount++] = block;
+            block = nullptr;
+        }
+        portEXIT_CRITICAL(&_mux);
+        if (block) {
+            Memory::release(block);
+            return _allocatedCount >= count;
+        }
+    }
+}
+
+void* BlockPool::acquire() {
+    void* block = take();
+    if (!block && _allocatedCount < _capacity && reserve(_allocatedCount + 1)) {
+        block = take();
+    }
+
+    if (!block) {
+        portENTER_CRITICAL(&_mux);
+        _failureCount++;
+        portEXIT_CRITICAL(&_mux);
+    }
+    return block;
+}
+
+bool BlockPool::release(void* block) {
+    if (!block) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&_mux);
+    for (int i = 0; i < _allocatedCount; i++) {
+        if (_blocks[i] == block) {
+            _inUseMask &= ~(1u << i);
+            portEXIT_CRITICAL(&_mux);
+            return true;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    return false;
+}
+
+const char* BlockPool::getName() const {
+    return _name;
+}
+
+size_t BlockPool::getBlockSize() const {
+    return _blockSize;
+}
+
+uint8_t BlockPool::getCapacity() const {
+    return _capacity;
+}
+
+uint8_t BlockPool::getAllocatedCount() const {
+    return _allocatedCount;
+}
+
+uint8_t BlockPool::getInUseCount() const {
+    return __builtin_popcount(_inUseMask);
+}
+
+uint8_t BlockPool::getHighWater() const {
+    return _highWater;
+}
+
+uint32_t BlockPool::getFailureCount() const {
+    return _failureCount;
+}
+
+BlockPool* BlockPool::first() {
+    return s_firstPool;
+}
+
+BlockPool* BlockPool::next() const {
+    return _next;
+}
+
+void* BlockPool::take() {
+    portENTER_CRITICAL(&_mux);
+    uint32_t allocatedMask = _allocatedCount >= 32 ? 0xFFFFFFFFu : (1u << _allocatedCount) - 1;
+    uint32_t freeMask = allocatedMask & ~_inUseMask;
+    void* block = nullptr;
+    if (freeMask != 0) {
+        int index = __builtin_ctz(freeMask);
+        _inUseMask |= 1u << index;
+        block = _blocks[index];
+
+        uint8_t inUse = __builtin_popcount(_inUseMask);
+        if (inUse > _highWater) {
+            _highWater = inUse;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    return block;
+}
+
+} // namespace Utils
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+// Most blocks a BlockPool can hold
+#define BLOCK_POOL_MAX_BLOCKS 32
+
+// Buffers whose size is remembered for the counters before IDF 5.1, whose heap can't report it
+#ifndef MEMORY_TRACKED_BUFFERS
+#define MEMORY_TRACKED_BUFFERS 128
+#endif
+
+namespace Utils {
+
+/**
+ * @brief Where a buffer has to live
+ */
+enum class MemoryPlacement : uint8_t {
+    Dma,        // Internal memory the SPI DMA can reach
+    Internal,   // Internal memory, fast but scarce
+    Psram,      // External SPI RAM only
+    PsramFirst  // External SPI RAM, internal memory when there is none left
+};
+
+/**
+ * @brief Allocation counters of one memory region
+ */
+struct MemoryStats {
+    size_t used;        // Bytes allocated now
+    size_t peak;        // Most bytes allocated at once since boot
+    uint32_t failures;  // Allocations that returned nullptr
+};
+
+/**
+ * @brief Allocation with an explicit placement and per-region accounting
+ *
+ * Every buffer the firmware keeps goes through here, so the internal and
+ * external usage and their high-water marks can be read back at any time.
+ * The counters are kept under a spinlock, allocate() and release() work
+ * from any task but not from an ISR.
+ *
+ * Usage example:
+ * uint8_t* frame = (uint8_t*)Memory::allocate(length, MemoryPlacement::PsramFirst);
+ * ...
+ * Memory::release(frame);
+ */
+class Memory {
+public:
+    /**
+     * @brief Allocate a buffer
+     * @param size Size in bytes
+     * @param placement Where the buffer has to live
+     * @return Pointer to the buffer, nullptr if there is no room
+     */
+    static void* allocate(size_t size, MemoryPlacement placement);
+
+    /**
+     * @brief Resize a buffer, keeping its content
+     * The buffer may move to another region if the placement allows it
+     * @param pointer Buffer from allocate(), or nullptr
+     * @param size New size in bytes
+     * @param placement Where the buffer has to live
+     * @return Pointer to the buffer, nullptr if there is no room and the old buffer is kept
+     */
+    static void* reallocate(void* pointer, size_t size, MemoryPlacement placement);
+
+    /**
+     * @brief Free a buffer from allocate(), reallocate() or adopt()
+     * @param pointer Buffer to free, nullptr is ignored
+     */
+    static void release(void* pointer);
+
+    /**
+     * @brief Count a buffer another library allocated with malloc()
+     * Afterwards it is freed with release() like any other buffer
+     * @param pointer Buffer to count, nullptr is ignored
+     * @param size Size of the buffer, only used where the heap can't report it
+     */
+    static void adopt(void* pointer, size_t size);
+
+    /**
+     * @brief Get the counters of internal memory
+     * @return Snapshot of the counters
+     */
+    static MemoryStats getInternalStats();
+
+    /**
+     * @brief Get the counters of external SPI RAM
+     * @return Snapshot of the counters
+     */
+    static MemoryStats getExternalStats();
+
+private:
+    // Add or remove a buffer from the counters, returns the size it was counted with
+    static size_t count(void* pointer, size_t size, bool allocated);
+};
+
+/**
+ * @brief Pool of fixed-size blocks of one size class
+ *
+ * Blocks are allocated one at a time with the pool's placement, not as one
+ * large region, so they fit a fragmented heap. The pool only grows when no
+ * free block is left, up to its capacity, and keeps its blocks until it is
+ * destroyed. acquire() and release() take a spinlock and work from any task.
+ *
+ * Every pool is listed from first(), so its fill level and high-water mark
+ * can be reported without knowing who owns it.
+ *
+ * Usage example:
+ * BlockPool pool("frame", 64 * 1024, 3, MemoryPlacement::Psram);
+ * uint8_t* block = (uint8_t*)pool.acquire();
+ * ...
+ * pool.release(block);
+ */
+class BlockPool {
+public:
+    /**
+     * @brief Constructor
+     * Nothing is allocated until reserve() or acquire()
+     * @param name Name in reports, must stay valid (e.g. a string literal)
+     * @param blockSize Size of every block in bytes
+     * @param capacity Most blocks the pool holds, up to BLOCK_POOL_MAX_BLOCKS
+     * @param placement Where the blocks live
+     */
+    BlockPool(const char* name, size_t blockSize, uint8_t capacity, MemoryPlacement placement);
+
+    /**
+     * @brief Destructor
+     * Frees every block, blocks still acquired must not be used afterwards
+     */
+    ~BlockPool();
+
+    /**
+     * @brief Allocate blocks up front
+     * @param count Blocks the pool should hold at least
+     * @return true if the pool holds that many blocks
+     */
+    bool reserve(uint8_t count);
+
+    /**
+     * @brief Take a free block, growing the pool when none is free
+     * @return Pointer to the block, nullptr if every block is in use
+     */
+    void* acquire();
+
+    /**
+     * @brief Give a block back
+     * @param block Block to give back
+     * @return true if the block belongs to this pool, false leaves it untouched
+     */
+    bool release(void* block);
+
+    /**
+     * @brief Get the name of the pool
+     * @return Name given to the constructor
+     */
+    const char* getName() const;
+
+    /**
+     * @brief Get the size of a block
+     * @return Block size in bytes
+     */
+    size_t getBlockSize() const;
+
+    /**
+     * @brief Get the most blocks the pool holds
+     * @return Capacity in blocks
+     */
+    uint8_t getCapacity() const;
+
+    /**
+     * @brief Get the number of blocks allocated so far
+     * @return Blocks held, free or in use
+     */
+    uint8_t getAllocatedCount() const;
+
+    /**
+     * @brief Get the number of blocks in use
+     * @return Blocks acquired and not released
+     */
+    uint8_t getInUseCount() const;
+
+    /**
+     * @brief Get the most blocks in use at once
+     * @return High-water mark since construction
+     */
+    uint8_t getHighWater() const;
+
+    /**
+     * @brief Get the number of acquire() calls that found no block
+     * @return Failed acquisitions since construction
+     */
+    uint32_t getFailureCount() const;
+
+    /**
+     * @brief Get the first pool of the list of all pools
+     * @return First pool, nullptr if there is none
+     */
+    static BlockPool* first();
+
+    /**
+     * @brief Get the next pool of the list of all pools
+     * @return Next pool, nullptr after the last one
+     */
+    BlockPool* next() const;
+
+private:
+    const char* _name;
+    size_t _blockSize;
+    uint8_t _capacity;
+    MemoryPlacement _placement;
+    void* _blocks[BLOCK_POOL_MAX_BLOCKS];
+    uint8_t _allocatedCount;
+    uint32_t _inUseMask;      // Bit n set while _blocks[n] is acquired
+    uint8_t _highWater;
+    uint32_t _failureCount;
+    BlockPool* _next;
+    portMUX_TYPE _mux;
+
+    // Mark a free block as in use, nullptr if there is none
+    void* take();
+
+    // Copying would free the blocks twice
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+};
+
+} // namespace Utils
@@ -2,6 +2,7 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "Memory.h"
 
 namespace Utils {
 
@@ -22,7 +23,7 @@ struct SpiRamAllocator : ArduinoJson::Allocator {
      * @return Pointer to allocated memory
      */
     void* allocate(size_t size) override {
-        return heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        return Memory::allocate(size, MemoryPlacement::Psram);
     }
 
     /**
@@ -30,7 +31,7 @@ struct SpiRamAllocator : ArduinoJson::Allocator {
      * @param pointer Pointer to memory to free
      */
     void deallocate(void* pointer) override {
-        heap_caps_free(pointer);
+        Memory::release(pointer);
     }
 
     /**
@@ -40,7 +41,7 @@ struct SpiRamAllocator : ArduinoJson::Allocator {
      * @return Pointer to reallocated memory
      */
     void* reallocate(void* ptr, size_t new_size) override {
-        return heap_caps_realloc(ptr, new_size, MALLOC_CAP_SPIRAM);
+        return Memory::reallocate(ptr, new_size, MemoryPlacement::Psram);
     }
 
     /**
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+namespace Utils {
+
+/**
+ * @brief Wait-free single-producer/single-consumer queue
+ *
+ * Fixed-capacity ring that hands small items (indices, descriptors) from one
+ * context to another without locks or heap allocation. The producer side is
+ * safe to use from an ISR.
+ *
+ * Usage example:
+ * SpscQueue<uint8_t, 8> queue;
+ * queue.push(3);          // Producer (e.g. ISR)
+ * uint8_t index;
+ * queue.pop(index);       // Consumer (e.g. task)
+ *
+ * @tparam T Item type, should be cheap to copy
+ * @tparam Capacity Number of items, must be a power of two
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    /**
+     * @brief Add an item, producer side only
+     * @param item Item to add
+     * @return true if added, false if the queue is full
+     */
+    bool push(const T& item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        _items[head & (Capacity - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item, consumer side only
+     * @param item Reference to store the item
+     * @return true if an item was removed, false if the queue is empty
+     */
+    bool pop(T& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        item = _items[tail & (Capacity - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get the number of queued items
+     * @return Number of items, may be stale by the time it is used
+     */
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Check if the queue is empty
+     * @return true if empty
+     */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * @brief Drop all items
+     * Only call while neither the producer nor the consumer is running
+     */
+    void reset() {
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the capacity of the queue
+     * @return Maximum number of items
+     */
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+
+private:
+    std::atomic<size_t> _head;  // Written by the producer
+    std::atomic<size_t> _tail;  // Written by the consumer
+    T _items[Capacity];
+};
+
+} // namespace Utils
@@ -1,24 +1,74 @@
 #include "Sstring.h"
 #include <string.h>
 #include <stdlib.h>
+#include "Memory.h"
 
 namespace Utils {
 
-Sstring::Sstring() : buffer(nullptr), capacity(0), len(0) {
+namespace {
+
+// External SPI RAM first, internal memory when there is none left
+char* allocateChars(size_t size) {
+    return static_cast<char*>(Memory::allocate(size, MemoryPlacement::PsramFirst));
 }
 
-Sstring::~Sstring() {
-    if (buffer) {
-        heap_caps_free(buffer);
+} // namespace
+
+SstringArena::SstringArena(size_t size) : _block(allocateChars(size)), _size(0), _used(0) {
+    if (_block) {
+        _size = size;
     }
 }
 
-void Sstring::setBuffer(char* buf, size_t cap) {
-    if (buffer) {
-        heap_caps_free(buffer);
+SstringArena::~SstringArena() {
+    if (_block) {
+        Memory::release(_block);
     }
-    buffer = buf;
-    capacity = cap;
+}
+
+char* SstringArena::allocate(size_t size) {
+    // Keep every allocation 4-byte aligned, memcpy is faster on aligned PSRAM
+    size_t aligned = (size + 3) & ~(size_t)3;
+    if (!_block || aligned > _size - _used) {
+        return nullptr;
+    }
+    char* ptr = _block + _used;
+    _used += aligned;
+    return ptr;
+}
+
+void SstringArena::reset() {
+    _used = 0;
+}
+
+size_t SstringArena::used() const {
+    return _used;
+}
+
+size_t SstringArena::capacity() const {
+    return _size;
+}
+
+Sstring::Sstring() {
+}
+
+Sstring::Sstring(SstringArena& arena) : arena(&arena) {
+}
+
+Sstring::~Sstring() {
+    releaseBuffer();
+}
+
+bool Sstring::ownsBuffer() const {
+    return buffer != inlineBuffer && !arena;
+}
+
+void Sstring::releaseBuffer() {
+    if (ownsBuffer()) {
+        Memory::release(buffer);
+    }
+    buffer = inlineBuffer;
+    capacity = SSTRING_INLINE_CAPACITY;
 }
 
 bool Sstring::ensureCapacity(size_t minCap) {
@@ -33,172 +83,158 @@ bool Sstring::ensureCapacity(size_t minCap) {
         newCap = minCap;
     }
     
-    // Allocate new buffer
-    char* newBuf = static_cast<char*>(heap_caps_malloc(newCap + 1, MALLOC_CAP_SPIRAM));
+    // Allocate new buffer, from the arena while it has room
+    char* newBuf = arena ? arena->allocate(newCap + 1) : nullptr;
+    bool fromArena = newBuf != nullptr;
     if (!newBuf) {
-        newBuf = static_cast<char*>(heap_caps_malloc(newCap + 1, MALLOC_CAP_INTERNAL));
+        newBuf = allocateChars(newCap + 1);
     }
     if (!newBuf) {
-        newBuf = static_cast<char*>(heap_caps_malloc(newCap + 1, MALLOC_CAP_DEFAULT));
+        return false;
     }
     
     // Copy existing content if any
-    if (buffer && len > 0) {
+    if (len > 0) {
         memcpy(newBuf, buffer, len);
     }
     
     // Add null terminator
     newBuf[len] = '\0';
     
-    // Set new buffer and capacity
-    setBuffer(newBuf, newCap);
+    // Set new buffer and capacity, a full arena leaves this string on the heap
+    releaseBuffer();
+    if (!fromArena) {
+        arena = nullptr;
+    }
+    buffer = newBuf;
+    capacity = newCap;
     return true;
 }
 
-Sstring::Sstring(const Sstring& other) : buffer(nullptr), capacity(0), len(0) {
-    if (other.len > 0) {
-        if (ensureCapacity(other.len)) {
-            memcpy(buffer, other.buffer, other.len);
-            len = other.len;
-            buffer[len] = '\0';
-        }
-    }
+Sstring::Sstring(const Sstring& other) {
+    append(other.buffer, other.len);
 }
 
 Sstring& Sstring::operator=(const Sstring& other) {
     if (this != &other) {
         clear();
-        if (other.len > 0) {
-            if (ensureCapacity(other.len)) {
-                memcpy(buffer, other.buffer, other.len);
-                len = other.len;
-                buffer[len] = '\0';
-            }
-        }
+        append(other.buffer, other.len);
     }
     return *this;
 }
 
-Sstring::Sstring(Sstring&& other) noexcept : buffer(other.buffer), capacity(other.capacity), len(other.len) {
-    other.buffer = nullptr;
-    other.capacity = 0;
-    other.len = 0;
+Sstring::Sstring(Sstring&& other) noexcept {
+    *this = static_cast<Sstring&&>(other);
 }
 
 Sstring& Sstring::operator=(Sstring&& other) noexcept {
     if (this != &other) {
-        setBuffer(other.buffer, other.capacity);
-        len = other.len;
-        other.buffer = nullptr;
-        other.capacity = 0;
+        if (other.buffer == other.inlineBuffer) {
+            // Nothing to steal, the characters fit inline here as well
+            clear();
+            append(other.buffer, other.len);
+        } else {
+            releaseBuffer();
+            buffer = other.buffer;
+            capacity = other.capacity;
+            len = other.len;
+            arena = other.arena;
+            other.buffer = other.inlineBuffer;
+            other.capacity = SSTRING_INLINE_CAPACITY;
+        }
         other.len = 0;
+        other.buffer[0] = '\0';
     }
     return *this;
 }
 
-Sstring::Sstring(char value) : buffer(nullptr), capacity(0), len(0) {
-    if (ensureCapacity(1)) {
-        buffer[0] = value;
-        buffer[1] = '\0';
-        len = 1;
-    }
+Sstring::Sstring(char value) {
+    append(value);
 }
 
-Sstring::Sstring(char* value) : buffer(nullptr), capacity(0), len(0) {
-    if (value) {
-        size_t valueLen = strlen(value);
-        if (valueLen > 0 && ensureCapacity(valueLen)) {
-            memcpy(buffer, value, valueLen);
-            len = valueLen;
-            buffer[len] = '\0';
-        }
-    }
+Sstring::Sstring(char* value) {
+    append(value);
 }
 
-Sstring::Sstring(const char* value) : buffer(nullptr), capacity(0), len(0) {
-    if (value) {
-        size_t valueLen = strlen(value);
-        if (valueLen > 0 && ensureCapacity(valueLen)) {
-            memcpy(buffer, value, valueLen);
-            len = valueLen;
-            buffer[len] = '\0';
-        }
-    }
+Sstring::Sstring(const char* value) {
+    append(value);
 }
 
-Sstring::Sstring(String& value) : buffer(nullptr), capacity(0), len(0) {
-    size_t valueLen = value.length();
-    if (valueLen > 0 && ensureCapacity(valueLen)) {
-        memcpy(buffer, value.c_str(), valueLen);
-        len = valueLen;
-        buffer[len] = '\0';
-    }
+Sstring::Sstring(String& value) {
+    append(value.c_str(), value.length());
 }
 
-Sstring::Sstring(const String& value) : buffer(nullptr), capacity(0), len(0) {
-    size_t valueLen = value.length();
-    if (valueLen > 0 && ensureCapacity(valueLen)) {
-        memcpy(buffer, value.c_str(), valueLen);
-        len = valueLen;
-        buffer[len] = '\0';
-    }
+Sstring::Sstring(const String& value) {
+    append(value.c_str(), value.length());
+}
+
+Sstring::Sstring(SstringView value) {
+    append(value.data(), value.length());
 }
 
-Sstring::Sstring(int value, unsigned char base) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(int value, unsigned char base) {
     char buf[34]; // Max 33 chars for base 2 + null terminator
     ltoa(value, buf, base);
-    *this = Sstring(buf);
+    append(buf);
 }
 
-Sstring::Sstring(unsigned int value, unsigned char base) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(unsigned int value, unsigned char base) {
     char buf[34]; // Max 33 chars for base 2 + null terminator
     ultoa(value, buf, base);
-    *this = Sstring(buf);
+    append(buf);
 }
 
-Sstring::Sstring(long value, unsigned char base) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(long value, unsigned char base) {
     char buf[34]; // Max 33 chars for base 2 + null terminator
     ltoa(value, buf, base);
-    *this = Sstring(buf);
+    append(buf);
 }
 
-Sstring::Sstring(unsigned long value, unsigned char base) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(unsigned long value, unsigned char base) {
     char buf[34]; // Max 33 chars for base 2 + null terminator
     ultoa(value, buf, base);
-    *this = Sstring(buf);
+    append(buf);
 }
 
-Sstring::Sstring(float value, unsigned char decimals) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(float value, unsigned char decimals) {
     char buf[33];
     dtostrf(value, (decimals + 2), decimals, buf);
-    *this = Sstring(buf);
+    append(buf);
 }
 
-Sstring::Sstring(double value, unsigned char decimals) : buffer(nullptr), capacity(0), len(0) {
+Sstring::Sstring(double value, unsigned char decimals) {
     char buf[33];
     dtostrf(value, (decimals + 2), decimals, buf);
-    *this = Sstring(buf);
+    append(buf);
 }
 
 void Sstring::clear() {
-    if (buffer) {
-        buffer[0] = '\0';
-    }
+    buffer[0] = '\0';
     len = 0;
 }
 
 bool Sstring::append(const char* str) {
     if (!str) return false;
+    return append(str, strlen(str));
+}
+
+bool Sstring::append(const char* str, size_t length) {
+    if (length == 0) return true;
+    if (!str) return false;
     
-    size_t strLen = strlen(str);
-    if (strLen == 0) return true;
+    // str may point into this string, find it again after the buffer moved
+    bool isSelf = str >= buffer && str < buffer + len;
+    size_t selfOffset = isSelf ? str - buffer : 0;
     
-    size_t newLen = len + strLen;
+    size_t newLen = len + length;
     if (!ensureCapacity(newLen)) {
         return false;
     }
+    if (isSelf) {
+        str = buffer + selfOffset;
+    }
     
-    memcpy(buffer + len, str, strLen);
+    memcpy(buffer + len, str, length);
     len = newLen;
     buffer[len] = '\0';
     return true;
@@ -215,12 +251,28 @@ bool Sstring::append(char c) {
     return true;
 }
 
+bool Sstring::append(SstringView str) {
+    return append(str.data(), str.length());
+}
+
 void Sstring::reserve(size_t minCap) {
     ensureCapacity(minCap);
 }
 
 const char* Sstring::c_str() const {
-    return buffer ? buffer : "";
+    return buffer;
+}
+
+SstringView Sstring::view() const {
+    return SstringView(buffer, len);
+}
+
+SstringView Sstring::view(size_t start, size_t count) const {
+    return view().substring(start, count);
+}
+
+Sstring::operator SstringView() const {
+    return view();
 }
 
 String Sstring::toString() const {
@@ -232,7 +284,7 @@ const char* Sstring::toChar() const {
 }
 
 int Sstring::toInt() {
-    return buffer ? atoi(buffer) : 0;
+    return atoi(buffer);
 }
 
 size_t Sstring::size() const {
@@ -247,37 +299,66 @@ bool Sstring::isEmpty() {
     return (len == 0);
 }
 
-Sstring Sstring::operator+(const Sstring& rhs) const {
-    Sstring result(*this);
-    result.append(rhs.c_str());
+Sstring Sstring::operator+(const Sstring& rhs) const & {
+    Sstring result;
+    result.reserve(len + rhs.len);
+    result.append(buffer, len);
+    result.append(rhs.buffer, rhs.len);
     return result;
 }
 
-Sstring Sstring::operator+(const String& rhs) const {
-    Sstring result(*this);
-    result.append(rhs.c_str());
+Sstring Sstring::operator+(const Sstring& rhs) && {
+    append(rhs.buffer, rhs.len);
+    return static_cast<Sstring&&>(*this);
+}
+
+Sstring Sstring::operator+(const String& rhs) const & {
+    Sstring result;
+    result.reserve(len + rhs.length());
+    result.append(buffer, len);
+    result.append(rhs.c_str(), rhs.length());
     return result;
 }
 
-Sstring Sstring::operator+(const char* rhs) const {
-    Sstring result(*this);
-    result.append(rhs);
+Sstring Sstring::operator+(const String& rhs) && {
+    append(rhs.c_str(), rhs.length());
+    return static_cast<Sstring&&>(*this);
+}
+
+Sstring Sstring::operator+(const char* rhs) const & {
+    size_t rhsLen = rhs ? strlen(rhs) : 0;
+    Sstring result;
+    result.reserve(len + rhsLen);
+    result.append(buffer, len);
+    result.append(rhs, rhsLen);
     return result;
 }
 
-Sstring Sstring::operator+(char rhs) const {
-    Sstring result(*this);
+Sstring Sstring::operator+(const char* rhs) && {
+    append(rhs);
+    return static_cast<Sstring&&>(*this);
+}
+
+Sstring Sstring::operator+(char rhs) const & {
+    Sstring result;
+    result.reserve(len + 1);
+    result.append(buffer, len);
     result.append(rhs);
     return result;
 }
 
+Sstring Sstring::operator+(char rhs) && {
+    append(rhs);
+    return static_cast<Sstring&&>(*this);
+}
+
 Sstring& Sstring::operator+=(const Sstring& rhs) {
-    append(rhs.c_str());
+    append(rhs.buffer, rhs.len);
     return *this;
 }
 
 Sstring& Sstring::operator+=(const String& rhs) {
-    append(rhs.c_str());
+    append(rhs.c_str(), rhs.length());
     return *this;
 }
 
@@ -291,10 +372,14 @@ Sstring& Sstring::operator+=(char rhs) {
     return *this;
 }
 
+Sstring& Sstring::operator+=(SstringView rhs) {
+    append(rhs.data(), rhs.length());
+    return *this;
+}
+
 bool Sstring::operator==(const Sstring& rhs) const {
     if (len != rhs.len) return false;
-    if (len == 0) return true;
-    return (strcmp(c_str(), rhs.c_str()) == 0);
+    return (memcmp(buffer, rhs.buffer, len) == 0);
 }
 
 bool Sstring::operator==(const char* rhs) const {
@@ -307,8 +392,8 @@ bool Sstring::contains(const char* substr) const {
     return (strstr(buffer, substr) != nullptr);
 }
 
-bool Sstring::contains(const Sstring& substr) const {
-    return contains(substr.c_str());
+bool Sstring::contains(SstringView substr) const {
+    return view().contains(substr);
 }
 
 bool Sstring::equals(const char* other) const {
@@ -326,8 +411,8 @@ bool Sstring::startsWith(const char* prefix) const {
     return (strncmp(buffer, prefix, prefixLen) == 0);
 }
 
-bool Sstring::startsWith(const Sstring& prefix) const {
-    return startsWith(prefix.c_str());
+bool Sstring::startsWith(SstringView prefix) const {
+    return view().startsWith(prefix);
 }
 
 int Sstring::indexOf(const char* substr, size_t startPos) const {
@@ -337,8 +422,8 @@ int Sstring::indexOf(const char* substr, size_t startPos) const {
     return (found - buffer);
 }
 
-int Sstring::indexOf(const Sstring& substr, size_t startPos) const {
-    return indexOf(substr.c_str(), startPos);
+int Sstring::indexOf(SstringView substr, size_t startPos) const {
+    return view().indexOf(substr, startPos);
 }
 
 int Sstring::indexOf(char ch, size_t startPos) const {
@@ -348,137 +433,47 @@ int Sstring::indexOf(char ch, size_t startPos) const {
     return (found - buffer);
 }
 
-void Sstring::replace(Sstring src, Sstring dest) {
-    if (len == 0 || src.len == 0) return;
-
-    const char* srcStr = src.c_str();
-    const char* destStr = dest.c_str();
-    size_t srcLen = src.len;
-    size_t destLen = dest.len;
+void Sstring::replace(SstringView src, SstringView dest) {
+    if (len == 0 || src.length() == 0) return;
 
     // Find the first occurrence
-    const char* found = strstr(buffer, srcStr);
-    if (!found) return;
+    SstringView text = view();
+    int found = text.indexOf(src);
+    if (found < 0) return;
 
-    // Create a new buffer for the result
-    size_t resultLen = len + 100; // Start with some extra space
-    char* result = static_cast<char*>(heap_caps_malloc(resultLen + 1, MALLOC_CAP_SPIRAM));
-    if (!result) return;
+    // Build the result next to this string, then take over its buffer,
+    // src and dest stay valid until then even if they point in here
+    Sstring result;
+    result.arena = arena;
+    result.reserve(len);
 
     size_t pos = 0;
-    size_t copiedPos = 0;
-
-    while (found) {
-        size_t foundPos = found - buffer;
-        size_t needLen = copiedPos + (foundPos - pos) + destLen;
-
-        // Ensure we have enough space
-        if (needLen > resultLen) {
-            resultLen = needLen + 100; // Add some extra space
-            char* newResult = static_cast<char*>(heap_caps_realloc(result, resultLen + 1, MALLOC_CAP_SPIRAM));
-            if (!newResult) {
-                heap_caps_free(result);
-                return;
-            }
-            result = newResult;
+    while (found >= 0) {
+        // Copy part before the found substring, then the replacement
+        if (!result.append(buffer + pos, found - pos) || !result.append(dest)) {
+            return;
         }
 
-        // Copy part before the found substring
-        if (foundPos > pos) {
-            memcpy(result + copiedPos, buffer + pos, foundPos - pos);
-            copiedPos += (foundPos - pos);
-        }
-
-        // Copy the replacement
-        memcpy(result + copiedPos, destStr, destLen);
-        copiedPos += destLen;
-
-        // Move past this occurrence
-        pos = foundPos + srcLen;
-
-        // Look for the next occurrence
-        found = strstr(buffer + pos, srcStr);
+        // Move past this occurrence, then look for the next one
+        pos = found + src.length();
+        found = text.indexOf(src, pos);
     }
 
     // Copy the rest of the string
-    if (pos < len) {
-        size_t restLen = len - pos;
-        size_t needLen = copiedPos + restLen;
-
-        // Ensure we have enough space for the rest
-        if (needLen > resultLen) {
-            resultLen = needLen;
-            char* newResult = static_cast<char*>(heap_caps_realloc(result, resultLen + 1, MALLOC_CAP_SPIRAM));
-            if (!newResult) {
-                heap_caps_free(result);
-                return;
-            }
-            result = newResult;
-        }
-
-        memcpy(result + copiedPos, buffer + pos, restLen);
-        copiedPos += restLen;
+    if (!result.append(buffer + pos, len - pos)) {
+        return;
     }
 
-    // Null terminate the result
-    result[copiedPos] = '\0';
-
-    // Replace our buffer with the new one
-    setBuffer(result, resultLen);
-    len = copiedPos;
+    *this = static_cast<Sstring&&>(result);
 }
 
 Sstring Sstring::substring(size_t start, size_t count) const {
-    if (!buffer || start >= len) {
-        return Sstring();
-    }
-
-    // Adjust count if necessary
-    if (count > len - start || count == SIZE_MAX) {
-        count = len - start;
-    }
-
-    // Create a new buffer for the substring
-    char* newBuf = static_cast<char*>(heap_caps_malloc(count + 1, MALLOC_CAP_SPIRAM));
-    if (!newBuf) {
-        return Sstring();
-    }
-
-    // Copy the substring
-    memcpy(newBuf, buffer + start, count);
-    newBuf[count] = '\0';
-
-    // Create a new Sstring with the substring
-    Sstring result;
-    result.setBuffer(newBuf, count);
-    result.len = count;
-    return result;
+    // Short substrings stay inline
+    return Sstring(view(start, count));
 }
 
 Sstring Sstring::trim() const {
-    if (!buffer || len == 0) {
-        return Sstring();
-    }
-
-    // Find the first non-whitespace character
-    size_t start = 0;
-    while (start < len && isspace(buffer[start])) {
-        start++;
-    }
-
-    // If the string is all whitespace, return an empty string
-    if (start == len) {
-        return Sstring();
-    }
-
-    // Find the last non-whitespace character
-    size_t end = len - 1;
-    while (end > start && isspace(buffer[end])) {
-        end--;
-    }
-
-    // Return the trimmed substring
-    return substring(start, end - start + 1);
+    return Sstring(view().trim());
 }
 
 float Sstring::toFloat() const {
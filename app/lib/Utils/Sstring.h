@@ -2,27 +2,103 @@
 
 #include <Arduino.h>
 #include <esp_heap_caps.h>
+#include "SstringView.h"
+
+// Characters stored inside the object, longer strings go to the heap
+#ifndef SSTRING_INLINE_CAPACITY
+#define SSTRING_INLINE_CAPACITY 23
+#endif
 
 namespace Utils {
 
+/**
+ * @brief Bump allocator for batches of temporary strings
+ *
+ * One block is allocated up front, from external SPI RAM when available, and
+ * handed out front to back. Nothing is freed individually: reset() drops
+ * everything at once, so strings using the arena must not outlive the reset.
+ *
+ * Usage example:
+ * SstringArena arena(1024);
+ * Sstring path(arena);
+ * path += dir;
+ * path += "/";
+ * path += name;
+ * ...
+ * arena.reset();
+ */
+class SstringArena {
+public:
+    /**
+     * @brief Allocate the arena block
+     * @param size Size of the block in bytes
+     */
+    explicit SstringArena(size_t size);
+
+    /**
+     * @brief Free the arena block
+     */
+    ~SstringArena();
+
+    SstringArena(const SstringArena&) = delete;
+    SstringArena& operator=(const SstringArena&) = delete;
+
+    /**
+     * @brief Take bytes from the arena
+     * @param size Number of bytes
+     * @return Pointer to the bytes, or nullptr if the arena is full
+     */
+    char* allocate(size_t size);
+
+    /**
+     * @brief Give all bytes back at once
+     */
+    void reset();
+
+    /**
+     * @brief Get the number of bytes handed out since the last reset
+     * @return Used bytes
+     */
+    size_t used() const;
+
+    /**
+     * @brief Get the size of the arena block
+     * @return Size in bytes, 0 if the block could not be allocated
+     */
+    size_t capacity() const;
+
+private:
+    char* _block;
+    size_t _size;
+    size_t _used;
+};
+
 /**
  * @brief A string class that uses ESP32's external SPI RAM
  * 
  * This class provides string functionality similar to Arduino's String class
  * but allocates memory from external SPI RAM, preserving internal memory.
+ * Strings up to SSTRING_INLINE_CAPACITY characters are kept inside the object
+ * and need no allocation at all.
  */
 class Sstring {
 private:
-    char* buffer;
-    size_t capacity;
-    size_t len;
+    char inlineBuffer[SSTRING_INLINE_CAPACITY + 1] = {0};
+    char* buffer = inlineBuffer;
+    size_t capacity = SSTRING_INLINE_CAPACITY;
+    size_t len = 0;
+    SstringArena* arena = nullptr;  // Grows into the arena instead of the heap when set
+
+    /**
+     * @brief Check if the buffer was allocated from the heap
+     * @return true if the buffer has to be freed
+     */
+    bool ownsBuffer() const;
 
     /**
-     * @brief Set buffer pointer and capacity
-     * @param buf Buffer pointer
-     * @param cap Capacity
+     * @brief Free a heap buffer and go back to the inline buffer
      */
-    void setBuffer(char* buf, size_t cap);
+    void releaseBuffer();
 
     /**
      * @brief Ensure buffer has sufficient capacity
@@ -37,6 +113,13 @@ public:
      */
     Sstring();
 
+    /**
+     * @brief Construct an empty string that grows into an arena
+     * Falls back to the heap once the arena is full
+     * @param arena Arena to allocate from, must outlive the string
+     */
+    explicit Sstring(SstringArena& arena);
+
     /**
      * @brief Copy constructor
      * @param other String to copy
@@ -100,6 +183,12 @@ public:
      */
     Sstring(const String& value);
 
+    /**
+     * @brief Construct a copy of a view
+     * @param value Characters to copy
+     */
+    explicit Sstring(SstringView value);
+
     /**
      * @brief Construct from an integer
      * @param value Integer value
@@ -161,6 +250,21 @@ public:
      */
     bool append(char c);
 
+    /**
+     * @brief Append a number of characters
+     * @param str Characters to append, need not be null-terminated
+     * @param length Number of characters
+     * @return true if successful
+     */
+    bool append(const char* str, size_t length);
+
+    /**
+     * @brief Append the characters of a view
+     * @param str View to append
+     * @return true if successful
+     */
+    bool append(SstringView str);
+
     /**
      * @brief Reserve memory for string
      * @param minCap Minimum capacity to reserve
@@ -173,6 +277,26 @@ public:
      */
     const char* c_str() const;
 
+    /**
+     * @brief View the whole string without copying
+     * Invalidated by anything that changes the string
+     * @return View of the characters
+     */
+    SstringView view() const;
+
+    /**
+     * @brief View part of the string without copying
+     * @param start Start position
+     * @param count Length of the view (default: remainder)
+     * @return View of the substring
+     */
+    SstringView view(size_t start, size_t count = SIZE_MAX) const;
+
+    /**
+     * @brief Views convert implicitly, so Sstring can be passed wherever a SstringView is taken
+     */
+    operator SstringView() const;
+
     /**
      * @brief Convert to Arduino String
      * @return Arduino String
@@ -210,34 +334,39 @@ public:
     bool isEmpty();
 
     // Operator overloads for concatenation
+    // On a temporary left-hand side (a + b + c) the result takes over its buffer
     
     /**
      * @brief Concatenate with another Sstring
      * @param rhs String to add
      * @return New concatenated string
      */
-    Sstring operator+(const Sstring& rhs) const;
+    Sstring operator+(const Sstring& rhs) const &;
+    Sstring operator+(const Sstring& rhs) &&;
 
     /**
      * @brief Concatenate with Arduino String
      * @param rhs String to add
      * @return New concatenated string
      */
-    Sstring operator+(const String& rhs) const;
+    Sstring operator+(const String& rhs) const &;
+    Sstring operator+(const String& rhs) &&;
 
     /**
      * @brief Concatenate with C-string
      * @param rhs String to add
      * @return New concatenated string
      */
-    Sstring operator+(const char* rhs) const;
+    Sstring operator+(const char* rhs) const &;
+    Sstring operator+(const char* rhs) &&;
 
     /**
      * @brief Concatenate with character
      * @param rhs Character to add
      * @return New concatenated string
      */
-    Sstring operator+(char rhs) const;
+    Sstring operator+(char rhs) const &;
+    Sstring operator+(char rhs) &&;
 
     /**
      * @brief Append another Sstring
@@ -267,6 +396,13 @@ public:
      */
     Sstring& operator+=(char rhs);
 
+    /**
+     * @brief Append the characters of a view
+     * @param rhs View to append
+     * @return Reference to this string
+     */
+    Sstring& operator+=(SstringView rhs);
+
     // Comparison operators
     
     /**
@@ -295,7 +431,7 @@ public:
      * @param substr Substring to check
      * @return true if contains
      */
-    bool contains(const Sstring& substr) const;
+    bool contains(SstringView substr) const;
 
     /**
      * @brief Compare with another string
@@ -323,7 +459,7 @@ public:
      * @param prefix Prefix to check
      * @return true if starts with prefix
      */
-    bool startsWith(const Sstring& prefix) const;
+    bool startsWith(SstringView prefix) const;
 
     /**
      * @brief Find position of substring
@@ -339,7 +475,7 @@ public:
      * @param startPos Start position for search
      * @return Position or -1 if not found
      */
-    int indexOf(const Sstring& substr, size_t startPos = 0) const;
+    int indexOf(SstringView substr, size_t startPos = 0) const;
 
     /**
      * @brief Find position of character
@@ -351,10 +487,10 @@ public:
 
     /**
      * @brief Replace occurrences of src with dest
-     * @param src String to replace
-     * @param dest Replacement string
+     * @param src String to replace, may point into this string
+     * @param dest Replacement string, may point into this string
      */
-    void replace(Sstring src, Sstring dest);
+    void replace(SstringView src, SstringView dest);
 
     /**
      * @brief Extract a substring
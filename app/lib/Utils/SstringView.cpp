@@ -0,0 +1,157 @@
+#include "SstringView.h"
+#include <string.h>
+
+namespace Utils {
+
+SstringView::SstringView() : _data(""), _length(0) {
+}
+
+SstringView::SstringView(const char* str) : _data(str ? str : ""), _length(str ? strlen(str) : 0) {
+}
+
+SstringView::SstringView(const char* str, size_t length) : _data(str ? str : ""), _length(str ? length : 0) {
+}
+
+SstringView::SstringView(const String& str) : _data(str.c_str()), _length(str.length()) {
+}
+
+bool SstringView::equals(SstringView other) const {
+    return _length == other._length && memcmp(_data, other._data, _length) == 0;
+}
+
+bool SstringView::operator==(SstringView other) const {
+    return equals(other);
+}
+
+bool SstringView::operator!=(SstringView other) const {
+    return !equals(other);
+}
+
+int SstringView::compareTo(SstringView other) const {
+    int result = memcmp(_data, other._data, _length < other._length ? _length : other._length);
+    if (result != 0) {
+        return result;
+    }
+    return _length < other._length ? -1 : (_length > other._length ? 1 : 0);
+}
+
+bool SstringView::startsWith(SstringView prefix) const {
+    return _length >= prefix._length && memcmp(_data, prefix._data, prefix._length) == 0;
+}
+
+bool SstringView::endsWith(SstringView suffix) const {
+    return _length >= suffix._length &&
+           memcmp(_data + _length - suffix._length, suffix._data, suffix._length) == 0;
+}
+
+bool SstringView::contains(SstringView substr) const {
+    return indexOf(substr) >= 0;
+}
+
+int SstringView::indexOf(char ch, size_t startPos) const {
+    if (startPos >= _length) return -1;
+    const char* found = static_cast<const char*>(memchr(_data + startPos, ch, _length - startPos));
+    if (!found) return -1;
+    return (found - _data);
+}
+
+int SstringView::indexOf(SstringView substr, size_t startPos) const {
+    if (startPos > _length || substr._length > _length - startPos) return -1;
+    if (substr._length == 0) return startPos;
+
+    // Jump between occurrences of the first character instead of comparing at every position
+    size_t last = _length - substr._length;
+    size_t pos = startPos;
+    while (pos <= last) {
+        const char* found = static_cast<const char*>(memchr(_data + pos, substr._data[0], last - pos + 1));
+        if (!found) return -1;
+        pos = found - _data;
+        if (memcmp(found, substr._data, substr._length) == 0) {
+            return pos;
+        }
+        pos++;
+    }
+    return -1;
+}
+
+int SstringView::lastIndexOf(char ch) const {
+    for (size_t i = _length; i > 0; i--) {
+        if (_data[i - 1] == ch) {
+            return i - 1;
+        }
+    }
+    return -1;
+}
+
+SstringView SstringView::substring(size_t start, size_t count) const {
+    if (start >= _length) {
+        return SstringView();
+    }
+
+    // Adjust count if necessary
+    if (count > _length - start) {
+        count = _length - start;
+    }
+    return SstringView(_data + start, count);
+}
+
+SstringView SstringView::trim() const {
+    size_t start = 0;
+    size_t end = _length;
+    while (start < end && isspace((unsigned char)_data[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)_data[end - 1])) {
+        end--;
+    }
+    return SstringView(_data + start, end - start);
+}
+
+SstringView SstringView::split(char separator) {
+    int index = indexOf(separator);
+    if (index < 0) {
+        SstringView token = *this;
+        *this = SstringView(_data + _length, 0);
+        return token;
+    }
+
+    SstringView token(_data, index);
+    _data += index + 1;
+    _length -= index + 1;
+    return token;
+}
+
+long SstringView::toInt() const {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < _length && (_data[pos] == '-' || _data[pos] == '+')) {
+        negative = _data[pos] == '-';
+        pos++;
+    }
+
+    long value = 0;
+    while (pos < _length && _data[pos] >= '0' && _data[pos] <= '9') {
+        value = value * 10 + (_data[pos] - '0');
+        pos++;
+    }
+    return negative ? -value : value;
+}
+
+String SstringView::toString() const {
+    String result;
+    result.concat(_data, _length);
+    return result;
+}
+
+size_t SstringView::copyTo(char* buffer, size_t size) const {
+    if (!buffer || size == 0) {
+        return 0;
+    }
+
+    size_t count = _length < size - 1 ? _length : size - 1;
+    memcpy(buffer, _data, count);
+    buffer[count] = '\0';
+    return count;
+}
+
+} // namespace Utils
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Utils {
+
+/**
+ * @brief Non-owning view of a run of characters
+ *
+ * A pointer and a length into a string owned by someone else, e.g. a Sstring,
+ * an Arduino String or a received SPI buffer. Views are cheap to copy and none
+ * of the operations allocate, so tokens can be cut out of a payload without
+ * copying them. The characters need not be null-terminated, and the view must
+ * not outlive the string it points into.
+ *
+ * Usage example:
+ * SstringView path(file.path());
+ * SstringView name = path.substring(path.lastIndexOf('/') + 1);
+ * if (name.endsWith(".jpg")) { ... }
+ */
+class SstringView {
+public:
+    static const size_t npos = SIZE_MAX;
+
+    /**
+     * @brief Construct an empty view
+     */
+    SstringView();
+
+    /**
+     * @brief Construct a view of a null-terminated string
+     * @param str String to view, nullptr gives an empty view
+     */
+    SstringView(const char* str);
+
+    /**
+     * @brief Construct a view of a number of characters
+     * @param str Characters to view
+     * @param length Number of characters
+     */
+    SstringView(const char* str, size_t length);
+
+    /**
+     * @brief Construct a view of an Arduino String
+     * @param str String to view, must not be modified while the view is used
+     */
+    SstringView(const String& str);
+
+    /**
+     * @brief Get the first character
+     * @return Pointer to the characters, not necessarily null-terminated
+     */
+    const char* data() const { return _data; }
+
+    /**
+     * @brief Get the number of characters
+     * @return Length of the view
+     */
+    size_t length() const { return _length; }
+
+    /**
+     * @brief Alias for length()
+     * @return Length of the view
+     */
+    size_t size() const { return _length; }
+
+    /**
+     * @brief Check if the view is empty
+     * @return true if empty
+     */
+    bool isEmpty() const { return _length == 0; }
+
+    /**
+     * @brief Get a character
+     * @param index Position of the character, must be less than length()
+     * @return The character
+     */
+    char operator[](size_t index) const { return _data[index]; }
+
+    /**
+     * @brief Compare with another view
+     * @param other View to compare
+     * @return true if both hold the same characters
+     */
+    bool equals(SstringView other) const;
+    bool operator==(SstringView other) const;
+    bool operator!=(SstringView other) const;
+
+    /**
+     * @brief Order two views like strcmp
+     * @param other View to compare
+     * @return Negative, zero or positive
+     */
+    int compareTo(SstringView other) const;
+
+    /**
+     * @brief Check if the view starts with prefix
+     * @param prefix Prefix to check
+     * @return true if starts with prefix
+     */
+    bool startsWith(SstringView prefix) const;
+
+    /**
+     * @brief Check if the view ends with suffix
+     * @param suffix Suffix to check
+     * @return true if ends with suffix
+     */
+    bool endsWith(SstringView suffix) const;
+
+    /**
+     * @brief Check if the view contains a substring
+     * @param substr Substring to check
+     * @return true if contains
+     */
+    bool contains(SstringView substr) const;
+
+    /**
+     * @brief Find position of character
+     * @param ch Character to find
+     * @param startPos Start position for search
+     * @return Position or -1 if not found
+     */
+    int indexOf(char ch, size_t startPos = 0) const;
+
+    /**
+     * @brief Find position of substring
+     * @param substr Substring to find
+     * @param startPos Start position for search
+     * @return Position or -1 if not found
+     */
+    int indexOf(SstringView substr, size_t startPos = 0) const;
+
+    /**
+     * @brief Find the last position of character
+     * @param ch Character to find
+     * @return Position or -1 if not found
+     */
+    int lastIndexOf(char ch) const;
+
+    /**
+     * @brief View part of this view
+     * @param start Start position
+     * @param count Length of substring (default: remainder)
+     * @return View of the substring, empty if start is past the end
+     */
+    SstringView substring(size_t start, size_t count = npos) const;
+
+    /**
+     * @brief View this view without whitespace on both ends
+     * @return Trimmed view
+     */
+    SstringView trim() const;
+
+    /**
+     * @brief Split off the text before a separator
+     * The view is advanced past the separator, or emptied if there is none
+     * @param separator Character to split at
+     * @return View of the text before the separator
+     */
+    SstringView split(char separator);
+
+    /**
+     * @brief Convert a decimal number with an optional sign
+     * Stops at the first character that is not a digit
+     * @return Integer value, 0 if there is no number
+     */
+    long toInt() const;
+
+    /**
+     * @brief Copy the characters into an Arduino String
+     * @return New String holding a copy of the characters
+     */
+    String toString() const;
+
+    /**
+     * @brief Copy the characters into a buffer and null-terminate them
+     * @param buffer Destination buffer
+     * @param size Size of the buffer, the copy is truncated to size - 1 characters
+     * @return Number of characters copied
+     */
+    size_t copyTo(char* buffer, size_t size) const;
+
+private:
+    const char* _data;
+    size_t _length;
+};
+
+} // namespace Utils
@@ -1,18 +1,86 @@
 #include <Arduino.h>
 #include <algorithm>
+#include <esp_crc.h>
+#include <esp_timer.h>
 #include "app.h"
 #include "Config.h"
 #include "lib/Communication/SPISlaveHandler.h"
 
 Communication::SPISlaveHandler* spiSlaveHandler = nullptr;
+Communication::SPIBulkChannel* bulkChannel = nullptr;
 Sensors::Camera* camera = nullptr;
+Sensors::ChangeDetector* changeDetector = nullptr;
+Sensors::QualityController* qualityController = nullptr;
 Sensors::TemperatureSensor* temperatureSensor = nullptr;
 Utils::FileManager* fileManager = nullptr;
 Utils::Logger* logger = nullptr;
 Utils::CommandMapper* commandMapper = nullptr;
+Utils::HealthCheck* healthCheck = nullptr;
+Sensors::FrameRing* frameRing = nullptr;
+Sensors::FrameSpool* frameSpool = nullptr;
+
+// Blocks for frame copies when there is no frame ring, larger frames go to the heap
+Utils::BlockPool* framePool = nullptr;
 
 int cameraBufferSended = 0;
 
+// Sequence number of frames captured outside the frame ring
+uint32_t cameraFrameSequence = 0;
+
+// Newest frame the change detector saw change, only touched by the capturing task
+uint32_t lastChangedSequence = 0;
+
+// Frame captured in the background while cameraFrame is transferred
+CameraFrame nextCameraFrame = {};
+SemaphoreHandle_t nextCameraFrameReady = nullptr;
+TaskHandle_t cameraStreamTaskHandle = nullptr;
+
+// Keeps the capture task off the camera while it is restarted with other settings
+volatile bool cameraPauseRequested = false;
+SemaphoreHandle_t cameraPaused = nullptr;
+
+// Set once the camera stage of the boot is done, successful or not
+volatile bool cameraInitDone = false;
+
+// Preset the camera runs with, CAMERA_PROFILE_CUSTOM for settings sent by the master
+uint8_t cameraProfileIndex = 0;
+
+// Guards cameraFrame between the protocol handler and the stream filler
+SemaphoreHandle_t cameraFrameMutex = nullptr;
+
+// Streaming mode state, the block index is only touched by the stream filler
+volatile bool streamActive = false;
+uint16_t streamBlockIndex = 0;
+uint32_t lastStreamedSequence = 0; // Newest frame whose blocks were streamed
+
+// Blocks of cameraFrame BULK_READ_REQUEST asked for, under cameraFrameMutex
+bool bulkReadActive = false;
+uint32_t bulkReadSequence = 0;
+uint16_t bulkNextBlock = 0;
+uint16_t bulkEndBlock = 0;
+
+// Telemetry, each histogram has a single writer so recording needs no lock
+Utils::Histogram captureTimeHistogram; // Camera capture and copy in milliseconds, written by the capturing task
+Utils::Histogram blockReadyHistogram;  // Block request to staged response in microseconds, written by the protocol handler
+Utils::Histogram frameReadoutHistogram;  // Sensor timestamp to fb_get returning in milliseconds, written by the capturing task
+Utils::Histogram frameWaitHistogram;     // Frame stored to first block staged in milliseconds, under cameraFrameMutex
+Utils::Histogram frameTransferHistogram; // First block staged to last block sent in milliseconds, under cameraFrameMutex
+
+// Stage timestamps of the last frame whose last block went out, for FRAME_TIMING_REQUEST
+uint32_t timedFrameSequence = 0;
+Sensors::FrameTimestamps timedFrameTimestamps = {};
+
+// The last block of cameraFrame is staged, it is sent once a slot carrying lastBlockGeneration completes
+volatile bool lastBlockPending = false;
+uint32_t lastBlockGeneration = 0;  // Staged response holding the last block, under cameraFrameMutex
+volatile int16_t cachedTemperature = TELEMETRY_TEMPERATURE_UNAVAILABLE; // Centi-degrees, refreshed by the health check
+
+// Blocks of cameraFrame the master reported as damaged with BLOCK_NACK_BITMAP
+uint8_t* retransmitBitmap = nullptr;
+size_t retransmitBitCount = 0;
+size_t retransmitCursor = 0;
+uint16_t retransmitStartBlock = 0;
+
 // Global camera frame structure that holds all camera-related data
 CameraFrame cameraFrame = {
   nullptr,    // data
@@ -20,318 +88,1994 @@ CameraFrame cameraFrame = {
   0,          // width
   0,          // height
   0,          // totalBlocks
-  1024,       // blockSize (default)
+  SPI_BUFFER_SIZE - BLOCK_HEADER_SIZE, // blockSize (default)
   false,      // isValid
   0,          // captureTime
-  nullptr     // frameBuffer
+  0,          // crc
+  0,          // sequence
+  nullptr,    // frameBuffer
+  nullptr,    // ringSlot
+  FRAME_KIND_FULL, // kind
+  0,          // unchangedSince
+  0,          // quality
+  {}          // timestamps
 };
 
-// Initialize the camera frame structure
-void initializeCameraFrame() {
-  // Make sure any existing data is released
-  releaseCameraFrame();
+// The stream filler writes a whole frame header into one transaction
+static_assert(FRAME_HEADER_SIZE <= MIN_TRANSFER_LENGTH, "Frame header must fit the shortest transaction");
+static_assert(MIN_TRANSFER_LENGTH >= SPI_MIN_TRANSACTION_SIZE, "Shortest transaction must be one the handler accepts");
+static_assert(MIN_TRANSFER_LENGTH <= SPI_BUFFER_SIZE, "Telemetry record must fit a transaction");
+static_assert(MIN_BLOCK_SIZE + BLOCK_HEADER_SIZE <= MIN_TRANSFER_LENGTH, "Smallest block must fit the shortest transaction");
+
+// Initialize the camera frame structure
+void initializeCameraFrame() {
+  // Make sure any existing data is released
+  releaseCameraFrame();
+  
+  // Set default values
+  cameraFrame.data = nullptr;
+  cameraFrame.length = 0;
+  cameraFrame.width = 0;
+  cameraFrame.height = 0;
+  cameraFrame.totalBlocks = 0;
+  cameraFrame.blockSize = SPI_BUFFER_SIZE - BLOCK_HEADER_SIZE; // A block fills a whole transaction by default
+  cameraFrame.isValid = false;
+  cameraFrame.captureTime = 0;
+  cameraFrame.crc = 0;
+  cameraFrame.sequence = 0;
+  cameraFrame.frameBuffer = nullptr;
+  cameraFrame.ringSlot = nullptr;
+  cameraFrame.kind = FRAME_KIND_FULL;
+  cameraFrame.unchangedSince = 0;
+  cameraFrame.quality = 0;
+  cameraFrame.timestamps = {};
+  
+  LOG_DEBUG(CAMERA, "Camera frame initialized");
+}
+
+// Allocate the data of a frame copy in PSRAM, out of the frame pool when it fits a block
+uint8_t* allocateFrameData(size_t length) {
+  uint8_t* data = nullptr;
+  if (framePool && length <= framePool->getBlockSize()) {
+    data = (uint8_t*)framePool->acquire();
+  }
+  if (!data) {
+    data = (uint8_t*)Utils::Memory::allocate(length, Utils::MemoryPlacement::PsramFirst);
+  }
+  return data;
+}
+
+// Free the data of a frame copy, wherever it came from
+void releaseFrameData(uint8_t* data) {
+  if (!framePool || !framePool->release(data)) {
+    Utils::Memory::release(data);
+  }
+}
+
+// Release the resources held by a camera frame
+void releaseCameraFrame(CameraFrame& frame) {
+  if (frame.ringSlot != nullptr) {
+    // Frame stays in the ring, it may be overwritten from now on
+    frameRing->release(frame.ringSlot);
+    frame.ringSlot = nullptr;
+    frame.data = nullptr;
+  }
+  
+  if (frame.frameBuffer != nullptr) {
+    // Zero-copy frame: data points into the held frame buffer
+    if (camera) {
+      camera->returnFrame(frame.frameBuffer);
+    }
+    frame.frameBuffer = nullptr;
+    frame.data = nullptr;
+  }
+  
+  if (frame.data != nullptr) {
+    releaseFrameData(frame.data);
+    frame.data = nullptr;
+  }
+  
+  frame.isValid = false;
+  
+  // A block staged for the old frame says nothing about the next one
+  if (&frame == &cameraFrame) {
+    lastBlockPending = false;
+  }
+  
+  LOG_DEBUG(CAMERA, "Camera frame resources released");
+}
+
+// Release camera frame resources
+void releaseCameraFrame() {
+  releaseCameraFrame(cameraFrame);
+}
+
+// Log a failed capture, a camera that keeps failing would flood the log otherwise
+void logCaptureFailure() {
+  static uint32_t lastLog = 0;
+  static uint32_t suppressed = 0;
+  uint32_t now = millis();
+  if (lastLog != 0 && now - lastLog < CAMERA_FAILURE_LOG_MS) {
+    suppressed++;
+    return;
+  }
+  LOG_ERROR(CAMERA, "Failed to capture camera frame, %u more failures since the last report", suppressed);
+  lastLog = now;
+  suppressed = 0;
+}
+
+// Split a frame into blocks of its block size, false if a 16-bit block index can't reach them all
+bool setFrameBlocks(CameraFrame& frame) {
+  size_t blocks = (frame.length + frame.blockSize - 1) / frame.blockSize;
+  if (blocks > MAX_FRAME_BLOCKS) {
+    LOG_ERROR(CAMERA, "Frame of %d bytes needs %d blocks of %d bytes, more than a block index holds",
+              frame.length, blocks, frame.blockSize);
+    frame.totalBlocks = 0;
+    return false;
+  }
+  frame.totalBlocks = blocks;
+  return true;
+}
+
+// Capture a new camera frame and store it in the given frame structure
+bool captureCameraFrame(CameraFrame& frame) {
+  if (!camera || !CAMERA_ENABLED) {
+    LOG_ERROR(CAMERA, "Camera not available");
+    return false;
+  }
+  
+  // Release any existing frame
+  releaseCameraFrame(frame);
+  
+  // Copy into the frame ring instead of a fresh allocation
+  if (frameRing) {
+    uint32_t sequence = captureIntoFrameRing();
+    return sequence != 0 && loadRingFrame(frame, sequence);
+  }
+  
+  // Capture a new frame
+  uint32_t captureStart = millis();
+  frame.frameBuffer = camera->captureFrame();
+  
+  if (!frame.frameBuffer) {
+    logCaptureFailure();
+    return false;
+  }
+  beginFrameTimestamps(frame.timestamps, frame.frameBuffer);
+  
+  // Store the frame data, the quality may have changed just after the frame was captured
+  frame.length = frame.frameBuffer->len;
+  frame.quality = camera->getQuality();
+  
+  if (CAMERA_ZERO_COPY) {
+    // Serve blocks straight out of the frame buffer, it is returned in releaseCameraFrame(frame)
+    frame.data = frame.frameBuffer->buf;
+  } else {
+    frame.data = allocateFrameData(frame.length);
+    
+    if (!frame.data) {
+      LOG_ERROR(CAMERA, "Failed to allocate memory for camera frame");
+      camera->returnFrame(frame.frameBuffer);
+      frame.frameBuffer = nullptr;
+      return false;
+    }
+    
+    // Copy the data from frame buffer
+    memcpy(frame.data, frame.frameBuffer->buf, frame.length);
+  }
+  
+  // Get frame dimensions, the resolution may have changed since the frame was captured
+  frame.width = frame.frameBuffer->width;
+  frame.height = frame.frameBuffer->height;
+  
+  if (!setFrameBlocks(frame)) {
+    releaseCameraFrame(frame);
+    return false;
+  }
+  
+  // Update frame metadata, the CRC is computed here so it is ready before the frame is requested
+  frame.isValid = true;
+  frame.captureTime = frame.timestamps.sensor / 1000;
+  frame.crc = esp_crc32_le(0, frame.data, frame.length);
+  frame.unchangedSince = detectFrameChange(frame.data, frame.length, frame.width, frame.height);
+  frame.timestamps.stored = esp_timer_get_time();
+  frame.sequence = ++cameraFrameSequence;
+  frame.kind = FRAME_KIND_FULL;
+  commitFrameChange(frame.sequence, frame.unchangedSince);
+  captureTimeHistogram.record(millis() - captureStart);
+  adjustFrameQuality(frame.length);
+  
+  // Release the original frame buffer after copying its data
+  if (!CAMERA_ZERO_COPY) {
+    camera->returnFrame(frame.frameBuffer);
+    frame.frameBuffer = nullptr;
+  }
+  
+  LOG_INFO(CAMERA, "Camera frame captured: %dx%d, %d bytes, %d blocks", 
+              frame.width, frame.height, 
+              frame.length, frame.totalBlocks);
+  
+  return true;
+}
+
+// Capture a new camera frame and store it in the global structure
+bool captureCameraFrame() {
+  return captureCameraFrame(cameraFrame);
+}
+
+// Capture a frame into the frame ring, the camera buffer is returned right away
+uint32_t captureIntoFrameRing() {
+  uint32_t captureStart = millis();
+  camera_fb_t* fb = camera->captureFrame();
+  if (!fb) {
+    logCaptureFailure();
+    return 0;
+  }
+  Sensors::FrameTimestamps timestamps;
+  beginFrameTimestamps(timestamps, fb);
+  
+  Sensors::FrameSlot* slot = frameRing->beginWrite(fb->len);
+  if (!slot) {
+    LOG_WARNING(CAMERA, "No free frame ring slot, frame dropped");
+    camera->returnFrame(fb);
+    return 0;
+  }
+  
+  memcpy(slot->data, fb->buf, fb->len);
+  slot->length = fb->len;
+  slot->width = fb->width;
+  slot->height = fb->height;
+  slot->quality = camera->getQuality();
+  slot->captureTime = timestamps.sensor / 1000;
+  slot->crc = esp_crc32_le(0, slot->data, slot->length);
+  camera->returnFrame(fb);
+  
+  slot->unchangedSince = detectFrameChange(slot->data, slot->length, slot->width, slot->height);
+  timestamps.stored = esp_timer_get_time();
+  slot->timestamps = timestamps;
+  uint32_t sequence = frameRing->commitWrite(slot);
+  commitFrameChange(sequence, slot->unchangedSince);
+  captureTimeHistogram.record(millis() - captureStart);
+  adjustFrameQuality(slot->length);
+  LOG_DEBUG(CAMERA, "Camera frame %u stored: %d bytes", sequence, slot->length);
+  return sequence;
+}
+
+// Start the timestamps of a frame esp_camera_fb_get() just returned
+// The camera driver stamps the frame in esp_timer time, older drivers leave it at 0
+void beginFrameTimestamps(Sensors::FrameTimestamps& timestamps, const camera_fb_t* fb) {
+  int64_t now = esp_timer_get_time();
+  int64_t sensor = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  
+  timestamps = {};
+  timestamps.sensor = sensor > 0 && sensor <= now ? sensor : now;
+  timestamps.captured = now;
+  frameReadoutHistogram.record((now - timestamps.sensor) / 1000);
+}
+
+// Record that a block of the current frame was staged, called with cameraFrameMutex held
+void noteBlockStaged(uint16_t blockIndex, bool streaming) {
+  Sensors::FrameTimestamps& timestamps = cameraFrame.timestamps;
+  int64_t now = esp_timer_get_time();
+  
+  if (timestamps.firstBlock == 0) {
+    timestamps.firstBlock = now;
+    if (timestamps.stored != 0) {
+      frameWaitHistogram.record((now - timestamps.stored) / 1000);
+    }
+  }
+  
+  // Streamed blocks are clocked in order, a staged response only goes out once a slot is queued again
+  if (blockIndex + 1 == cameraFrame.totalBlocks && timestamps.lastBlock == 0) {
+    if (streaming) {
+      completeFrameTiming(now);
+    } else {
+      lastBlockGeneration = spiSlaveHandler->getStagedGeneration();
+      lastBlockPending = true;
+    }
+  }
+}
+
+// The last block of the current frame went out, called with cameraFrameMutex held
+void completeFrameTiming(int64_t sentTime) {
+  Sensors::FrameTimestamps& timestamps = cameraFrame.timestamps;
+  timestamps.lastBlock = sentTime;
+  frameTransferHistogram.record((sentTime - timestamps.firstBlock) / 1000);
+  
+  timedFrameSequence = cameraFrame.sequence;
+  timedFrameTimestamps = timestamps;
+  lastBlockPending = false;
+}
+
+// Compare a captured frame with the last one that changed, before it gets its sequence number
+// Returns the sequence number of the frame it matches, 0 if it changed
+uint32_t detectFrameChange(const uint8_t* data, size_t length, uint16_t width, uint16_t height) {
+  if (!changeDetector || changeDetector->compare(data, length, width, height) || lastChangedSequence == 0) {
+    return 0;
+  }
+  
+  LOG_DEBUG(CAMERA, "Frame unchanged since %u, difference %u", lastChangedSequence,
+            changeDetector->getLastDifference());
+  return lastChangedSequence;
+}
+
+// Remember a changed frame once it has its sequence number, later frames may match it
+void commitFrameChange(uint32_t sequence, uint32_t unchangedSince) {
+  if (unchangedSince == 0) {
+    lastChangedSequence = sequence;
+  }
+}
+
+// Let the quality controller pick the quality of the next frames from the length of this one
+void adjustFrameQuality(size_t length) {
+  if (!qualityController || !qualityController->isEnabled()) {
+    return;
+  }
+  
+  uint8_t quality = camera->getQuality();
+  uint8_t next = qualityController->update(length, quality);
+  if (next != quality && camera->setQuality(next)) {
+    LOG_DEBUG(CAMERA, "Frame of %d bytes, quality %d -> %d", length, quality, next);
+  }
+}
+
+// Point a camera frame at a frame of the ring, it is held until the frame is released
+bool loadRingFrame(CameraFrame& frame, uint32_t sequence) {
+  const Sensors::FrameSlot* slot = frameRing->acquire(sequence);
+  if (!slot) {
+    return false;
+  }
+  
+  releaseCameraFrame(frame);
+  
+  frame.data = slot->data;
+  frame.length = slot->length;
+  frame.width = slot->width;
+  frame.height = slot->height;
+  frame.isValid = setFrameBlocks(frame);
+  frame.captureTime = slot->captureTime;
+  frame.crc = slot->crc;
+  frame.sequence = slot->sequence;
+  frame.ringSlot = slot;
+  frame.kind = FRAME_KIND_FULL;
+  frame.unchangedSince = slot->unchangedSince;
+  frame.quality = slot->quality;
+  frame.timestamps = slot->timestamps;
+  return true;
+}
+
+// Copy a spooled frame from flash into a camera frame of its own
+bool loadSpooledFrame(CameraFrame& frame, const Sensors::SpoolEntry& entry) {
+  uint8_t* data = allocateFrameData(entry.length);
+  if (!data) {
+    LOG_ERROR(CAMERA, "Failed to allocate memory for spooled frame");
+    return false;
+  }
+  
+  if (!frameSpool->readFrame(entry, data)) {
+    LOG_ERROR(CAMERA, "Failed to read spooled frame %u", entry.sequence);
+    releaseFrameData(data);
+    return false;
+  }
+  
+  releaseCameraFrame(frame);
+  
+  frame.data = data;
+  frame.length = entry.length;
+  frame.width = entry.width;
+  frame.height = entry.height;
+  frame.isValid = setFrameBlocks(frame);
+  frame.captureTime = entry.captureTime;
+  frame.crc = entry.crc;
+  frame.sequence = entry.sequence;
+  frame.kind = FRAME_KIND_FULL;
+  frame.unchangedSince = 0;
+  frame.quality = 0;         // Not kept in the spool
+  frame.timestamps = {};
+  frame.timestamps.stored = esp_timer_get_time();
+  return true;
+}
+
+// Start copying the frames of the ring to flash, frames spooled before a reset are kept
+bool startFrameSpool() {
+  if (!frameRing) {
+    LOG_WARNING(CAMERA, "Frame spool needs the frame ring");
+    return false;
+  }
+  
+  if (!fileManager) {
+    fileManager = new Utils::FileManager();
+  }
+  if (!fileManager->init()) {
+    LOG_ERROR(CAMERA, "Failed to mount SPIFFS for the frame spool");
+    return false;
+  }
+  
+  frameSpool = new Sensors::FrameSpool(fileManager);
+  if (!frameSpool->init(FRAME_SPOOL_DIRECTORY, FRAME_SPOOL_SEGMENT_SIZE, FRAME_SPOOL_MAX_FRAMES) ||
+      !frameSpool->start(frameRing, FRAME_SPOOL_TASK_PRIORITY, FRAME_SPOOL_TASK_CORE)) {
+    LOG_ERROR(CAMERA, "Failed to start the frame spool");
+    delete frameSpool;
+    frameSpool = nullptr;
+    return false;
+  }
+  
+  LOG_INFO(CAMERA, "Frame spool started: %d frames kept, %d of %d bytes used",
+           frameSpool->getFrameCount(), frameSpool->getUsedBytes(), frameSpool->getSegmentSize());
+  return true;
+}
+
+// Let the stream filler fill the slots it had no frame for
+void wakeStreamFiller() {
+  if (streamActive) {
+    spiSlaveHandler->wakeTransmitFiller();
+  }
+}
+
+// Background capture task: keeps the next frame ready while the current one is transferred
+void cameraStreamTask(void* parameter) {
+  while (true) {
+    // Stay off the camera while applyCameraProfile() restarts it
+    if (cameraPauseRequested) {
+      xSemaphoreGive(cameraPaused);
+      while (cameraPauseRequested) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+      }
+      continue;
+    }
+    
+    // A failed restart left the camera down, only CAMERA_CONFIG brings it back
+    if (!camera->isInitialized()) {
+      vTaskDelay(pdMS_TO_TICKS(CAMERA_DOWN_RETRY_MS));
+      continue;
+    }
+    
+    // With the ring keep capturing at the camera's pace, the master takes whatever is newest
+    if (frameRing) {
+      if (captureIntoFrameRing()) {
+        xSemaphoreGive(nextCameraFrameReady);
+        wakeStreamFiller();
+      } else {
+        vTaskDelay(pdMS_TO_TICKS(10));
+      }
+      continue;
+    }
+    
+    captureCameraFrame(nextCameraFrame);
+    xSemaphoreGive(nextCameraFrameReady);
+    wakeStreamFiller();
+    
+    // Wait until the frame has been taken before capturing the next one
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+// Start the background capture task on its own core
+bool startCameraPipeline() {
+  if (cameraStreamTaskHandle) {
+    return true;
+  }
+  
+  nextCameraFrame = cameraFrame;
+  nextCameraFrame.data = nullptr;
+  nextCameraFrame.frameBuffer = nullptr;
+  nextCameraFrame.isValid = false;
+  
+  nextCameraFrameReady = xSemaphoreCreateBinary();
+  cameraPaused = xSemaphoreCreateBinary();
+  if (!nextCameraFrameReady || !cameraPaused) {
+    LOG_ERROR(CAMERA, "Failed to create camera frame semaphore");
+    return false;
+  }
+  
+  if (xTaskCreatePinnedToCore(cameraStreamTask, "camera_stream", 4096, nullptr, CAMERA_CAPTURE_TASK_PRIORITY,
+                              &cameraStreamTaskHandle, CAMERA_CAPTURE_TASK_CORE) != pdPASS) {
+    LOG_ERROR(CAMERA, "Failed to create camera capture task");
+    vSemaphoreDelete(nextCameraFrameReady);
+    nextCameraFrameReady = nullptr;
+    cameraStreamTaskHandle = nullptr;
+    return false;
+  }
+  
+  LOG_INFO(CAMERA, "Camera capture pipeline started on core %d", CAMERA_CAPTURE_TASK_CORE);
+  return true;
+}
+
+// Stop the capture task between two captures, without the pipeline there is nothing to stop
+bool pauseCameraCapture() {
+  if (!cameraStreamTaskHandle) {
+    return true;
+  }
+  
+  // Without the ring the task may be waiting for its last frame to be taken
+  cameraPauseRequested = true;
+  if (!frameRing) {
+    xTaskNotifyGive(cameraStreamTaskHandle);
+  }
+  
+  if (xSemaphoreTake(cameraPaused, pdMS_TO_TICKS(CAMERA_CAPTURE_TIMEOUT_MS)) != pdTRUE) {
+    cameraPauseRequested = false;
+    return false;
+  }
+  return true;
+}
+
+// Let the capture task continue after pauseCameraCapture()
+void resumeCameraCapture() {
+  cameraPauseRequested = false;
+}
+
+// Switch the camera to other settings, restarting it if the settings need that
+bool applyCameraProfile(const Sensors::CameraProfile& profile) {
+  if (!camera->needsRestart(profile)) {
+    return camera->applyProfile(profile);
+  }
+  
+  if (!pauseCameraCapture()) {
+    LOG_ERROR(CAMERA, "Capture task did not pause for the camera restart");
+    return false;
+  }
+  
+  // The restart frees the frame buffers, and frames in the old format are of no use anymore
+  releaseCameraFrame();
+  releaseCameraFrame(nextCameraFrame);
+  clearRetransmitRequest();
+  if (nextCameraFrameReady) {
+    xSemaphoreTake(nextCameraFrameReady, 0);
+  }
+  
+  bool applied = camera->applyProfile(profile);
+  resumeCameraCapture();
+  return applied;
+}
+
+// Wait until a frame newer than cameraFrame can be swapped in
+bool waitForNextCameraFrame(TickType_t ticksToWait) {
+  if (!frameRing) {
+    return xSemaphoreTake(nextCameraFrameReady, ticksToWait) == pdTRUE;
+  }
+  
+  // The semaphore only signals that a capture finished, the ring tells if it is new
+  TickType_t start = xTaskGetTickCount();
+  while (frameRing->getNewestSequence() <= cameraFrame.sequence) {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= ticksToWait) {
+      return false;
+    }
+    xSemaphoreTake(nextCameraFrameReady, ticksToWait - elapsed);
+  }
+  return true;
+}
+
+// Move the frame captured in the background into the global structure
+// The caller must have seen waitForNextCameraFrame() succeed
+void swapInNextCameraFrame() {
+  // Keep the transfer layout of the current frame, retransmit requests refer to the old one
+  uint16_t blockSize = cameraFrame.blockSize;
+  clearRetransmitRequest();
+  
+  // Take the newest frame of the ring, older ones stay there for CAMERA_FRAME_FETCH
+  if (frameRing) {
+    if (!loadRingFrame(cameraFrame, frameRing->getNewestSequence())) {
+      releaseCameraFrame();
+    }
+    return;
+  }
+  
+  releaseCameraFrame();
+  cameraFrame = nextCameraFrame;
+  cameraFrame.blockSize = blockSize;
+  cameraFrame.isValid = cameraFrame.isValid && setFrameBlocks(cameraFrame);
+  
+  // The buffers belong to cameraFrame now
+  nextCameraFrame.data = nullptr;
+  nextCameraFrame.frameBuffer = nullptr;
+  nextCameraFrame.isValid = false;
+  
+  // Start capturing the next frame while this one is transferred
+  xTaskNotifyGive(cameraStreamTaskHandle);
+}
+
+// Swap the frame captured in the background into the global structure
+bool takeNextCameraFrame() {
+  // Without the pipeline capture synchronously
+  if (!cameraStreamTaskHandle) {
+    return captureCameraFrame();
+  }
+  
+  // Normally the frame is already there, only the very first request waits for a capture
+  if (!waitForNextCameraFrame(0)) {
+    // The capture may be waiting for the frame buffer the current frame still holds
+    releaseCameraFrame();
+    
+    if (!waitForNextCameraFrame(pdMS_TO_TICKS(CAMERA_CAPTURE_TIMEOUT_MS))) {
+      LOG_ERROR(CAMERA, "Timed out waiting for camera frame");
+      return false;
+    }
+  }
+  
+  swapInNextCameraFrame();
+  
+  return isCameraFrameValid();
+}
+
+// Check if the camera frame is valid
+bool isCameraFrameValid() {
+  return cameraFrame.isValid && cameraFrame.data != nullptr && cameraFrame.length > 0;
+}
+
+// Write the CAMERA_DATA_RESPONSE header describing the current frame
+size_t writeFrameHeader(uint8_t* buffer, uint8_t flags) {
+  const uint8_t header[] = {
+    static_cast<uint8_t>(Communication::SPICommand::CAMERA_DATA_RESPONSE),
+    0x06,  // Data version
+    static_cast<uint8_t>((cameraFrame.width >> 8) & 0xFF),  // Width high byte
+    static_cast<uint8_t>(cameraFrame.width & 0xFF),         // Width low byte
+    static_cast<uint8_t>((cameraFrame.height >> 8) & 0xFF), // Height high byte
+    static_cast<uint8_t>(cameraFrame.height & 0xFF),        // Height low byte
+    static_cast<uint8_t>((cameraFrame.totalBlocks >> 8) & 0xFF),   // Total blocks high byte
+    static_cast<uint8_t>(cameraFrame.totalBlocks & 0xFF),          // Total blocks low byte
+    static_cast<uint8_t>((cameraFrame.blockSize >> 8) & 0xFF),     // Block size high byte
+    static_cast<uint8_t>(cameraFrame.blockSize & 0xFF),            // Block size low byte
+    static_cast<uint8_t>((cameraFrame.length >> 24) & 0xFF), // Length byte 3
+    static_cast<uint8_t>((cameraFrame.length >> 16) & 0xFF), // Length byte 2
+    static_cast<uint8_t>((cameraFrame.length >> 8) & 0xFF),  // Length byte 1
+    static_cast<uint8_t>(cameraFrame.length & 0xFF),         // Length byte 0
+    static_cast<uint8_t>((cameraFrame.crc >> 24) & 0xFF),    // Frame CRC byte 3
+    static_cast<uint8_t>((cameraFrame.crc >> 16) & 0xFF),    // Frame CRC byte 2
+    static_cast<uint8_t>((cameraFrame.crc >> 8) & 0xFF),     // Frame CRC byte 1
+    static_cast<uint8_t>(cameraFrame.crc & 0xFF),            // Frame CRC byte 0
+    static_cast<uint8_t>((cameraFrame.sequence >> 24) & 0xFF), // Sequence byte 3
+    static_cast<uint8_t>((cameraFrame.sequence >> 16) & 0xFF), // Sequence byte 2
+    static_cast<uint8_t>((cameraFrame.sequence >> 8) & 0xFF),  // Sequence byte 1
+    static_cast<uint8_t>(cameraFrame.sequence & 0xFF),         // Sequence byte 0
+    static_cast<uint8_t>((cameraFrame.captureTime >> 24) & 0xFF), // Capture time byte 3
+    static_cast<uint8_t>((cameraFrame.captureTime >> 16) & 0xFF), // Capture time byte 2
+    static_cast<uint8_t>((cameraFrame.captureTime >> 8) & 0xFF),  // Capture time byte 1
+    static_cast<uint8_t>(cameraFrame.captureTime & 0xFF),         // Capture time byte 0
+    cameraFrame.kind,  // Frame kind
+    flags,             // FRAME_FLAG_*
+    static_cast<uint8_t>((cameraFrame.unchangedSince >> 24) & 0xFF), // Unchanged since byte 3
+    static_cast<uint8_t>((cameraFrame.unchangedSince >> 16) & 0xFF), // Unchanged since byte 2
+    static_cast<uint8_t>((cameraFrame.unchangedSince >> 8) & 0xFF),  // Unchanged since byte 1
+    static_cast<uint8_t>(cameraFrame.unchangedSince & 0xFF),         // Unchanged since byte 0
+    cameraFrame.quality,  // JPEG quality, 0 if unknown
+    0x00, 0x00, 0x00      // Reserved
+  };
+  memcpy(buffer, header, sizeof(header));
+  
+  // Capture stages in microseconds: sensor time, then the time to fb_get and to stored
+  const Sensors::FrameTimestamps& timestamps = cameraFrame.timestamps;
+  uint32_t readout = timestamps.captured ? timestamps.captured - timestamps.sensor : 0;
+  uint32_t store = timestamps.captured ? timestamps.stored - timestamps.captured : 0;
+  size_t pos = sizeof(header);
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    buffer[pos++] = (timestamps.sensor >> shift) & 0xFF;
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    buffer[pos++] = (readout >> shift) & 0xFF;
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    buffer[pos++] = (store >> shift) & 0xFF;
+  }
+  return pos;
+}
+
+// Write the CAMERA_DATA_BLOCK_RESPONSE header (command + block index + data length + CRC32)
+size_t writeBlockHeader(uint8_t* buffer, uint16_t blockIndex, const uint8_t* blockData, size_t dataLength) {
+  uint32_t crc = esp_crc32_le(0, blockData, dataLength);
+  
+  buffer[0] = static_cast<uint8_t>(Communication::SPICommand::CAMERA_DATA_BLOCK_RESPONSE);
+  buffer[1] = (blockIndex >> 8) & 0xFF;  // Block index high byte
+  buffer[2] = blockIndex & 0xFF;         // Block index low byte
+  buffer[3] = (dataLength >> 8) & 0xFF;  // Data length high byte
+  buffer[4] = dataLength & 0xFF;         // Data length low byte
+  buffer[5] = (crc >> 24) & 0xFF;        // Block CRC byte 3
+  buffer[6] = (crc >> 16) & 0xFF;        // Block CRC byte 2
+  buffer[7] = (crc >> 8) & 0xFF;         // Block CRC byte 1
+  buffer[8] = crc & 0xFF;                // Block CRC byte 0
+  return BLOCK_HEADER_SIZE;
+}
+
+// Get the byte range of a block in the current frame
+size_t getBlockLength(uint16_t blockIndex, size_t& startOffset) {
+  startOffset = (size_t)blockIndex * cameraFrame.blockSize;
+  size_t remainingBytes = (startOffset < cameraFrame.length) ? (cameraFrame.length - startOffset) : 0;
+  return (cameraFrame.blockSize < remainingBytes) ? cameraFrame.blockSize : remainingBytes;
+}
+
+// Drop the blocks queued for retransmission
+void clearRetransmitRequest() {
+  if (retransmitBitmap) {
+    Utils::Memory::release(retransmitBitmap);
+    retransmitBitmap = nullptr;
+  }
+  retransmitBitCount = 0;
+  retransmitCursor = 0;
+}
+
+// Get the next block reported as damaged, false once all of them have been resent
+bool nextRetransmitBlock(uint16_t& blockIndex) {
+  while (retransmitBitmap && retransmitCursor < retransmitBitCount) {
+    size_t bit = retransmitCursor++;
+    if (retransmitBitmap[bit / 8] & (0x80 >> (bit % 8))) {
+      blockIndex = retransmitStartBlock + bit;
+      return true;
+    }
+  }
+  
+  clearRetransmitRequest();
+  return false;
+}
+
+// Stage a block of the current frame as the next response
+bool prepareBlockResponse(uint16_t blockIndex, uint16_t headerIndex) {
+  if (!isCameraFrameValid()) {
+    LOG_ERROR(SPI, "No camera frame data available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x05};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return false;
+  }
+  
+  if (blockIndex >= cameraFrame.totalBlocks) {
+    LOG_ERROR(SPI, "Invalid block index: %d >= %d", blockIndex, cameraFrame.totalBlocks);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x06};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return false;
+  }
+  
+  // Calculate start offset and data length for this block
+  size_t startOffset;
+  size_t dataLength = getBlockLength(blockIndex, startOffset);
+  
+  uint8_t header[BLOCK_HEADER_SIZE];
+  writeBlockHeader(header, headerIndex, cameraFrame.data + startOffset, dataLength);
+  
+  // Send the header and the block data straight from the frame
+  spiSlaveHandler->prepareDataToSend(header, sizeof(header), cameraFrame.data + startOffset, dataLength);
+  noteBlockStaged(blockIndex, false);
+  
+  LOG_INFO(SPI, "Sent camera data block %d, %d bytes", blockIndex, dataLength);
+  return true;
+}
+
+// Stage consecutive blocks of the current frame as one response, as many as the transaction holds
+// Returns the number of blocks staged, 0 if not even the first one fits
+uint8_t prepareMultiBlockResponse(uint16_t startBlock, uint8_t maxCount) {
+  uint8_t response[MULTI_BLOCK_HEADER_SIZE] = {
+    static_cast<uint8_t>(Communication::SPICommand::CAMERA_DATA_MULTI_BLOCK_RESPONSE),
+    static_cast<uint8_t>((startBlock >> 8) & 0xFF),  // Start block high byte
+    static_cast<uint8_t>(startBlock & 0xFF),         // Start block low byte
+    0                                                // Block count, set below
+  };
+  
+  // Each block keeps its own header, the data is gathered straight from the frame
+  uint8_t headers[MULTI_BLOCK_MAX_COUNT][BLOCK_HEADER_SIZE];
+  Communication::SPISegment segments[1 + 2 * MULTI_BLOCK_MAX_COUNT];
+  size_t segmentCount = 0;
+  segments[segmentCount++] = {response, sizeof(response)};
+  
+  size_t capacity = spiSlaveHandler->getTransactionLength() - MULTI_BLOCK_HEADER_SIZE;
+  uint8_t count = 0;
+  maxCount = std::min(maxCount, (uint8_t)MULTI_BLOCK_MAX_COUNT);
+  while (count < maxCount && startBlock + count < cameraFrame.totalBlocks) {
+    size_t startOffset;
+    size_t dataLength = getBlockLength(startBlock + count, startOffset);
+    if (BLOCK_HEADER_SIZE + dataLength > capacity) {
+      break;
+    }
+    capacity -= BLOCK_HEADER_SIZE + dataLength;
+    
+    writeBlockHeader(headers[count], startBlock + count, cameraFrame.data + startOffset, dataLength);
+    segments[segmentCount++] = {headers[count], BLOCK_HEADER_SIZE};
+    segments[segmentCount++] = {cameraFrame.data + startOffset, dataLength};
+    count++;
+  }
+  
+  if (count == 0) {
+    return 0;
+  }
+  
+  response[3] = count;
+  spiSlaveHandler->prepareDataToSend(segments, segmentCount);
+  for (uint8_t i = 0; i < count; i++) {
+    noteBlockStaged(startBlock + i, false);
+  }
+  
+  LOG_INFO(SPI, "Sent camera data blocks %d-%d", startBlock, startBlock + count - 1);
+  return count;
+}
+
+// Segment filler of the bulk channel, runs on its task
+// Every segment is one block response of the frame BULK_READ_REQUEST asked for
+size_t fillBulkSegment(uint8_t* buffer, size_t capacity) {
+  xSemaphoreTake(cameraFrameMutex, portMAX_DELAY);
+  
+  // A frame swapped in under the read ends it, the master asks again
+  if (bulkReadActive && (!isCameraFrameValid() || cameraFrame.sequence != bulkReadSequence ||
+                         bulkNextBlock >= bulkEndBlock)) {
+    bulkReadActive = false;
+  }
+  if (!bulkReadActive) {
+    xSemaphoreGive(cameraFrameMutex);
+    return 0;
+  }
+  
+  uint16_t blockIndex = bulkNextBlock++;
+  size_t startOffset;
+  size_t dataLength = getBlockLength(blockIndex, startOffset);
+  dataLength = std::min(dataLength, capacity - BLOCK_HEADER_SIZE);
+  
+  writeBlockHeader(buffer, blockIndex, cameraFrame.data + startOffset, dataLength);
+  memcpy(buffer + BLOCK_HEADER_SIZE, cameraFrame.data + startOffset, dataLength);
+  noteBlockStaged(blockIndex, true);
+  
+  xSemaphoreGive(cameraFrameMutex);
+  return BLOCK_HEADER_SIZE + dataLength;
+}
+
+// Transmit filler for streaming mode, runs on the SPI recycle task
+// Fills each queued transaction with the next block, or the next frame's header once a frame is done
+size_t fillStreamTransaction(uint8_t* buffer, size_t capacity) {
+  if (!streamActive) {
+    return 0;
+  }
+  
+  xSemaphoreTake(cameraFrameMutex, portMAX_DELAY);
+  
+  // Damaged blocks go out before the rest of the frame
+  uint16_t blockIndex;
+  bool haveBlock = isCameraFrameValid() && nextRetransmitBlock(blockIndex) && blockIndex < cameraFrame.totalBlocks;
+  if (!haveBlock && isCameraFrameValid() && streamBlockIndex < cameraFrame.totalBlocks) {
+    blockIndex = streamBlockIndex++;
+    haveBlock = true;
+  }
+  
+  if (haveBlock) {
+    size_t startOffset;
+    size_t dataLength = getBlockLength(blockIndex, startOffset);
+    dataLength = std::min(dataLength, capacity - BLOCK_HEADER_SIZE);
+    
+    writeBlockHeader(buffer, blockIndex, cameraFrame.data + startOffset, dataLength);
+    memcpy(buffer + BLOCK_HEADER_SIZE, cameraFrame.data + startOffset, dataLength);
+    noteBlockStaged(blockIndex, true);
+    
+    xSemaphoreGive(cameraFrameMutex);
+    return BLOCK_HEADER_SIZE + dataLength;
+  }
+  
+  // Frame done, the capture may be waiting for the frame buffer it still holds
+  // Leave the handshake low until the next frame is there, the capture task wakes the filler then
+  if (!waitForNextCameraFrame(0)) {
+    releaseCameraFrame();
+    xSemaphoreGive(cameraFrameMutex);
+    return 0;
+  }
+  
+  swapInNextCameraFrame();
+  streamBlockIndex = 0;
+  
+  // The master already has a frame this one matches, only the header goes out
+  uint8_t flags = 0;
+  if (cameraFrame.unchangedSince != 0 && cameraFrame.unchangedSince <= lastStreamedSequence) {
+    flags = FRAME_FLAG_BLOCKS_SKIPPED;
+    streamBlockIndex = cameraFrame.totalBlocks;
+  } else if (isCameraFrameValid()) {
+    lastStreamedSequence = cameraFrame.sequence;
+  }
+  size_t length = isCameraFrameValid() ? writeFrameHeader(buffer, flags) : 0;
+  xSemaphoreGive(cameraFrameMutex);
+  
+  if (length > 0) {
+    LOG_DEBUG(SPI, "Streaming frame: %d bytes, %d blocks%s", cameraFrame.length, cameraFrame.totalBlocks,
+              flags ? ", unchanged" : "");
+  }
+  return length;
+}
+
+// Answer PING with PONG, echoing up to 15 bytes of its payload
+void handlePing(const uint8_t* data, size_t length) {
+  LOG_INFO(SPI, "Received PING command, responding with PONG");
+  // Echo back any additional data that came with the PING, a bare PING gets a 0x00
+  uint8_t response[16] = {0};
+  size_t echoLength = std::min(length, sizeof(response)) - 1;
+  
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::PONG);
+  memcpy(response + 1, data + 1, echoLength);
+  
+  spiSlaveHandler->prepareDataToSend(response, std::max(echoLength + 1, (size_t)2));
+}
+
+// Make the next captured frame current and answer with its header
+void handleCameraDataRequest(const uint8_t* data, size_t length) {
+  LOG_INFO(SPI, "Received camera data request");
+  
+  // Check if camera is available
+  if (!CAMERA_ENABLED || !camera) {
+    LOG_WARNING(SPI, "Camera not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Frames are pushed by the stream filler while streaming
+  if (streamActive) {
+    LOG_WARNING(SPI, "Camera data request while streaming");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Swap in the frame captured in the background
+  if (!takeNextCameraFrame()) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x02};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Prepare response with metadata about the camera frame
+  uint8_t response[FRAME_HEADER_SIZE];
+  writeFrameHeader(response);
+  
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+  LOG_INFO(SPI, "Camera data ready: %d bytes, %d blocks", cameraFrame.length, cameraFrame.totalBlocks);
+  cameraBufferSended = 0;
+}
+
+// Answer with a block of the current frame: cmd, index(2)
+void handleBlockRequest(const uint8_t* data, size_t length) {
+  int64_t requestTime = esp_timer_get_time();
+  
+  // Extract block index from request
+  uint16_t blockIndex = (data[1] << 8) | data[2];
+  
+  // Resend the next block reported by BLOCK_NACK_BITMAP, labelled with its real index
+  if (blockIndex == RETRANSMIT_NEXT_BLOCK) {
+    if (!nextRetransmitBlock(blockIndex)) {
+      LOG_INFO(SPI, "No more blocks to retransmit");
+      uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK),
+                             static_cast<uint8_t>(Communication::SPICommand::BLOCK_NACK_BITMAP)};
+      spiSlaveHandler->prepareDataToSend(response, 2);
+      return;
+    }
+    prepareBlockResponse(blockIndex, blockIndex);
+    blockReadyHistogram.record(esp_timer_get_time() - requestTime);
+    return;
+  }
+
+  if (cameraBufferSended < blockIndex) {
+    LOG_INFO(SPI, "Received request for camera data block %d, but already sended. send next block %d", blockIndex, cameraBufferSended);
+    blockIndex = cameraBufferSended;
+  } else {
+    LOG_INFO(SPI, "Received request for camera data block %d", blockIndex);        
+  }
+  
+  // Prepare the block, echoing the requested block index
+  if (prepareBlockResponse(blockIndex, (data[1] << 8) | data[2])) {
+    cameraBufferSended = blockIndex + 1;
+  }
+  blockReadyHistogram.record(esp_timer_get_time() - requestTime);
+}
+
+// Answer with consecutive blocks of the current frame in one transaction: cmd, start block(2), count
+// A count of 0 asks for as many blocks as the transaction holds
+void handleMultiBlockRequest(const uint8_t* data, size_t length) {
+  int64_t requestTime = esp_timer_get_time();
+  uint16_t startBlock = (data[1] << 8) | data[2];
+  uint8_t count = data[3] ? data[3] : MULTI_BLOCK_MAX_COUNT;
+  
+  if (!isCameraFrameValid()) {
+    LOG_ERROR(SPI, "No camera frame data available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x05};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  if (startBlock >= cameraFrame.totalBlocks) {
+    LOG_ERROR(SPI, "Invalid block index: %d >= %d", startBlock, cameraFrame.totalBlocks);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x06};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Blocks as large as the transaction don't pack, answer with a plain block instead
+  uint8_t staged = prepareMultiBlockResponse(startBlock, count);
+  if (staged == 0 && prepareBlockResponse(startBlock, startBlock)) {
+    staged = 1;
+  }
+  cameraBufferSended = startBlock + staged;
+  blockReadyHistogram.record(esp_timer_get_time() - requestTime);
+}
+
+// Queue damaged blocks for retransmission: cmd, start block(2), bitmap
+void handleBlockNackBitmap(const uint8_t* data, size_t length) {
+  // Blocks of a frame released after its ACK are gone, don't resend whatever is current instead
+  if (!isCameraFrameValid()) {
+    LOG_WARNING(SPI, "Retransmit requested after the frame was released");
+    clearRetransmitRequest();
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x05};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Keep a copy of the bitmap, the receive buffer goes back to the pool
+  clearRetransmitRequest();
+  size_t bitmapLength = length - 3;
+  retransmitBitmap = (uint8_t*)Utils::Memory::allocate(bitmapLength, Utils::MemoryPlacement::Internal);
+  if (!retransmitBitmap) {
+    LOG_ERROR(SPI, "Failed to allocate retransmit bitmap");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::MEMORY_ERROR)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  memcpy(retransmitBitmap, data + 3, bitmapLength);
+  retransmitStartBlock = (data[1] << 8) | data[2];
+  retransmitBitCount = bitmapLength * 8;
+  retransmitCursor = 0;
+  
+  LOG_INFO(SPI, "Retransmit requested from block %d", retransmitStartBlock);
+  
+  // While streaming the filler picks the blocks up, otherwise answer with the first one
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint16_t blockIndex;
+  if (!nextRetransmitBlock(blockIndex)) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  prepareBlockResponse(blockIndex, blockIndex);
+}
+
+// Make a frame of the ring current by its sequence number: cmd, sequence(4)
+void handleFrameFetch(const uint8_t* data, size_t length) {
+  if (!frameRing) {
+    LOG_WARNING(SPI, "Frame ring not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // The stream filler owns the frame order while streaming
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint32_t sequence = ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) | (data[3] << 8) | data[4];
+  if (!loadRingFrame(cameraFrame, sequence)) {
+    LOG_WARNING(SPI, "Frame %u is no longer in the ring", sequence);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x07};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Blocks are requested from the fetched frame now
+  clearRetransmitRequest();
+  cameraBufferSended = 0;
+  
+  uint8_t response[FRAME_HEADER_SIZE];
+  writeFrameHeader(response);
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+  LOG_INFO(SPI, "Fetched camera frame %u: %d bytes", sequence, cameraFrame.length);
+}
+
+// Find the captured frame a preview or region is encoded from, 0 asks for the newest
+// A ring frame is held until releaseSourceFrame(), the current frame is only borrowed
+bool acquireSourceFrame(uint32_t sequence, CameraFrame& source) {
+  if (frameRing) {
+    source = {};
+    source.blockSize = cameraFrame.blockSize;
+    return loadRingFrame(source, sequence ? sequence : frameRing->getNewestSequence());
+  }
+  
+  if (!isCameraFrameValid() || cameraFrame.kind != FRAME_KIND_FULL ||
+      (sequence != 0 && sequence != cameraFrame.sequence)) {
+    return false;
+  }
+  source = cameraFrame;
+  source.frameBuffer = nullptr;
+  source.data = nullptr;
+  source.ringSlot = nullptr;
+  return true;
+}
+
+// Let go of a frame from acquireSourceFrame()
+void releaseSourceFrame(CameraFrame& source) {
+  if (source.ringSlot) {
+    releaseCameraFrame(source);
+  }
+}
+
+// Make an encoded preview or region the current frame, it takes over the data
+void loadEncodedFrame(uint8_t* data, size_t length, uint16_t width, uint16_t height,
+                      uint32_t sequence, uint32_t captureTime, uint8_t kind, uint8_t quality) {
+  releaseCameraFrame();
+  clearRetransmitRequest();
+  
+  cameraFrame.data = data;
+  cameraFrame.length = length;
+  cameraFrame.width = width;
+  cameraFrame.height = height;
+  cameraFrame.isValid = setFrameBlocks(cameraFrame);
+  cameraFrame.captureTime = captureTime;
+  cameraFrame.crc = esp_crc32_le(0, data, length);
+  cameraFrame.sequence = sequence;    // Same as the full frame, so the master can fetch it next
+  cameraFrame.kind = kind;
+  cameraFrame.unchangedSince = 0;
+  cameraFrame.quality = quality;
+  cameraFrame.timestamps = {};
+  cameraFrame.timestamps.stored = esp_timer_get_time();
+  cameraBufferSended = 0;
+}
+
+// Make a downscaled copy of a captured frame current: cmd, sequence(4), scale shift, quality
+void handlePreviewRequest(const uint8_t* data, size_t length) {
+  // The stream filler owns the frame order while streaming
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint32_t sequence = ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) | (data[3] << 8) | data[4];
+  uint8_t scaleShift = data[5];
+  uint8_t quality = data[6];
+  if (scaleShift < 1 || scaleShift > 3) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::INVALID_FORMAT)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  CameraFrame source;
+  if (!acquireSourceFrame(sequence, source)) {
+    LOG_WARNING(SPI, "Frame %u not available for a preview", sequence);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x07};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // The current frame may be the source, its data stays valid until loadEncodedFrame()
+  const uint8_t* sourceData = source.ringSlot ? source.data : cameraFrame.data;
+  uint8_t* preview = nullptr;
+  size_t previewLength = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  int64_t start = esp_timer_get_time();
+  bool encoded = Sensors::FrameEncoder::encodePreview(sourceData, source.length, source.width, source.height,
+                                                      scaleShift, quality, &preview, &previewLength,
+                                                      width, height);
+  if (encoded) {
+    loadEncodedFrame(preview, previewLength, width, height, source.sequence, source.captureTime, FRAME_KIND_PREVIEW,
+                     quality);
+  }
+  releaseSourceFrame(source);
+  
+  if (!encoded) {
+    LOG_ERROR(CAMERA, "Failed to encode preview of frame %u", source.sequence);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::MEMORY_ERROR)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint8_t response[FRAME_HEADER_SIZE];
+  writeFrameHeader(response);
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+  LOG_INFO(CAMERA, "Preview of frame %u: %dx%d, %d bytes in %d us", source.sequence, width, height,
+           previewLength, (int)(esp_timer_get_time() - start));
+}
+
+// Make a cropped part of a captured frame current: cmd, sequence(4), x(2), y(2), width(2), height(2), quality
+void handleRegionRequest(const uint8_t* data, size_t length) {
+  // The stream filler owns the frame order while streaming
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
   
-  // Set default values
-  cameraFrame.data = nullptr;
-  cameraFrame.length = 0;
-  cameraFrame.width = 0;
-  cameraFrame.height = 0;
-  cameraFrame.totalBlocks = 0;
-  cameraFrame.blockSize = SPI_BUFFER_SIZE - (16*8); // Default block size
-  cameraFrame.isValid = false;
-  cameraFrame.captureTime = 0;
-  cameraFrame.frameBuffer = nullptr;
+  uint32_t sequence = ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) | (data[3] << 8) | data[4];
+  Sensors::FrameRegion region = {
+    static_cast<uint16_t>((data[5] << 8) | data[6]),
+    static_cast<uint16_t>((data[7] << 8) | data[8]),
+    static_cast<uint16_t>((data[9] << 8) | data[10]),
+    static_cast<uint16_t>((data[11] << 8) | data[12])
+  };
+  uint8_t quality = data[13];
+  
+  CameraFrame source;
+  if (!acquireSourceFrame(sequence, source)) {
+    LOG_WARNING(SPI, "Frame %u not available for a region", sequence);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x07};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  if (!Sensors::FrameEncoder::isValidRegion(region, source.width, source.height)) {
+    releaseSourceFrame(source);
+    LOG_WARNING(SPI, "Region %d,%d %dx%d outside of the %dx%d frame", region.x, region.y,
+                region.width, region.height, source.width, source.height);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::INVALID_FORMAT)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // The current frame may be the source, its data stays valid until loadEncodedFrame()
+  const uint8_t* sourceData = source.ringSlot ? source.data : cameraFrame.data;
+  uint8_t* crop = nullptr;
+  size_t cropLength = 0;
+  bool encoded = Sensors::FrameEncoder::encodeRegion(sourceData, source.length, source.width, source.height,
+                                                     region, quality, &crop, &cropLength);
+  if (encoded) {
+    loadEncodedFrame(crop, cropLength, region.width, region.height, source.sequence, source.captureTime,
+                     FRAME_KIND_REGION, quality);
+  }
+  releaseSourceFrame(source);
   
-  if (logger) {
-    logger->debug("Camera frame initialized");
+  if (!encoded) {
+    LOG_ERROR(CAMERA, "Failed to encode region of frame %u", source.sequence);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::MEMORY_ERROR)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
+  
+  uint8_t response[FRAME_HEADER_SIZE];
+  writeFrameHeader(response);
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+  LOG_INFO(CAMERA, "Region of frame %u: %dx%d, %d bytes", source.sequence, region.width, region.height,
+           cropLength);
 }
 
-// Release camera frame resources
-void releaseCameraFrame() {
-  if (cameraFrame.data != nullptr) {
-    free(cameraFrame.data);
-    cameraFrame.data = nullptr;
+// Switch the camera settings, with only the command byte nothing changes:
+// cmd, preset or cmd, CAMERA_PROFILE_CUSTOM, framesize, pixel format, quality, fb count
+void handleCameraConfig(const uint8_t* data, size_t length) {
+  if (!CAMERA_ENABLED || !camera) {
+    LOG_WARNING(SPI, "Camera not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
   
-  if (cameraFrame.frameBuffer != nullptr) {
-    if (camera) {
-      camera->returnFrame(cameraFrame.frameBuffer);
+  bool restarted = false;
+  if (length >= 2) {
+    Sensors::CameraProfile profile = camera->getProfile();
+    if (data[1] == CAMERA_PROFILE_CUSTOM && length >= 6) {
+      profile.name = "custom";
+      profile.frameSize = static_cast<framesize_t>(data[2]);
+      profile.pixelFormat = static_cast<pixformat_t>(data[3]);
+      profile.jpegQuality = data[4];
+      profile.fbCount = data[5];
+    } else if (data[1] < Sensors::Camera::getPresetCount()) {
+      profile = Sensors::Camera::getPreset(data[1]);
+    } else {
+      profile.frameSize = FRAMESIZE_INVALID;
+    }
+    
+    bool valid = profile.frameSize < FRAMESIZE_INVALID && profile.jpegQuality <= 63 &&
+                 profile.fbCount >= 1 && profile.fbCount <= 3 &&
+                 (profile.pixelFormat == PIXFORMAT_JPEG || profile.pixelFormat == PIXFORMAT_RGB565 ||
+                  profile.pixelFormat == PIXFORMAT_YUV422 || profile.pixelFormat == PIXFORMAT_GRAYSCALE);
+    if (!valid) {
+      uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                             static_cast<uint8_t>(Communication::SPIResponseCode::INVALID_FORMAT)};
+      spiSlaveHandler->prepareDataToSend(response, 2);
+      return;
     }
-    cameraFrame.frameBuffer = nullptr;
+    
+    // A restart takes the frame away from under a running stream
+    restarted = camera->needsRestart(profile);
+    if (restarted && streamActive) {
+      uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                             static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+      spiSlaveHandler->prepareDataToSend(response, 2);
+      return;
+    }
+    
+    if (!applyCameraProfile(profile)) {
+      LOG_ERROR(SPI, "Failed to apply camera profile %s", profile.name);
+      uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                             static_cast<uint8_t>(Communication::SPIResponseCode::CAMERA_NOT_AVAILABLE)};
+      spiSlaveHandler->prepareDataToSend(response, 2);
+      return;
+    }
+    cameraProfileIndex = data[1];
+    if (qualityController) {
+      qualityController->setSettleFrames(camera->getProfile().fbCount);
+    }
+    LOG_INFO(SPI, "Camera profile %s applied%s", profile.name, restarted ? " with a restart" : "");
   }
   
-  cameraFrame.isValid = false;
+  // Report what is active now
+  const Sensors::CameraProfile& active = camera->getProfile();
+  uint8_t response[7] = {
+    static_cast<uint8_t>(Communication::SPICommand::CAMERA_CONFIG_RESPONSE),
+    cameraProfileIndex,
+    static_cast<uint8_t>(active.frameSize),
+    static_cast<uint8_t>(active.pixelFormat),
+    active.jpegQuality,
+    active.fbCount,
+    static_cast<uint8_t>(restarted ? 1 : 0)
+  };
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Keep frames under a byte budget by adjusting the JPEG quality: cmd, target(4), 0 stops
+void handleQualityTarget(const uint8_t* data, size_t length) {
+  if (!qualityController) {
+    LOG_WARNING(SPI, "Camera not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
   
-  if (logger) {
-    logger->debug("Camera frame resources released");
+  uint32_t target = ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) | (data[3] << 8) | data[4];
+  qualityController->setTarget(target);
+  
+  // Without a target the profile decides the quality again
+  if (target == 0) {
+    camera->setQuality(camera->getProfile().jpegQuality);
   }
+  
+  LOG_INFO(SPI, "Frame size target: %u bytes", target);
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
 }
 
-// Capture a new camera frame and store it in the global structure
-bool captureCameraFrame() {
-  if (!camera || !CAMERA_ENABLED) {
-    if (logger) {
-      logger->error("Camera not available");
-    }
-    return false;
+// Turn change detection on or off and set its threshold: cmd, enabled, threshold
+void handleChangeDetectConfig(const uint8_t* data, size_t length) {
+  if (!changeDetector) {
+    LOG_WARNING(SPI, "Change detection not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
   
-  // Release any existing frame
-  releaseCameraFrame();
+  // The capturing task picks both up with its next frame
+  changeDetector->setThreshold(data[2]);
+  changeDetector->setEnabled(data[1] != 0);
   
-  // Capture a new frame
-  cameraFrame.frameBuffer = camera->captureFrame();
+  LOG_INFO(SPI, "Change detection %s, threshold %d", data[1] ? "enabled" : "disabled", data[2]);
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+
+// Report the sequence range and loss counters of the frame ring
+void handleFrameRingStatus(const uint8_t* data, size_t length) {
+  uint32_t oldest = frameRing ? frameRing->getOldestSequence() : 0;
+  uint32_t newest = frameRing ? frameRing->getNewestSequence() : 0;
+  uint32_t overwritten = frameRing ? frameRing->getOverwrittenCount() : 0;
+  uint32_t dropped = frameRing ? frameRing->getDroppedCount() : 0;
+  
+  uint8_t response[17];
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::FRAME_RING_STATUS_RESPONSE);
+  const uint32_t fields[4] = {oldest, newest, overwritten, dropped};
+  for (int i = 0; i < 4; i++) {
+    response[1 + i * 4] = (fields[i] >> 24) & 0xFF;
+    response[2 + i * 4] = (fields[i] >> 16) & 0xFF;
+    response[3 + i * 4] = (fields[i] >> 8) & 0xFF;
+    response[4 + i * 4] = fields[i] & 0xFF;
+  }
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Stop, start or clear the flash frame spool: cmd, action (0 = stop, 1 = start, 2 = clear)
+void handleSpoolControl(const uint8_t* data, size_t length) {
+  if (!frameSpool) {
+    LOG_WARNING(SPI, "Frame spool not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
   
-  if (!cameraFrame.frameBuffer) {
-    if (logger) {
-      logger->error("Failed to capture camera frame");
+  switch (data[1]) {
+    case 0: frameSpool->setEnabled(false); break;
+    case 1: frameSpool->setEnabled(true); break;
+    case 2: frameSpool->clear(); break;
+    default: {
+      uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                             static_cast<uint8_t>(Communication::SPIResponseCode::INVALID_FORMAT)};
+      spiSlaveHandler->prepareDataToSend(response, 2);
+      return;
     }
-    return false;
   }
   
-  // Store the frame data
-  cameraFrame.length = cameraFrame.frameBuffer->len;
-  cameraFrame.data = (uint8_t*)malloc(cameraFrame.length);
+  LOG_INFO(SPI, "Frame spool control: %d", data[1]);
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+
+// Make a spooled frame current by its position, 0 is the oldest: cmd, index(2)
+void handleSpoolFetch(const uint8_t* data, size_t length) {
+  if (!frameSpool) {
+    LOG_WARNING(SPI, "Frame spool not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // The stream filler owns the frame order while streaming
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint16_t index = (data[1] << 8) | data[2];
+  Sensors::SpoolEntry entry;
+  if (!frameSpool->getEntry(index, entry)) {
+    LOG_WARNING(SPI, "No spooled frame at %d", index);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x07};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // The newest frames wait in the write batch for up to SPOOL_FLUSH_INTERVAL_MS
+  if (!frameSpool->isReadable(entry)) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  if (!loadSpooledFrame(cameraFrame, entry)) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::CHECKSUM_ERROR)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Blocks are requested from the fetched frame now
+  clearRetransmitRequest();
+  cameraBufferSended = 0;
+  
+  uint8_t response[FRAME_HEADER_SIZE];
+  writeFrameHeader(response);
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+  LOG_INFO(SPI, "Fetched spooled frame %d (sequence %u): %d bytes", index, entry.sequence, entry.length);
+}
+
+// Report the frame count, fill level and missed frames of the spool
+void handleSpoolStatus(const uint8_t* data, size_t length) {
+  uint32_t frames = frameSpool ? frameSpool->getFrameCount() : 0;
+  uint32_t used = frameSpool ? frameSpool->getUsedBytes() : 0;
+  uint32_t size = frameSpool ? frameSpool->getSegmentSize() : 0;
+  uint32_t missed = frameSpool ? frameSpool->getMissedCount() : 0;
+  
+  uint8_t response[18];
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::SPOOL_STATUS_RESPONSE);
+  response[1] = frameSpool && frameSpool->isEnabled() ? 1 : 0;
+  const uint32_t fields[4] = {frames, used, size, missed};
+  for (int i = 0; i < 4; i++) {
+    response[2 + i * 4] = (fields[i] >> 24) & 0xFF;
+    response[3 + i * 4] = (fields[i] >> 16) & 0xFF;
+    response[4 + i * 4] = (fields[i] >> 8) & 0xFF;
+    response[5 + i * 4] = fields[i] & 0xFF;
+  }
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Report the receive buffer state and the link counters
+void handleBufferStatus(const uint8_t* data, size_t length) {
+  uint32_t dropped = spiSlaveHandler->getDroppedPacketCount();
+  uint32_t transactions = spiSlaveHandler->getTransactionCount();
+  uint32_t recoveries = spiSlaveHandler->getRecoveryAttempts();
+  
+  uint8_t response[15];
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::BUFFER_STATUS_RESPONSE);
+  response[1] = spiSlaveHandler->getBufferStatus();
+  response[2] = static_cast<uint8_t>(spiSlaveHandler->pendingReceiveCount());
+  const uint32_t fields[3] = {dropped, transactions, recoveries};
+  for (int i = 0; i < 3; i++) {
+    response[3 + i * 4] = (fields[i] >> 24) & 0xFF;
+    response[4 + i * 4] = (fields[i] >> 16) & 0xFF;
+    response[5 + i * 4] = (fields[i] >> 8) & 0xFF;
+    response[6 + i * 4] = fields[i] & 0xFF;
+  }
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Write the TELEMETRY_RESPONSE record, only reads counters so it never waits for a lock
+size_t writeTelemetry(uint8_t* buffer) {
+  // The ring is published before cameraInitDone is set and never freed afterwards
+  Sensors::FrameRing* ring = cameraInitDone ? frameRing : nullptr;
+  uint32_t capturedFrames = ring ? ring->getNewestSequence() : cameraFrameSequence;
+  const uint32_t fields[10] = {
+    (uint32_t)millis(),
+    spiSlaveHandler->getTransactionCount(),
+    spiSlaveHandler->getDroppedPacketCount(),
+    spiSlaveHandler->getRecoveryAttempts(),
+    ESP.getFreeHeap(),
+    ESP.getMinFreeHeap(),
+    psramFound() ? ESP.getFreePsram() : 0,
+    capturedFrames,
+    ring ? ring->getDroppedCount() : 0,
+    ring ? ring->getOverwrittenCount() : 0
+  };
+  
+  size_t pos = 0;
+  buffer[pos++] = static_cast<uint8_t>(Communication::SPICommand::TELEMETRY_RESPONSE);
+  buffer[pos++] = TELEMETRY_VERSION;
+  for (int i = 0; i < 10; i++) {
+    buffer[pos++] = (fields[i] >> 24) & 0xFF;
+    buffer[pos++] = (fields[i] >> 16) & 0xFF;
+    buffer[pos++] = (fields[i] >> 8) & 0xFF;
+    buffer[pos++] = fields[i] & 0xFF;
+  }
+  buffer[pos++] = static_cast<uint8_t>(spiSlaveHandler->getReceiveQueueHighWater());
+  buffer[pos++] = static_cast<uint8_t>(SPI_BUFFER_POOL_SIZE - SPI_TRANSACTION_SLOTS);  // Packets the queue can hold
+  int16_t temperature = cachedTemperature;
+  buffer[pos++] = (temperature >> 8) & 0xFF;
+  buffer[pos++] = temperature & 0xFF;
+  
+  pos += captureTimeHistogram.writeTo(buffer + pos);
+  pos += blockReadyHistogram.writeTo(buffer + pos);
+  pos += spiSlaveHandler->getIsrTimeHistogram().writeTo(buffer + pos);
+  pos += frameReadoutHistogram.writeTo(buffer + pos);
+  pos += frameWaitHistogram.writeTo(buffer + pos);
+  pos += frameTransferHistogram.writeTo(buffer + pos);
+  
+  // Memory accounting after the histograms, so older readers keep finding them at the same offsets
+  Utils::MemoryStats internalStats = Utils::Memory::getInternalStats();
+  Utils::MemoryStats externalStats = Utils::Memory::getExternalStats();
+  const uint32_t memoryFields[5] = {
+    (uint32_t)internalStats.used,
+    (uint32_t)internalStats.peak,
+    (uint32_t)externalStats.used,
+    (uint32_t)externalStats.peak,
+    internalStats.failures + externalStats.failures
+  };
+  for (int i = 0; i < 5; i++) {
+    buffer[pos++] = (memoryFields[i] >> 24) & 0xFF;
+    buffer[pos++] = (memoryFields[i] >> 16) & 0xFF;
+    buffer[pos++] = (memoryFields[i] >> 8) & 0xFF;
+    buffer[pos++] = memoryFields[i] & 0xFF;
+  }
+  return pos;
+}
+
+// Report the link, memory and camera counters with the latency histograms
+void handleTelemetryRequest(const uint8_t* data, size_t length) {
+  uint8_t response[TELEMETRY_RESPONSE_SIZE];
+  size_t responseLength = writeTelemetry(response);
+  spiSlaveHandler->prepareDataToSend(response, responseLength);
+}
+
+// Answer with both clocks so the master can map slave timestamps to its own: cmd, masterTime(8)
+void handleTimeSync(const uint8_t* data, size_t length) {
+  // The ISR time of this request, the master pairs it with the time it sent it at
+  int64_t receiveTime = spiSlaveHandler->getReceiveTime();
+  
+  uint8_t response[17];
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::TIME_SYNC_RESPONSE);
+  memcpy(response + 1, data + 1, 8);  // Master time, echoed as sent
+  for (int i = 0; i < 8; i++) {
+    response[9 + i] = (receiveTime >> (56 - i * 8)) & 0xFF;
+  }
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Report the stage timestamps of the last frame whose blocks all went out
+void handleFrameTimingRequest(const uint8_t* data, size_t length) {
+  const int64_t stages[5] = {
+    timedFrameTimestamps.sensor,
+    timedFrameTimestamps.captured,
+    timedFrameTimestamps.stored,
+    timedFrameTimestamps.firstBlock,
+    timedFrameTimestamps.lastBlock
+  };
   
-  if (!cameraFrame.data) {
-    if (logger) {
-      logger->error("Failed to allocate memory for camera frame");
+  uint8_t response[45];
+  response[0] = static_cast<uint8_t>(Communication::SPICommand::FRAME_TIMING_RESPONSE);
+  response[1] = (timedFrameSequence >> 24) & 0xFF;
+  response[2] = (timedFrameSequence >> 16) & 0xFF;
+  response[3] = (timedFrameSequence >> 8) & 0xFF;
+  response[4] = timedFrameSequence & 0xFF;
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 8; j++) {
+      response[5 + i * 8 + j] = (stages[i] >> (56 - j * 8)) & 0xFF;
     }
-    camera->returnFrame(cameraFrame.frameBuffer);
-    cameraFrame.frameBuffer = nullptr;
-    return false;
+  }
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+#if SPI_BENCHMARK_ENABLED
+// Benchmark builds only: change the camera resolution: cmd, framesize
+void handleBenchSetFramesize(const uint8_t* data, size_t length) {
+  if (!camera) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x04};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
   
-  // Copy the data from frame buffer
-  memcpy(cameraFrame.data, cameraFrame.frameBuffer->buf, cameraFrame.length);
+  // Frames already captured keep their size, the master discards a few
+  camera->setResolution(static_cast<framesize_t>(data[1]));
+  LOG_WARNING(SPI, "Benchmark: camera resolution set to %d", data[1]);
   
-  // Get frame dimensions
-  framesize_t resolution = camera->getResolution();
-  switch (resolution) {
-    case FRAMESIZE_QQVGA: cameraFrame.width = 160; cameraFrame.height = 120; break;
-    case FRAMESIZE_QVGA: cameraFrame.width = 320; cameraFrame.height = 240; break;
-    case FRAMESIZE_VGA: cameraFrame.width = 640; cameraFrame.height = 480; break;
-    case FRAMESIZE_SVGA: cameraFrame.width = 800; cameraFrame.height = 600; break;
-    case FRAMESIZE_XGA: cameraFrame.width = 1024; cameraFrame.height = 768; break;
-    case FRAMESIZE_HD: cameraFrame.width = 1280; cameraFrame.height = 720; break;
-    case FRAMESIZE_SXGA: cameraFrame.width = 1280; cameraFrame.height = 1024; break;
-    case FRAMESIZE_UXGA: cameraFrame.width = 1600; cameraFrame.height = 1200; break;
-    default: cameraFrame.width = 320; cameraFrame.height = 240; break;
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+#endif
+
+// Switch to streaming, the transmit filler pushes frames from now on
+void handleStreamStart(const uint8_t* data, size_t length) {
+  // Streaming needs the background capture to keep frames coming
+  if (!CAMERA_ENABLED || !camera || !cameraStreamTaskHandle) {
+    LOG_WARNING(SPI, "Streaming not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
   
-  // Calculate total blocks
-  cameraFrame.totalBlocks = (cameraFrame.length + cameraFrame.blockSize - 1) / cameraFrame.blockSize;
+  // Start with the next frame's header, the current frame may be half transferred
+  streamBlockIndex = cameraFrame.totalBlocks;
+  lastStreamedSequence = 0;
+  streamActive = true;
+  spiSlaveHandler->setTransmitFiller(fillStreamTransaction);
   
-  // Update frame metadata
-  cameraFrame.isValid = true;
-  cameraFrame.captureTime = millis();
+  LOG_INFO(SPI, "Streaming started");
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+
+// Queue blocks of the current frame on the bulk channel: cmd, start block(2), count(2), 0 to the end
+void handleBulkReadRequest(const uint8_t* data, size_t length) {
+  if (!bulkChannel) {
+    LOG_WARNING(SPI, "Bulk channel not available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
   
-  // Release the original frame buffer after copying its data
-  camera->returnFrame(cameraFrame.frameBuffer);
-  cameraFrame.frameBuffer = nullptr;
+  // The stream filler owns the frame's blocks while streaming
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
   
-  if (logger) {
-    logger->info("Camera frame captured: %dx%d, %d bytes, %d blocks", 
-                cameraFrame.width, cameraFrame.height, 
-                cameraFrame.length, cameraFrame.totalBlocks);
+  if (!isCameraFrameValid()) {
+    LOG_ERROR(SPI, "No camera frame data available");
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x05};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
   }
   
-  return true;
+  uint16_t startBlock = (data[1] << 8) | data[2];
+  uint16_t count = (data[3] << 8) | data[4];
+  if (startBlock >= cameraFrame.totalBlocks) {
+    LOG_ERROR(SPI, "Invalid block index: %d >= %d", startBlock, cameraFrame.totalBlocks);
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x06};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  uint16_t available = cameraFrame.totalBlocks - startBlock;
+  count = (count == 0 || count > available) ? available : count;
+  
+  // The channel task picks the blocks up as soon as it has a free segment
+  bulkReadSequence = cameraFrame.sequence;
+  bulkNextBlock = startBlock;
+  bulkEndBlock = startBlock + count;
+  bulkReadActive = true;
+  cameraBufferSended = bulkEndBlock;
+  bulkChannel->notify();
+  
+  LOG_INFO(SPI, "Bulk read of blocks %d-%d", startBlock, bulkEndBlock - 1);
+  uint8_t response[10] = {
+    static_cast<uint8_t>(Communication::SPICommand::BULK_READ_RESPONSE),
+    static_cast<uint8_t>((bulkReadSequence >> 24) & 0xFF), // Sequence byte 3
+    static_cast<uint8_t>((bulkReadSequence >> 16) & 0xFF), // Sequence byte 2
+    static_cast<uint8_t>((bulkReadSequence >> 8) & 0xFF),  // Sequence byte 1
+    static_cast<uint8_t>(bulkReadSequence & 0xFF),         // Sequence byte 0
+    static_cast<uint8_t>((startBlock >> 8) & 0xFF),        // Start block high byte
+    static_cast<uint8_t>(startBlock & 0xFF),               // Start block low byte
+    static_cast<uint8_t>((count >> 8) & 0xFF),             // Block count high byte
+    static_cast<uint8_t>(count & 0xFF),                    // Block count low byte
+    bulkChannel->getLineCount()                            // Data lines of the bulk bus
+  };
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
 }
 
-// Check if the camera frame is valid
-bool isCameraFrameValid() {
-  return cameraFrame.isValid && cameraFrame.data != nullptr && cameraFrame.length > 0;
+// Back to request/response mode
+void handleStreamStop(const uint8_t* data, size_t length) {
+  streamActive = false;
+  spiSlaveHandler->setTransmitFiller(nullptr);
+  
+  LOG_INFO(SPI, "Streaming stopped");
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+
+// Negotiate the block size and transaction length: cmd, block size(2), length(2)
+void handleSetTransferParams(const uint8_t* data, size_t length) {
+  // The block layout must not change under a running stream
+  if (streamActive) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Zero asks for the largest value the slave supports
+  uint16_t requestedBlockSize = (data[1] << 8) | data[2];
+  uint16_t requestedLength = (data[3] << 8) | data[4];
+  size_t maxLength = spiSlaveHandler->getMaxTransactionLength();
+  
+  // Transactions are DMA buffers, keep them a multiple of 4 bytes
+  // Every control response, the telemetry record included, has to fit in one
+  size_t transactionLength = requestedLength ? requestedLength : maxLength;
+  transactionLength = std::min(std::max(transactionLength, (size_t)MIN_TRANSFER_LENGTH), maxLength) & ~(size_t)3;
+  
+  // A block and its header have to fit in one transaction, and a 16-bit block index has to reach every block
+  size_t maxBlockSize = transactionLength - BLOCK_HEADER_SIZE;
+  size_t minBlockSize = std::max((size_t)MIN_BLOCK_SIZE, (cameraFrame.length + MAX_FRAME_BLOCKS - 1) / MAX_FRAME_BLOCKS);
+  size_t blockSize = requestedBlockSize ? std::min((size_t)requestedBlockSize, maxBlockSize) : maxBlockSize;
+  blockSize = std::min(std::max(blockSize, minBlockSize), maxBlockSize);
+  
+  spiSlaveHandler->setTransactionLength(transactionLength);
+  cameraFrame.blockSize = blockSize;
+  if (!setFrameBlocks(cameraFrame)) {
+    releaseCameraFrame();
+  }
+  
+  LOG_INFO(SPI, "Transfer params: block size %d, transaction length %d", blockSize, transactionLength);
+  
+  // Report what was accepted, it may differ from the request
+  uint8_t response[7] = {
+    static_cast<uint8_t>(Communication::SPICommand::TRANSFER_PARAMS_RESPONSE),
+    static_cast<uint8_t>((blockSize >> 8) & 0xFF),         // Block size high byte
+    static_cast<uint8_t>(blockSize & 0xFF),                // Block size low byte
+    static_cast<uint8_t>((transactionLength >> 8) & 0xFF), // Transaction length high byte
+    static_cast<uint8_t>(transactionLength & 0xFF),        // Transaction length low byte
+    static_cast<uint8_t>((maxLength >> 8) & 0xFF),         // Maximum transaction length high byte
+    static_cast<uint8_t>(maxLength & 0xFF)                 // Maximum transaction length low byte
+  };
+  spiSlaveHandler->prepareDataToSend(response, sizeof(response));
+}
+
+// Master acknowledged the last response
+void handleAck(const uint8_t* data, size_t length) {
+  LOG_DEBUG(SPI, "Received ACK");
+  
+  // In zero-copy mode the frame buffer is handed back once the last block is acknowledged,
+  // the ACK closes the frame's retransmit window. While streaming the filler owns the frame.
+  if (CAMERA_ZERO_COPY && !streamActive && cameraFrame.frameBuffer != nullptr &&
+      cameraBufferSended >= cameraFrame.totalBlocks) {
+    releaseCameraFrame();
+  }
+}
+
+// Master rejected the last response
+void handleNack(const uint8_t* data, size_t length) {
+  LOG_WARNING(SPI, "Received NACK");
+}
+
+// Commands without a handler are acknowledged
+void handleUnknownCommand(const uint8_t* data, size_t length) {
+  LOG_DEBUG(SPI, "Received unknown command: 0x%02X", data[0]);
+  // Respond with ACK by default
+  uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
+  spiSlaveHandler->prepareDataToSend(response, 2);
+}
+
+// Register the protocol commands, the dispatcher checks each minimum length before calling the handler
+void registerCommandHandlers() {
+  Communication::CommandDispatcher& dispatcher = spiSlaveHandler->getDispatcher();
+  
+  dispatcher.registerHandler(Communication::SPICommand::PING, handlePing);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_DATA_REQUEST, handleCameraDataRequest);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_DATA_BLOCK_REQUEST, handleBlockRequest, 3);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_DATA_MULTI_BLOCK_REQUEST, handleMultiBlockRequest, 4);
+  dispatcher.registerHandler(Communication::SPICommand::BULK_READ_REQUEST, handleBulkReadRequest, 5);
+  dispatcher.registerHandler(Communication::SPICommand::BLOCK_NACK_BITMAP, handleBlockNackBitmap, 4);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_FRAME_FETCH, handleFrameFetch, 5);
+  dispatcher.registerHandler(Communication::SPICommand::FRAME_RING_STATUS_REQUEST, handleFrameRingStatus);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_PREVIEW_REQUEST, handlePreviewRequest, 7);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_ROI_REQUEST, handleRegionRequest, 14);
+  dispatcher.registerHandler(Communication::SPICommand::CHANGE_DETECT_CONFIG, handleChangeDetectConfig, 3);
+  dispatcher.registerHandler(Communication::SPICommand::SPOOL_CONTROL, handleSpoolControl, 2);
+  dispatcher.registerHandler(Communication::SPICommand::SPOOL_FETCH, handleSpoolFetch, 3);
+  dispatcher.registerHandler(Communication::SPICommand::SPOOL_STATUS_REQUEST, handleSpoolStatus);
+  dispatcher.registerHandler(Communication::SPICommand::BUFFER_STATUS_REQUEST, handleBufferStatus);
+  dispatcher.registerHandler(Communication::SPICommand::TELEMETRY_REQUEST, handleTelemetryRequest);
+  dispatcher.registerHandler(Communication::SPICommand::CAMERA_CONFIG, handleCameraConfig);
+  dispatcher.registerHandler(Communication::SPICommand::QUALITY_TARGET, handleQualityTarget, 5);
+  dispatcher.registerHandler(Communication::SPICommand::TIME_SYNC, handleTimeSync, 9);
+  dispatcher.registerHandler(Communication::SPICommand::FRAME_TIMING_REQUEST, handleFrameTimingRequest);
+#if SPI_BENCHMARK_ENABLED
+  dispatcher.registerHandler(Communication::SPICommand::BENCH_SET_FRAMESIZE, handleBenchSetFramesize, 2);
+#endif
+  dispatcher.registerHandler(Communication::SPICommand::STREAM_START, handleStreamStart);
+  dispatcher.registerHandler(Communication::SPICommand::STREAM_STOP, handleStreamStop);
+  dispatcher.registerHandler(Communication::SPICommand::SET_TRANSFER_PARAMS, handleSetTransferParams, 5);
+  dispatcher.registerHandler(Communication::SPICommand::ACK, handleAck);
+  dispatcher.registerHandler(Communication::SPICommand::NACK, handleNack);
+  dispatcher.setUnknownHandler(handleUnknownCommand);
+}
+
+// Commands that only read the link state and counters, answered while the camera is
+// still coming up and dispatched without cameraFrameMutex
+bool isBootCommand(uint8_t command) {
+  switch (static_cast<Communication::SPICommand>(command)) {
+    case Communication::SPICommand::PING:
+    case Communication::SPICommand::TIME_SYNC:
+    case Communication::SPICommand::BUFFER_STATUS_REQUEST:
+    case Communication::SPICommand::TELEMETRY_REQUEST:
+      return true;
+    default:
+      return false;
+  }
 }
 
 // Callback function to handle received SPI data
 void onDataReceived(const uint8_t* data, size_t length) {
-  if (logger) {
-    logger->info("Received %d bytes of data via SPI", length);
-    
-    // Print out the received data for debugging
-    String dataHex = "";
+  // The transaction that carried the staged last block clocked it out
+  // A later response in its place means it was replaced before it got out
+  uint32_t sentGeneration = spiSlaveHandler->getSentGeneration();
+  if (lastBlockPending && sentGeneration != 0) {
+    xSemaphoreTake(cameraFrameMutex, portMAX_DELAY);
+    if (lastBlockPending && sentGeneration == lastBlockGeneration) {
+      completeFrameTiming(spiSlaveHandler->getReceiveTime());
+    } else if (lastBlockPending && (int32_t)(sentGeneration - lastBlockGeneration) > 0) {
+      lastBlockPending = false;
+    }
+    xSemaphoreGive(cameraFrameMutex);
+  }
+  
+  // The master is only clocking out a response or a stream, nothing to answer
+  if (length > 0 && data[0] == static_cast<uint8_t>(Communication::SPICommand::NOP)) {
+    return;
+  }
+  
+  LOG_INFO(SPI, "Received %d bytes of data via SPI", length);
+  
+  // Print out the received data for debugging, skipped entirely when SPI debug logging is off
+  if (LOG_ENABLED(SPI, DEBUG)) {
+    char dataHex[16 * 5 + 1];
+    size_t pos = 0;
     for (size_t i = 0; i < min(length, (size_t)16); i++) {
-      char buf[8];
-      snprintf(buf, sizeof(buf), "0x%02X ", data[i]);
-      dataHex += buf;
+      pos += snprintf(dataHex + pos, sizeof(dataHex) - pos, "0x%02X ", data[i]);
     }
-    logger->debug("Data: %s", dataHex.c_str());
+    dataHex[pos] = '\0';
+    LOG_DEBUG(SPI, "Data: %s", dataHex);
+  }
+  
+  // Commands that touch the camera wait for the camera stage of the boot
+  if (length > 0 && spiSlaveHandler && !cameraInitDone && !isBootCommand(data[0])) {
+    uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK),
+                           static_cast<uint8_t>(Communication::SPIResponseCode::NOT_READY)};
+    spiSlaveHandler->prepareDataToSend(response, 2);
+    return;
+  }
+  
+  // Counters are read without a lock, they must not wait behind a frame encode or a camera restart
+  if (length > 0 && spiSlaveHandler && isBootCommand(data[0])) {
+    spiSlaveHandler->getDispatcher().dispatch(data, length);
+    return;
   }
   
   // Process received data
   if (length > 0 && spiSlaveHandler) {
-    Communication::SPICommand cmd = static_cast<Communication::SPICommand>(data[0]);
+    // The stream filler may be working on the frame
+    xSemaphoreTake(cameraFrameMutex, portMAX_DELAY);
     
-    switch (cmd) {
-      case Communication::SPICommand::PING: {
-        logger->info("Received PING command, responding with PONG");
-        // Echo back any additional data that came with the PING
-        size_t responseLen = length > 16 ? 16 : length;
-        uint8_t* response = new uint8_t[responseLen];
-        
-        response[0] = static_cast<uint8_t>(Communication::SPICommand::PONG);
-        // Copy any additional data from the PING command
-        if (length > 1) {
-          memcpy(response + 1, data + 1, responseLen - 1);
-        } else {
-          response[1] = 0x00;  // Default response if no additional data
-        }
-        
-        spiSlaveHandler->prepareDataToSend(response, responseLen);
-        delete[] response;
-        break;
-      }
-      
-      case Communication::SPICommand::CAMERA_DATA_REQUEST: {
-        logger->info("Received camera data request");
-        
-        // Check if camera is available
-        if (!CAMERA_ENABLED || !camera) {
-          logger->warning("Camera not available");
-          uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x01};
-          spiSlaveHandler->prepareDataToSend(response, 2);
-          break;
-        }
-        
-        // Capture a new frame using our helper function
-        if (!captureCameraFrame()) {
-          uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x02};
-          spiSlaveHandler->prepareDataToSend(response, 2);
-          break;
-        }
-        
-        // Prepare response with metadata about the camera frame
-        uint8_t response[16] = {
-          static_cast<uint8_t>(Communication::SPICommand::CAMERA_DATA_RESPONSE),
-          0x01,  // Data version
-          static_cast<uint8_t>((cameraFrame.width >> 8) & 0xFF),  // Width high byte
-          static_cast<uint8_t>(cameraFrame.width & 0xFF),         // Width low byte
-          static_cast<uint8_t>((cameraFrame.height >> 8) & 0xFF), // Height high byte
-          static_cast<uint8_t>(cameraFrame.height & 0xFF),        // Height low byte
-          static_cast<uint8_t>((cameraFrame.totalBlocks >> 8) & 0xFF),   // Total blocks high byte
-          static_cast<uint8_t>(cameraFrame.totalBlocks & 0xFF),          // Total blocks low byte
-          static_cast<uint8_t>((cameraFrame.blockSize >> 8) & 0xFF),     // Block size high byte
-          static_cast<uint8_t>(cameraFrame.blockSize & 0xFF),            // Block size low byte
-          static_cast<uint8_t>((cameraFrame.length >> 24) & 0xFF), // Length byte 3
-          static_cast<uint8_t>((cameraFrame.length >> 16) & 0xFF), // Length byte 2
-          static_cast<uint8_t>((cameraFrame.length >> 8) & 0xFF),  // Length byte 1
-          static_cast<uint8_t>(cameraFrame.length & 0xFF),         // Length byte 0
-          0x00, 0x00  // Reserved
-        };
-        
-        spiSlaveHandler->prepareDataToSend(response, sizeof(response));
-        logger->info("Camera data ready: %d bytes, %d blocks", cameraFrame.length, cameraFrame.totalBlocks);
-        cameraBufferSended = 0;
-        break;
-      }
-      
-      case Communication::SPICommand::CAMERA_DATA_BLOCK_REQUEST: {
-        if (length < 3) {
-          logger->error("Invalid block request format");
-          uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x04};
-          spiSlaveHandler->prepareDataToSend(response, 2);
-          break;
-        }
-        
-        // Extract block index from request
-        uint16_t blockIndex = (data[1] << 8) | data[2];
-
-        if (cameraBufferSended < blockIndex) {
-          logger->info("Received request for camera data block %d, but already sended. send next block %d", blockIndex, cameraBufferSended);
-          blockIndex = cameraBufferSended;
-        } else {
-          logger->info("Received request for camera data block %d", blockIndex);        
-        }
-        
-        // Validate request using our helper function
-        if (!isCameraFrameValid()) {
-          logger->error("No camera frame data available");
-          uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x05};
-          spiSlaveHandler->prepareDataToSend(response, 2);
-          break;
-        }
-        
-        if (blockIndex >= cameraFrame.totalBlocks) {
-          logger->error("Invalid block index: %d >= %d", blockIndex, cameraFrame.totalBlocks);
-          uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x06};
-          spiSlaveHandler->prepareDataToSend(response, 2);
-          break;
-        }
-        
-        // Calculate start offset and data length for this block
-        size_t startOffset = blockIndex * cameraFrame.blockSize;
-        size_t remainingBytes = (startOffset < cameraFrame.length) ? (cameraFrame.length - startOffset) : 0;
-        size_t dataLength = (cameraFrame.blockSize < remainingBytes) ? cameraFrame.blockSize : remainingBytes;
-        
-        // Prepare header (command + block index + data length)
-        uint8_t* response = (uint8_t*)malloc(5 + dataLength);
-        if (!response) {
-          logger->error("Failed to allocate memory for block response");
-          uint8_t errResponse[2] = {static_cast<uint8_t>(Communication::SPICommand::NACK), 0x07};
-          spiSlaveHandler->prepareDataToSend(errResponse, 2);
-          break;
-        }
-        
-        response[0] = static_cast<uint8_t>(Communication::SPICommand::CAMERA_DATA_BLOCK_RESPONSE);
-        response[1] = data[1]; // Block index high byte
-        response[2] = data[2]; // Block index low byte
-        response[3] = (dataLength >> 8) & 0xFF; // Data length high byte
-        response[4] = dataLength & 0xFF;        // Data length low byte
-        
-        // Copy the block data
-        memcpy(response + 5, cameraFrame.data + startOffset, dataLength);
-        
-        // Send the response
-        spiSlaveHandler->prepareDataToSend(response, 5 + dataLength);
-        free(response);
-        
-        cameraBufferSended = blockIndex + 1;
-
-        logger->info("Sent camera data block %d, %d bytes", blockIndex, dataLength);
-        break;
-      }
-      
-      case Communication::SPICommand::ACK:
-        logger->debug("Received ACK");
-        break;
-        
-      case Communication::SPICommand::NACK:
-        logger->warning("Received NACK");
-        break;
-        
-      default:
-        logger->debug("Received unknown command: 0x%02X", static_cast<uint8_t>(cmd));
-        // Respond with ACK by default
-        uint8_t response[2] = {static_cast<uint8_t>(Communication::SPICommand::ACK), data[0]};
-        spiSlaveHandler->prepareDataToSend(response, 2);
-        break;
-    }
+    spiSlaveHandler->getDispatcher().dispatch(data, length);
+    
+    xSemaphoreGive(cameraFrameMutex);
   }
 }
 
 // Function to initialize camera
 bool initializeCamera() {
-  if (!camera) {
-    camera = new Sensors::Camera();
+  // Boot commands read these globals while this runs on the init task,
+  // so everything is built here first and only published once it works
+  Sensors::Camera* newCamera = camera ? camera : new Sensors::Camera();
+  if (!newCamera) {
+    LOG_ERROR(CAMERA, "Failed to create camera instance");
+    return false;
   }
   
-  if (!camera) {
-    logger->error("Failed to create camera instance");
+  if (!newCamera->init()) {
+    LOG_ERROR(CAMERA, "Failed to initialize camera");
+    if (newCamera != camera) {
+      delete newCamera;
+    }
     return false;
   }
   
-  bool result = camera->init();
-  if (result) {
-    logger->info("Camera initialized successfully");
-    camera->setResolution(CAMERA_FRAME_SIZE);
-    logger->info("Camera resolution set to %d", (int)camera->getResolution());
-  } else {
-    logger->error("Failed to initialize camera");
+  LOG_INFO(CAMERA, "Camera initialized successfully");
+  LOG_INFO(CAMERA, "Camera profile %s, resolution %d", newCamera->getProfile().name, (int)newCamera->getResolution());
+  
+  // Keep the last frames in PSRAM so the master can fetch them by sequence number,
+  // zero-copy frames live in the camera's own buffers instead
+  Sensors::FrameRing* newFrameRing = nullptr;
+  if (!CAMERA_ZERO_COPY && CAMERA_FRAME_RING_SIZE > 0 && psramFound()) {
+    newFrameRing = new Sensors::FrameRing();
+    if (newFrameRing->init(CAMERA_FRAME_RING_SIZE)) {
+      LOG_INFO(CAMERA, "Camera frame ring holds %d frames", CAMERA_FRAME_RING_SIZE);
+    } else {
+      LOG_WARNING(CAMERA, "Failed to allocate camera frame ring, copying frames on the heap");
+      delete newFrameRing;
+      newFrameRing = nullptr;
+    }
+  }
+  
+  // Without the ring, frame copies come out of fixed PSRAM blocks instead of the fragmenting heap
+  Utils::BlockPool* newFramePool = nullptr;
+  if (!CAMERA_ZERO_COPY && !newFrameRing && FRAME_POOL_BLOCKS > 0 && psramFound()) {
+    newFramePool = new Utils::BlockPool("frame", FRAME_POOL_BLOCK_SIZE, FRAME_POOL_BLOCKS,
+                                        Utils::MemoryPlacement::Psram);
+    if (!newFramePool->reserve(FRAME_POOL_BLOCKS)) {
+      LOG_WARNING(CAMERA, "Only %d of %d frame blocks allocated", newFramePool->getAllocatedCount(),
+                  FRAME_POOL_BLOCKS);
+    }
+  }
+  
+  // Compare every captured frame with the last one that changed
+  Sensors::ChangeDetector* newChangeDetector = new Sensors::ChangeDetector();
+  newChangeDetector->setEnabled(CHANGE_DETECT_ENABLED);
+  newChangeDetector->setThreshold(CHANGE_DETECT_THRESHOLD);
+  newChangeDetector->setRefreshInterval(CHANGE_DETECT_REFRESH_MS);
+  
+  // Adjust the quality to a frame size budget, off until a target is set
+  Sensors::QualityController* newQualityController = new Sensors::QualityController();
+  newQualityController->setLimits(CAMERA_QUALITY_BEST, CAMERA_QUALITY_WORST);
+  newQualityController->setSettleFrames(newCamera->getProfile().fbCount);
+  newQualityController->setTarget(CAMERA_QUALITY_TARGET);
+  
+  // Handlers run under the frame mutex, they see either none or all of it
+  xSemaphoreTake(cameraFrameMutex, portMAX_DELAY);
+  camera = newCamera;
+  frameRing = newFrameRing;
+  framePool = newFramePool;
+  changeDetector = newChangeDetector;
+  qualityController = newQualityController;
+  xSemaphoreGive(cameraFrameMutex);
+  
+  // Keep the frames the master doesn't get to on flash
+  if (FRAME_SPOOL_ENABLED && !startFrameSpool()) {
+    LOG_WARNING(CAMERA, "Frame spool unavailable");
+  }
+  
+  // Keep the next frame captured ahead of the master's requests
+  if (CAMERA_CAPTURE_PIPELINE && !startCameraPipeline()) {
+    LOG_WARNING(CAMERA, "Camera capture pipeline unavailable, capturing on request");
   }
   
-  return result;
+  return true;
+}
+
+// Camera stage of the boot, inline or on its own task
+void runCameraInit() {
+  LOG_INFO(GENERAL, "Initializing camera...");
+  if (initializeCamera()) {
+    LOG_INFO(GENERAL, "Camera initialized successfully, %lu ms after reset", millis());
+  } else {
+    LOG_ERROR(GENERAL, "Failed to initialize camera");
+  }
+  cameraInitDone = true;
+}
+
+// Brings the camera up on the other core while loop() already serves SPI
+void cameraInitTask(void* parameter) {
+  runCameraInit();
+  vTaskDelete(nullptr);
 }
 
 // Implementation of setupSPISlaveCommunication
@@ -341,48 +2085,77 @@ void setupSPISlaveCommunication() {
   
   // Initialize SPI with configured pins and SPI mode
   if (!spiSlaveHandler->init(SPI_SCK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN, SPI_ESP32_SS, SPI_MODE1)) {
-    logger->error("Failed to initialize SPI slave");
+    LOG_ERROR(SPI, "Failed to initialize SPI slave");
     return;
   }
   
-  // Register our callback for received data
+  // Fill the command table, then route received data through our callback
+  registerCommandHandlers();
   spiSlaveHandler->setReceiveCallback(onDataReceived);
   
+  // Packets are processed from loop(), wake it as soon as one arrives
+  spiSlaveHandler->setConsumerTask(xTaskGetCurrentTaskHandle());
+  
+  // Tell the master when streamed data is queued
+  spiSlaveHandler->setHandshakePin(SPI_HANDSHAKE_PIN);
+  
+  // Frame blocks can also go out on a wide bus, commands stay on this one
+  if (SPI_BULK_CHANNEL_ENABLED) {
+    bulkChannel = new Communication::SPIBulkChannel(SPI_BUFFER_SIZE);
+    if (bulkChannel->init(SPI_BULK_HOST, SPI_BULK_SCK_PIN, SPI_BULK_CS_PIN, SPI_BULK_DATA0_PIN,
+                          SPI_BULK_DATA1_PIN, SPI_BULK_DATA2_PIN, SPI_BULK_DATA3_PIN)) {
+      bulkChannel->setFiller(fillBulkSegment);
+    } else {
+      LOG_ERROR(SPI, "Failed to initialize SPI bulk channel, blocks only go out on the command bus");
+      delete bulkChannel;
+      bulkChannel = nullptr;
+    }
+  }
+  
+  // Or hand the protocol to its own task on the other core
+  if (SPI_PROTOCOL_TASK_ENABLED &&
+      !spiSlaveHandler->startProtocolTask(SPI_PROTOCOL_TASK_CORE, SPI_PROTOCOL_TASK_PRIORITY)) {
+    LOG_ERROR(SPI, "Failed to start SPI protocol task, processing packets from loop()");
+  }
+  
   // Prepare initial response data (idle data that will be sent on first transaction)
   uint8_t initialData[4] = {0xAA, 0x55, 0xAA, 0x55}; // Recognizable pattern
   spiSlaveHandler->prepareDataToSend(initialData, sizeof(initialData));
   
-  logger->info("SPI slave communication initialized successfully");
+  LOG_INFO(SPI, "SPI slave communication initialized successfully");
 }
 
 // Implementation of loopSPISlaveHandler
 void loopSPISlaveHandler() {
   if (!spiSlaveHandler) return;
   
-  // Process any pending receive operations
-  while (spiSlaveHandler->processNextReceive()) {
-    // Each iteration processes one queued receive packet
-  }
-  
-  // Ensure a transaction is queued and ready to receive data
-  static unsigned long lastQueueTime = 0;
-  const unsigned long QUEUE_CHECK_INTERVAL = 33; // Check every 50ms
-  
-  if (millis() - lastQueueTime > QUEUE_CHECK_INTERVAL) {
-    lastQueueTime = millis();
-    spiSlaveHandler->ensureTransactionQueued();
-  }
-  
-  // Check for stalled transactions and recover if needed
-  static unsigned long lastWatchdogCheck = 0;
-  const unsigned long WATCHDOG_CHECK_INTERVAL = 15000; // Check every second
-  
-  if (millis() - lastWatchdogCheck > WATCHDOG_CHECK_INTERVAL) {
-    lastWatchdogCheck = millis();
+  // The protocol task takes care of receiving, queueing and the watchdog on its own
+  if (!spiSlaveHandler->isProtocolTaskRunning()) {
+    // Process any pending receive operations
+    while (spiSlaveHandler->processNextReceive()) {
+      // Each iteration processes one queued receive packet
+    }
+    
+    // Ensure a transaction is queued and ready to receive data
+    static unsigned long lastQueueTime = 0;
+    const unsigned long QUEUE_CHECK_INTERVAL = 33; // Check every 50ms
+    
+    if (millis() - lastQueueTime > QUEUE_CHECK_INTERVAL) {
+      lastQueueTime = millis();
+      spiSlaveHandler->ensureTransactionQueued();
+    }
+    
+    // Check for stalled transactions and recover if needed
+    static unsigned long lastWatchdogCheck = 0;
+    const unsigned long WATCHDOG_CHECK_INTERVAL = 15000; // Check every second
     
-    // If a recovery action was taken, log it
-    if (spiSlaveHandler->checkAndRecoverFromStalledTransaction()) {
-      logger->warning("SPI transaction watchdog triggered recovery action");
+    if (millis() - lastWatchdogCheck > WATCHDOG_CHECK_INTERVAL) {
+      lastWatchdogCheck = millis();
+      
+      // If a recovery action was taken, log it
+      if (spiSlaveHandler->checkAndRecoverFromStalledTransaction()) {
+        LOG_WARNING(SPI, "SPI transaction watchdog triggered recovery action");
+      }
     }
   }
   
@@ -397,9 +2170,93 @@ void loopSPISlaveHandler() {
     if (spiSlaveHandler->pendingReceiveCount() == 0) {
       uint8_t pingData[2] = {static_cast<uint8_t>(Communication::SPICommand::PING), 0x00};
       spiSlaveHandler->prepareDataToSend(pingData, sizeof(pingData));
-      logger->debug("Sent ping to master");
+      LOG_DEBUG(SPI, "Sent ping to master");
+    }
+  }
+}
+
+// Register the health checks, each one is cheap and runs on its own interval
+void setupHealthChecks() {
+  healthCheck = new Utils::HealthCheck();
+  healthCheck->init(HEALTH_CHECK_INTERVAL);
+  
+  healthCheck->addCheck("heap", []() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < HEALTH_HEAP_CRITICAL_BYTES) return Utils::HealthCheck::CRITICAL;
+    if (freeHeap < HEALTH_HEAP_WARNING_BYTES) return Utils::HealthCheck::WARNING;
+    return Utils::HealthCheck::HEALTHY;
+  }, HEALTH_CHECK_HEAP_INTERVAL);
+  
+  // Failed allocations since the last run mean some buffer isn't sized for the load
+  healthCheck->addCheck("memory", []() {
+    static uint32_t lastFailures = 0;
+    uint32_t failures = Utils::Memory::getInternalStats().failures + Utils::Memory::getExternalStats().failures;
+    for (Utils::BlockPool* pool = Utils::BlockPool::first(); pool; pool = pool->next()) {
+      failures += pool->getFailureCount();
+    }
+    bool failing = failures != lastFailures;
+    if (failing) {
+      for (Utils::BlockPool* pool = Utils::BlockPool::first(); pool; pool = pool->next()) {
+        LOG_WARNING(HEALTH, "Pool %s: %d of %d blocks in use, high water %d, %u failures", pool->getName(),
+                    pool->getInUseCount(), pool->getCapacity(), pool->getHighWater(), pool->getFailureCount());
+      }
     }
+    lastFailures = failures;
+    return failing ? Utils::HealthCheck::WARNING : Utils::HealthCheck::HEALTHY;
+  }, HEALTH_CHECK_HEAP_INTERVAL);
+  
+  // Any recovery since the last run means the link had stalled
+  healthCheck->addCheck("spi", []() {
+    static uint32_t lastRecoveries = 0;
+    if (!spiSlaveHandler || !spiSlaveHandler->isReadyToSend()) return Utils::HealthCheck::ERROR;
+    uint32_t recoveries = spiSlaveHandler->getRecoveryAttempts();
+    bool recovered = recoveries != lastRecoveries;
+    lastRecoveries = recoveries;
+    return recovered ? Utils::HealthCheck::WARNING : Utils::HealthCheck::HEALTHY;
+  }, HEALTH_CHECK_SPI_INTERVAL);
+  
+  // Frames the ring had no slot for mean the transfer can't keep up
+  healthCheck->addCheck("camera", []() {
+    static uint32_t lastDropped = 0;
+    if (!CAMERA_ENABLED || !cameraInitDone) return Utils::HealthCheck::HEALTHY;  // Nothing to judge while it comes up
+    if (!camera || !camera->isInitialized()) return Utils::HealthCheck::ERROR;  // Also down after a failed restart
+    uint32_t dropped = frameRing ? frameRing->getDroppedCount() : 0;
+    bool dropping = dropped != lastDropped;
+    lastDropped = dropped;
+    return dropping ? Utils::HealthCheck::WARNING : Utils::HealthCheck::HEALTHY;
+  });
+  
+  // The sensor read is the slowest check, its value is cached for the telemetry
+  if (temperatureSensor) {
+    healthCheck->addCheck("temperature", []() {
+      float temperature = temperatureSensor->readTemperature();
+      if (isnan(temperature)) {
+        cachedTemperature = TELEMETRY_TEMPERATURE_UNAVAILABLE;
+        return Utils::HealthCheck::WARNING;
+      }
+      cachedTemperature = (int16_t)(temperature * 100);
+      return temperature > HEALTH_TEMPERATURE_WARNING ? Utils::HealthCheck::WARNING : Utils::HealthCheck::HEALTHY;
+    }, HEALTH_CHECK_TEMPERATURE_INTERVAL);
   }
+  
+  // The checks themselves have to stay within their CPU budget
+  healthCheck->addCheck("health", []() {
+    return healthCheck->getCpuUsage() > HEALTH_CHECK_CPU_BUDGET ? Utils::HealthCheck::WARNING
+                                                                : Utils::HealthCheck::HEALTHY;
+  });
+  
+  healthCheck->setStatusChangeCallback([](const char* name, Utils::HealthCheck::Status previous,
+                                          Utils::HealthCheck::Status current) {
+    if (current > previous) {
+      LOG_WARNING(HEALTH, "Health check %s: %s -> %s", name,
+                  Utils::HealthCheck::statusToString(previous), Utils::HealthCheck::statusToString(current));
+    } else {
+      LOG_INFO(HEALTH, "Health check %s: %s -> %s", name,
+               Utils::HealthCheck::statusToString(previous), Utils::HealthCheck::statusToString(current));
+    }
+  });
+  
+  LOG_INFO(HEALTH, "Health checks registered: %d", healthCheck->getChecks().size());
 }
 
 void setup() {
@@ -409,48 +2266,70 @@ void setup() {
   // Initialize Logger
   logger = &Utils::Logger::getInstance();
   logger->init(true);
-  logger->setLogLevel(Utils::LogLevel::DEBUG);
-  logger->info("Logger initialized");
+  // Per-packet logging would dominate the benchmark numbers
+  logger->setLogLevel(SPI_BENCHMARK_ENABLED ? Utils::LogLevel::WARNING : Utils::LogLevel::DEBUG);
+  LOG_INFO(GENERAL, "Logger initialized");
   
   // Log SPI pin configuration for troubleshooting
-  logger->info("SPI Configuration:");
-  logger->info(" - SCK Pin: %d", SPI_SCK_PIN);
-  logger->info(" - MISO Pin: %d", SPI_MISO_PIN);
-  logger->info(" - MOSI Pin: %d", SPI_MOSI_PIN);
-  logger->info(" - SS Pin: %d", SPI_ESP32_SS);
-  logger->info(" - Mode: SPI_MODE1");
+  LOG_INFO(GENERAL, "SPI Configuration:");
+  LOG_INFO(GENERAL, " - SCK Pin: %d", SPI_SCK_PIN);
+  LOG_INFO(GENERAL, " - MISO Pin: %d", SPI_MISO_PIN);
+  LOG_INFO(GENERAL, " - MOSI Pin: %d", SPI_MOSI_PIN);
+  LOG_INFO(GENERAL, " - SS Pin: %d", SPI_ESP32_SS);
+  LOG_INFO(GENERAL, " - Mode: SPI_MODE1");
 
   // Initialize the camera frame structure
   initializeCameraFrame();
+  cameraFrameMutex = xSemaphoreCreateMutex();
 
   // Initialize SPI Slave Handler
   setupSPISlaveCommunication();
   if (spiSlaveHandler && spiSlaveHandler->isReadyToSend()) {
-    logger->info("SPI Slave Handler initialized successfully");
+    LOG_INFO(GENERAL, "SPI Slave Handler initialized successfully, %lu ms after reset", millis());
   } else {
-    logger->error("Failed to initialize SPI Slave");
+    LOG_ERROR(GENERAL, "Failed to initialize SPI Slave");
   }
   
-  // Initialize camera if enabled
+  // Initialize camera if enabled, camera commands get NOT_READY until it is done
   if (CAMERA_ENABLED) {
-    logger->info("Initializing camera...");
-    if (initializeCamera()) {
-      logger->info("Camera initialized successfully");
-    } else {
-      logger->error("Failed to initialize camera");
+    if (!CAMERA_INIT_DEFERRED) {
+      runCameraInit();
+    } else if (xTaskCreatePinnedToCore(cameraInitTask, "camera_init", 8192, nullptr, 1, nullptr,
+                                       CAMERA_INIT_TASK_CORE) != pdPASS) {
+      LOG_WARNING(GENERAL, "Failed to create camera init task, initializing inline");
+      runCameraInit();
     }
   } else {
-    logger->info("Camera disabled in configuration");
+    LOG_INFO(GENERAL, "Camera disabled in configuration");
+    cameraInitDone = true;
+  }
+  
+  // Chip temperature for the health check and the telemetry
+  temperatureSensor = new Sensors::TemperatureSensor();
+  if (!temperatureSensor->init()) {
+    LOG_WARNING(GENERAL, "Temperature sensor not available");
+    delete temperatureSensor;
+    temperatureSensor = nullptr;
+  }
+  
+  // Checks read the subsystems set up above
+  if (HEALTH_CHECK_ENABLED) {
+    setupHealthChecks();
   }
   
   // Set up a periodic timer to send a ping if no data is received
-  logger->info("SPI Slave is ready and waiting for master...");
+  LOG_INFO(GENERAL, "SPI Slave is ready and waiting for master...");
 }
 
 void loop() {
   // Process any pending SPI receive operations
   loopSPISlaveHandler();
   
-  // Give other tasks a chance to run
-  vTaskDelay(33);
+  // One due health check at most, so a slow one can't hold up the SPI handling
+  if (healthCheck) {
+    healthCheck->update();
+  }
+  
+  // Sleep until the next packet arrives, or give other tasks a chance to run
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(33));
 }
\ No newline at end of file
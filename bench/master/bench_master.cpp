@@ -0,0 +1,503 @@
+// Reference SPI master that benchmarks the camera slave
+// Flash the slave with the esp32cam-bench environment and this sketch with bench-master.
+// Results are printed on Serial as one JSON object per line.
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <esp_crc.h>
+
+// Wiring, VSPI defaults of the ESP32 DevKit
+#define BENCH_SCK_PIN 18
+#define BENCH_MISO_PIN 19
+#define BENCH_MOSI_PIN 23
+#define BENCH_CS_PIN 5
+#define BENCH_HANDSHAKE_PIN -1        // Slave SPI_HANDSHAKE_PIN, -1 skips the streaming runs
+
+// Run parameters
+#define BENCH_DURATION_MS 10000       // Length of each throughput run
+#define BENCH_FRAMESIZE_DURATION_MS 5000
+#define BENCH_LATENCY_SAMPLES 200
+#define BENCH_DEFAULT_CLOCK 8000000
+#define BENCH_RESPONSE_TIMEOUT_US 200000
+#define BENCH_POLL_INTERVAL_US 50
+#define BENCH_GAP_US 10               // CS high time, lets the slave load the next transaction
+#define BENCH_CONTROL_LENGTH 32       // Bytes clocked for commands and polls, the slave's transactions are longer
+#define SLAVE_MIN_TRANSACTION 500     // MIN_TRANSFER_LENGTH on the slave, the shortest it negotiates
+#define BENCH_MAX_TRANSACTION 8192    // SPI_BUFFER_SIZE on the slave
+#define BENCH_HISTOGRAM_BUCKETS 20    // Bucket n counts latencies below 2^n us
+
+// Protocol, must match Communication::SPICommand on the slave
+#define CMD_NOP 0x00
+#define CMD_PING 0x01
+#define CMD_PONG 0x02
+#define CMD_CAMERA_DATA_REQUEST 0x20
+#define CMD_CAMERA_DATA_RESPONSE 0x21
+#define CMD_CAMERA_DATA_BLOCK_REQUEST 0x22
+#define CMD_CAMERA_DATA_BLOCK_RESPONSE 0x23
+#define CMD_BUFFER_STATUS_REQUEST 0x30
+#define CMD_BUFFER_STATUS_RESPONSE 0x31
+#define CMD_STREAM_START 0x40
+#define CMD_STREAM_STOP 0x41
+#define CMD_SET_TRANSFER_PARAMS 0x50
+#define CMD_TRANSFER_PARAMS_RESPONSE 0x51
+#define CMD_BENCH_SET_FRAMESIZE 0x60
+#define CMD_ACK 0xAA
+#define CMD_NACK 0xFF
+
+#define FRAME_HEADER_SIZE 52          // FRAME_HEADER_SIZE on the slave
+#define BLOCK_HEADER_SIZE 9
+#define SLAVE_TRANSACTION_SLOTS 3     // Transactions the slave keeps queued
+
+// A poll may clock less than a slave transaction, never more
+static_assert(BENCH_CONTROL_LENGTH <= SLAVE_MIN_TRANSACTION, "Control transactions must fit the slave's shortest one");
+static_assert(FRAME_HEADER_SIZE <= SLAVE_MIN_TRANSACTION, "Frame header must fit the slave's shortest transaction");
+
+static const uint32_t CLOCKS[] = {1000000, 4000000, 8000000, 10000000, 16000000, 20000000};
+static const uint16_t BLOCK_SIZES[] = {1024, 2048, 4096, BENCH_MAX_TRANSACTION - BLOCK_HEADER_SIZE};
+
+// framesize_t values of esp32-camera
+struct FrameSizeEntry {
+  const char* name;
+  uint8_t value;
+};
+static const FrameSizeEntry FRAME_SIZES[] = {
+  {"QQVGA", 1}, {"QVGA", 5}, {"VGA", 8}, {"SVGA", 9},
+  {"XGA", 10}, {"HD", 11}, {"SXGA", 12}, {"UXGA", 13}
+};
+
+// Latency histogram with log2 microsecond buckets
+struct Histogram {
+  uint32_t buckets[BENCH_HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+
+  void reset() {
+    memset(this, 0, sizeof(*this));
+    minUs = UINT32_MAX;
+  }
+
+  void add(uint32_t us) {
+    int bucket = 0;
+    while (bucket < BENCH_HISTOGRAM_BUCKETS - 1 && us >= (1UL << bucket)) {
+      bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    sumUs += us;
+    minUs = min(minUs, us);
+    maxUs = max(maxUs, us);
+  }
+
+  // Upper bound of the bucket holding the given fraction of samples
+  uint32_t percentile(float fraction) const {
+    uint32_t target = (uint32_t)(count * fraction);
+    uint32_t seen = 0;
+    for (int i = 0; i < BENCH_HISTOGRAM_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen > target) {
+        return 1UL << i;
+      }
+    }
+    return maxUs;
+  }
+
+  void print(const char* command, uint32_t clock) const {
+    Serial.printf("{\"test\":\"latency\",\"command\":\"%s\",\"clock_hz\":%u,\"samples\":%u,"
+                  "\"min_us\":%u,\"avg_us\":%u,\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"histogram_log2_us\":[",
+                  command, clock, count, count ? minUs : 0, count ? (uint32_t)(sumUs / count) : 0,
+                  percentile(0.5f), percentile(0.99f), maxUs);
+    for (int i = 0; i < BENCH_HISTOGRAM_BUCKETS; i++) {
+      Serial.printf(i ? ",%u" : "%u", buckets[i]);
+    }
+    Serial.println("]}");
+  }
+};
+
+// Counters of one run
+struct RunStats {
+  uint32_t frames;
+  uint64_t bytes;
+  uint32_t crcErrors;
+  uint32_t timeouts;
+};
+
+// Slave side counters from BUFFER_STATUS_RESPONSE
+struct SlaveStatus {
+  uint32_t dropped;
+  uint32_t transactions;
+  uint32_t recoveries;
+};
+
+// Header of CAMERA_DATA_RESPONSE
+struct FrameInfo {
+  uint16_t totalBlocks;
+  uint16_t blockSize;
+  uint32_t length;
+  uint32_t crc;
+  uint32_t sequence;
+};
+
+SPIClass spi(VSPI);
+uint32_t spiClock = BENCH_DEFAULT_CLOCK;
+uint8_t* txBuffer = nullptr;
+uint8_t* rxBuffer = nullptr;
+size_t blockTransactionLength = BENCH_MAX_TRANSACTION;
+uint32_t lastSequence = 0;
+uint8_t pingTag = 0;
+
+Histogram pingLatency;
+Histogram frameLatency;
+Histogram blockLatency;
+
+uint32_t readUint32(const uint8_t* data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+// Clock one transaction, txBuffer goes out and rxBuffer holds the slave's response
+void transfer(size_t length) {
+  spi.beginTransaction(SPISettings(spiClock, MSBFIRST, SPI_MODE1));
+  digitalWrite(BENCH_CS_PIN, LOW);
+  spi.transferBytes(txBuffer, rxBuffer, length);
+  digitalWrite(BENCH_CS_PIN, HIGH);
+  spi.endTransaction();
+  delayMicroseconds(BENCH_GAP_US);
+}
+
+// Send a command in a control transaction
+void sendCommand(const uint8_t* command, size_t length) {
+  memset(txBuffer, 0, BENCH_CONTROL_LENGTH);
+  memcpy(txBuffer, command, length);
+  transfer(max(length, (size_t)BENCH_CONTROL_LENGTH));
+  memset(txBuffer, 0, BENCH_MAX_TRANSACTION);  // NOP from now on
+}
+
+// Poll with short NOP transactions until the response matches, then clock it out in full
+// The slave keeps the staged response in every queued slot, so the full read sees it again
+typedef bool (*ResponseMatcher)(const uint8_t* response, uint32_t arg);
+
+uint32_t waitForResponse(ResponseMatcher matcher, uint32_t arg, size_t responseLength, uint32_t startUs) {
+  while (micros() - startUs < BENCH_RESPONSE_TIMEOUT_US) {
+    delayMicroseconds(BENCH_POLL_INTERVAL_US);
+    transfer(BENCH_CONTROL_LENGTH);
+    if (rxBuffer[0] == CMD_NACK || matcher(rxBuffer, arg)) {
+      uint32_t latency = max(micros() - startUs, 1UL);
+      if (responseLength > BENCH_CONTROL_LENGTH && rxBuffer[0] != CMD_NACK) {
+        transfer(responseLength);
+      }
+      return latency;
+    }
+  }
+  return 0;
+}
+
+bool matchPong(const uint8_t* response, uint32_t tag) {
+  return response[0] == CMD_PONG && response[1] == tag;
+}
+
+bool matchAck(const uint8_t* response, uint32_t command) {
+  return response[0] == CMD_ACK && response[1] == command;
+}
+
+bool matchCommand(const uint8_t* response, uint32_t command) {
+  return response[0] == command;
+}
+
+bool matchNewFrame(const uint8_t* response, uint32_t previousSequence) {
+  return response[0] == CMD_CAMERA_DATA_RESPONSE && readUint32(response + 18) != previousSequence;
+}
+
+bool matchBlock(const uint8_t* response, uint32_t blockIndex) {
+  return response[0] == CMD_CAMERA_DATA_BLOCK_RESPONSE && (uint32_t)((response[1] << 8) | response[2]) == blockIndex;
+}
+
+// Send a command and wait for the matching response, false on timeout or NACK
+bool exchange(const uint8_t* command, size_t length, ResponseMatcher matcher, uint32_t arg,
+              size_t responseLength, Histogram* latency = nullptr) {
+  uint32_t start = micros();
+  sendCommand(command, length);
+  uint32_t us = waitForResponse(matcher, arg, responseLength, start);
+  if (us == 0 || rxBuffer[0] == CMD_NACK) {
+    return false;
+  }
+  if (latency) {
+    latency->add(us);
+  }
+  return true;
+}
+
+// Clock out the transactions the slave queued before a change
+void flushSlave() {
+  for (int i = 0; i < SLAVE_TRANSACTION_SLOTS; i++) {
+    transfer(BENCH_CONTROL_LENGTH);
+  }
+}
+
+bool readSlaveStatus(SlaveStatus& status) {
+  uint8_t command[1] = {CMD_BUFFER_STATUS_REQUEST};
+  if (!exchange(command, sizeof(command), matchCommand, CMD_BUFFER_STATUS_RESPONSE, BENCH_CONTROL_LENGTH)) {
+    return false;
+  }
+  status.dropped = readUint32(rxBuffer + 3);
+  status.transactions = readUint32(rxBuffer + 7);
+  status.recoveries = readUint32(rxBuffer + 11);
+  return true;
+}
+
+bool setTransferParams(uint16_t blockSize) {
+  size_t transactionLength = (blockSize + BLOCK_HEADER_SIZE + 3) & ~3;
+  uint8_t command[5] = {
+    CMD_SET_TRANSFER_PARAMS,
+    (uint8_t)(blockSize >> 8), (uint8_t)blockSize,
+    (uint8_t)(transactionLength >> 8), (uint8_t)transactionLength
+  };
+  if (!exchange(command, sizeof(command), matchCommand, CMD_TRANSFER_PARAMS_RESPONSE, BENCH_CONTROL_LENGTH)) {
+    return false;
+  }
+  blockTransactionLength = (rxBuffer[3] << 8) | rxBuffer[4];
+  flushSlave();
+  return true;
+}
+
+bool setFrameSize(uint8_t frameSize) {
+  uint8_t command[2] = {CMD_BENCH_SET_FRAMESIZE, frameSize};
+  return exchange(command, sizeof(command), matchAck, CMD_BENCH_SET_FRAMESIZE, BENCH_CONTROL_LENGTH);
+}
+
+bool parseFrameHeader(const uint8_t* response, FrameInfo& frame) {
+  if (response[0] != CMD_CAMERA_DATA_RESPONSE) {
+    return false;
+  }
+  frame.totalBlocks = (response[6] << 8) | response[7];
+  frame.blockSize = (response[8] << 8) | response[9];
+  frame.length = readUint32(response + 10);
+  frame.crc = readUint32(response + 14);
+  frame.sequence = readUint32(response + 18);
+  return true;
+}
+
+// Check a block response, returns its data length or -1 if the CRC doesn't match
+int checkBlock(const uint8_t* response) {
+  size_t length = (response[3] << 8) | response[4];
+  if (length > blockTransactionLength - BLOCK_HEADER_SIZE) {
+    return -1;
+  }
+  uint32_t crc = esp_crc32_le(0, response + BLOCK_HEADER_SIZE, length);
+  return crc == readUint32(response + 5) ? (int)length : -1;
+}
+
+// Fetch one frame with request/response commands
+bool fetchFrame(RunStats& stats) {
+  uint8_t request[1] = {CMD_CAMERA_DATA_REQUEST};
+  if (!exchange(request, sizeof(request), matchNewFrame, lastSequence, FRAME_HEADER_SIZE, &frameLatency)) {
+    stats.timeouts++;
+    return false;
+  }
+
+  FrameInfo frame;
+  parseFrameHeader(rxBuffer, frame);
+  lastSequence = frame.sequence;
+
+  for (uint16_t block = 0; block < frame.totalBlocks; block++) {
+    uint8_t blockRequest[3] = {CMD_CAMERA_DATA_BLOCK_REQUEST, (uint8_t)(block >> 8), (uint8_t)block};
+    if (!exchange(blockRequest, sizeof(blockRequest), matchBlock, block, blockTransactionLength, &blockLatency)) {
+      stats.timeouts++;
+      return false;
+    }
+
+    int length = checkBlock(rxBuffer);
+    if (length < 0) {
+      stats.crcErrors++;
+      continue;
+    }
+    stats.bytes += length;
+  }
+
+  stats.frames++;
+  return true;
+}
+
+// Receive frames pushed by the slave, the handshake says when a transaction holds stream data
+uint32_t streamFrames(RunStats& stats, uint32_t durationMs) {
+  uint8_t start[1] = {CMD_STREAM_START};
+  if (!exchange(start, sizeof(start), matchAck, CMD_STREAM_START, BENCH_CONTROL_LENGTH)) {
+    return 0;
+  }
+
+  uint32_t begin = millis();
+  uint16_t expectedBlocks = 0;
+  uint16_t receivedBlocks = 0;
+  while (millis() - begin < durationMs) {
+    uint32_t waitStart = micros();
+    while (!digitalRead(BENCH_HANDSHAKE_PIN) && micros() - waitStart < BENCH_RESPONSE_TIMEOUT_US) {
+    }
+    if (!digitalRead(BENCH_HANDSHAKE_PIN)) {
+      stats.timeouts++;
+      continue;
+    }
+
+    transfer(blockTransactionLength);
+    FrameInfo frame;
+    if (parseFrameHeader(rxBuffer, frame)) {
+      expectedBlocks = frame.totalBlocks;
+      receivedBlocks = 0;
+    } else if (rxBuffer[0] == CMD_CAMERA_DATA_BLOCK_RESPONSE) {
+      int length = checkBlock(rxBuffer);
+      if (length < 0) {
+        stats.crcErrors++;
+      } else {
+        stats.bytes += length;
+      }
+      if (++receivedBlocks == expectedBlocks) {
+        stats.frames++;
+      }
+    }
+  }
+
+  uint8_t stop[1] = {CMD_STREAM_STOP};
+  exchange(stop, sizeof(stop), matchAck, CMD_STREAM_STOP, BENCH_CONTROL_LENGTH);
+  flushSlave();
+  return millis() - begin;
+}
+
+void printRun(const char* mode, uint16_t blockSize, uint32_t elapsedMs, const RunStats& stats,
+              const SlaveStatus& before, const SlaveStatus& after) {
+  float seconds = elapsedMs / 1000.0f;
+  uint32_t transactions = after.transactions - before.transactions;
+  Serial.printf("{\"test\":\"throughput\",\"mode\":\"%s\",\"clock_hz\":%u,\"block_size\":%u,"
+                "\"duration_ms\":%u,\"frames\":%u,\"bytes\":%llu,\"mb_per_s\":%.3f,\"fps\":%.2f,"
+                "\"crc_errors\":%u,\"timeouts\":%u,\"slave_transactions\":%u,\"slave_drops\":%u,"
+                "\"slave_recoveries\":%u,\"drop_rate\":%.6f}\n",
+                mode, spiClock, blockSize, elapsedMs, stats.frames, stats.bytes,
+                seconds > 0 ? stats.bytes / seconds / 1e6f : 0.0f, seconds > 0 ? stats.frames / seconds : 0.0f,
+                stats.crcErrors, stats.timeouts, transactions, after.dropped - before.dropped,
+                after.recoveries - before.recoveries,
+                transactions ? (float)(after.dropped - before.dropped) / transactions : 0.0f);
+}
+
+void runLatency() {
+  pingLatency.reset();
+  frameLatency.reset();
+  blockLatency.reset();
+
+  for (int i = 0; i < BENCH_LATENCY_SAMPLES; i++) {
+    uint8_t ping[2] = {CMD_PING, ++pingTag};
+    exchange(ping, sizeof(ping), matchPong, pingTag, BENCH_CONTROL_LENGTH, &pingLatency);
+  }
+
+  RunStats stats = {};
+  for (int i = 0; i < BENCH_LATENCY_SAMPLES / 10; i++) {
+    fetchFrame(stats);
+  }
+
+  pingLatency.print("PING", spiClock);
+  frameLatency.print("CAMERA_DATA_REQUEST", spiClock);
+  blockLatency.print("CAMERA_DATA_BLOCK_REQUEST", spiClock);
+}
+
+void runThroughput(uint16_t blockSize) {
+  SlaveStatus before = {};
+  SlaveStatus after = {};
+
+  // Request/response
+  RunStats stats = {};
+  readSlaveStatus(before);
+  uint32_t begin = millis();
+  while (millis() - begin < BENCH_DURATION_MS) {
+    fetchFrame(stats);
+  }
+  uint32_t elapsed = millis() - begin;
+  readSlaveStatus(after);
+  printRun("request", blockSize, elapsed, stats, before, after);
+
+  // Streaming
+  if (BENCH_HANDSHAKE_PIN >= 0) {
+    stats = {};
+    readSlaveStatus(before);
+    elapsed = streamFrames(stats, BENCH_DURATION_MS);
+    readSlaveStatus(after);
+    printRun("stream", blockSize, elapsed, stats, before, after);
+  }
+}
+
+void runFrameSizes() {
+  for (const FrameSizeEntry& entry : FRAME_SIZES) {
+    if (!setFrameSize(entry.value)) {
+      Serial.printf("{\"test\":\"framesize\",\"framesize\":\"%s\",\"error\":\"not supported\"}\n", entry.name);
+      continue;
+    }
+
+    // Frames captured before the change still have the old size
+    RunStats warmup = {};
+    delay(500);
+    fetchFrame(warmup);
+    fetchFrame(warmup);
+
+    RunStats stats = {};
+    uint32_t begin = millis();
+    while (millis() - begin < BENCH_FRAMESIZE_DURATION_MS) {
+      fetchFrame(stats);
+    }
+    uint32_t elapsed = millis() - begin;
+
+    Serial.printf("{\"test\":\"framesize\",\"framesize\":\"%s\",\"clock_hz\":%u,\"frames\":%u,"
+                  "\"fps\":%.2f,\"avg_frame_bytes\":%u,\"mb_per_s\":%.3f,\"crc_errors\":%u,\"timeouts\":%u}\n",
+                  entry.name, spiClock, stats.frames, stats.frames * 1000.0f / elapsed,
+                  stats.frames ? (uint32_t)(stats.bytes / stats.frames) : 0,
+                  stats.bytes * 1000.0f / elapsed / 1e6f, stats.crcErrors, stats.timeouts);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  pinMode(BENCH_CS_PIN, OUTPUT);
+  digitalWrite(BENCH_CS_PIN, HIGH);
+  if (BENCH_HANDSHAKE_PIN >= 0) {
+    pinMode(BENCH_HANDSHAKE_PIN, INPUT);
+  }
+  spi.begin(BENCH_SCK_PIN, BENCH_MISO_PIN, BENCH_MOSI_PIN, -1);
+
+  txBuffer = (uint8_t*)heap_caps_malloc(BENCH_MAX_TRANSACTION, MALLOC_CAP_DMA);
+  rxBuffer = (uint8_t*)heap_caps_malloc(BENCH_MAX_TRANSACTION, MALLOC_CAP_DMA);
+  if (!txBuffer || !rxBuffer) {
+    Serial.println("{\"test\":\"setup\",\"error\":\"out of memory\"}");
+    return;
+  }
+  memset(txBuffer, 0, BENCH_MAX_TRANSACTION);
+
+  // Wait for the slave to answer
+  uint8_t ping[2] = {CMD_PING, ++pingTag};
+  while (!exchange(ping, sizeof(ping), matchPong, pingTag, BENCH_CONTROL_LENGTH)) {
+    delay(500);
+    ping[1] = ++pingTag;
+  }
+  Serial.println("{\"test\":\"setup\",\"slave\":\"ready\"}");
+
+  setTransferParams(BLOCK_SIZES[0]);
+  runLatency();
+
+  for (uint32_t clock : CLOCKS) {
+    spiClock = clock;
+    for (uint16_t blockSize : BLOCK_SIZES) {
+      if (!setTransferParams(blockSize)) {
+        Serial.printf("{\"test\":\"throughput\",\"clock_hz\":%u,\"block_size\":%u,\"error\":\"no response\"}\n",
+                      spiClock, blockSize);
+        continue;
+      }
+      runThroughput(blockSize);
+    }
+    runLatency();
+  }
+
+  spiClock = BENCH_DEFAULT_CLOCK;
+  setTransferParams(BLOCK_SIZES[sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0]) - 1]);
+  runFrameSizes();
+
+  Serial.println("{\"test\":\"done\"}");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -10,7 +10,6 @@
 #define SPI_MOSI_PIN (int)15
 #define SPI_ESP32_SS (int)14
 #define SPI_DMA_CHANNEL SPI_DMA_CH_AUTO
-#define SPI_BUFFER_SIZE 8096
 #define SPI_ACTIVITY_LED_PIN (int)2  // Onboard LED on most ESP32 boards
 
 // Camera configuration
@@ -18,10 +17,11 @@
 #define CAMERA_FRAME_SIZE FRAMESIZE_QVGA
 #define CAMERA_QUALITY 12
 #define CAMERA_FPS 15
+#define CAMERA_XCLK_FREQ_HZ 25000000
 
 // Health check configuration
 #define HEALTH_CHECK_ENABLED true
-#define HEALTH_CHECK_INTERVAL 10000  // milliseconds
+#define HEALTH_CHECK_INTERVAL 10000  // milliseconds, checks without an interval of their own
 
 // Miscellaneous
 #define SERIAL_BAUD_RATE 115200
@@ -38,12 +38,177 @@
 #define CAMERA_FRAME_SIZE FRAMESIZE_VGA
 #define CAMERA_QUALITY 12
 #define CAMERA_FPS 15
+#define CAMERA_XCLK_FREQ_HZ 25000000
 
 // Health check configuration
 #define HEALTH_CHECK_ENABLED true
-#define HEALTH_CHECK_INTERVAL 10000  // milliseconds
+#define HEALTH_CHECK_INTERVAL 10000  // milliseconds, checks without an interval of their own
 
 // Miscellaneous
 #define SERIAL_BAUD_RATE 115200
 #define DEBUG_ENABLED true
-#endif
\ No newline at end of file
+#endif
+
+// SPI transaction buffers
+// Size of every DMA buffer and the longest transaction the master can negotiate with
+// SET_TRANSFER_PARAMS, must be a multiple of 4 for DMA
+#ifndef SPI_BUFFER_SIZE
+#define SPI_BUFFER_SIZE 8192
+#endif
+
+// Camera frame transfer
+// When enabled the captured camera_fb_t is held for the whole transfer and block
+// responses are built straight from fb->buf instead of a heap copy of the frame.
+// The frame buffer goes back to the driver once the master ACKs the last block.
+#ifndef CAMERA_ZERO_COPY
+#define CAMERA_ZERO_COPY false
+#endif
+
+// SPI protocol task
+// Runs the SPI protocol on its own FreeRTOS task pinned to SPI_PROTOCOL_TASK_CORE instead of
+// polling from loop(). The task is woken by the SPI ISR for every received packet.
+#ifndef SPI_PROTOCOL_TASK_ENABLED
+#define SPI_PROTOCOL_TASK_ENABLED false
+#endif
+#ifndef SPI_PROTOCOL_TASK_CORE
+#define SPI_PROTOCOL_TASK_CORE 0       // loop() runs on core 1
+#endif
+#ifndef SPI_PROTOCOL_TASK_PRIORITY
+#define SPI_PROTOCOL_TASK_PRIORITY 10
+#endif
+
+// Camera capture pipeline
+// Captures the next frame on its own task while the current one is transferred, so a
+// CAMERA_DATA_REQUEST only swaps in a frame that is already there
+#ifndef CAMERA_CAPTURE_PIPELINE
+#define CAMERA_CAPTURE_PIPELINE true
+#endif
+#ifndef CAMERA_CAPTURE_TASK_CORE
+#define CAMERA_CAPTURE_TASK_CORE 1     // Opposite of SPI_PROTOCOL_TASK_CORE
+#endif
+#define CAMERA_CAPTURE_TASK_PRIORITY 5
+#define CAMERA_CAPTURE_TIMEOUT_MS 1000 // Longest a request waits for a frame in progress
+#define CAMERA_DOWN_RETRY_MS 200       // Capture task poll interval while a failed restart left the camera down
+#define CAMERA_FAILURE_LOG_MS 5000     // Capture failures are logged at most this often
+
+// Staged boot
+// SPI comes up first and answers camera commands with NOT_READY while the camera is
+// initialized on its own task, so the master can talk to the slave right after reset
+#ifndef CAMERA_INIT_DEFERRED
+#define CAMERA_INIT_DEFERRED true
+#endif
+#ifndef CAMERA_INIT_TASK_CORE
+#define CAMERA_INIT_TASK_CORE 0        // Opposite of loop()
+#endif
+
+// Camera frame ring
+// Number of frames kept in PSRAM for CAMERA_FRAME_FETCH, 0 to disable. With the capture
+// pipeline the camera keeps capturing into the ring and the master gets the newest frame.
+// Two frames are held while one is transferred and another fetched, keep at least 4
+// (5 with FRAME_SPOOL_ENABLED, the spool holds the frame it is copying).
+#ifndef CAMERA_FRAME_RING_SIZE
+#define CAMERA_FRAME_RING_SIZE 4
+#endif
+
+// Frame pool
+// Without the frame ring, frame copies and spooled frames are loaded into fixed PSRAM blocks,
+// larger frames are allocated on the heap. The current and the next frame each hold one block.
+#ifndef FRAME_POOL_BLOCKS
+#define FRAME_POOL_BLOCKS 3
+#endif
+#ifndef FRAME_POOL_BLOCK_SIZE
+#define FRAME_POOL_BLOCK_SIZE (64 * 1024)
+#endif
+
+// Change detection
+// Compares every captured frame with the last frame that changed, on a 1/8 scale luma plane
+// the JPEG decoder builds from the DC coefficients. The header of a matching frame carries
+// the sequence number of that frame and streaming sends no blocks for it. CHANGE_DETECT_CONFIG
+// changes both settings at runtime.
+#ifndef CHANGE_DETECT_ENABLED
+#define CHANGE_DETECT_ENABLED false
+#endif
+#ifndef CHANGE_DETECT_THRESHOLD
+#define CHANGE_DETECT_THRESHOLD 3      // Mean luma difference per sample of a changed frame
+#endif
+#define CHANGE_DETECT_REFRESH_MS 10000 // A frame counts as changed at least this often, 0 never
+
+// JPEG quality control
+// With a target the quality is adjusted from frame to frame to keep frames under that many
+// bytes, between CAMERA_QUALITY_BEST and CAMERA_QUALITY_WORST. QUALITY_TARGET sets it at runtime.
+#ifndef CAMERA_QUALITY_TARGET
+#define CAMERA_QUALITY_TARGET 0        // bytes, 0 keeps the profile's quality
+#endif
+#define CAMERA_QUALITY_BEST 6          // Lower values overflow the frame buffers on busy scenes
+#define CAMERA_QUALITY_WORST 40
+
+// Flash frame spool
+// Copies every frame of the ring into an append-only file on SPIFFS so frames the master
+// missed can be replayed with SPOOL_FETCH. Needs the frame ring. The spool fills up and
+// then misses frames until the master sends SPOOL_CONTROL with the clear action.
+#ifndef FRAME_SPOOL_ENABLED
+#define FRAME_SPOOL_ENABLED false
+#endif
+#ifndef FRAME_SPOOL_SEGMENT_SIZE
+#define FRAME_SPOOL_SEGMENT_SIZE (768 * 1024)  // Limited to the free SPIFFS space
+#endif
+#ifndef FRAME_SPOOL_MAX_FRAMES
+#define FRAME_SPOOL_MAX_FRAMES 256
+#endif
+#define FRAME_SPOOL_DIRECTORY "/spool"
+#define FRAME_SPOOL_TASK_CORE 1        // Flash writes stay off the SPI protocol core
+#define FRAME_SPOOL_TASK_PRIORITY 3    // Below the capture task
+
+// Benchmark build
+// Set by the esp32cam-bench environment, adds BENCH_* commands for bench/master and
+// turns per-packet logging down
+#ifndef SPI_BENCHMARK_ENABLED
+#define SPI_BENCHMARK_ENABLED false
+#endif
+
+// Streaming handshake
+// Driven high while a queued transaction holds streamed camera data, -1 to disable.
+// GPIO 2 is free on the ESP32-CAM next to the SPI pins (shared with the onboard LED)
+#ifndef SPI_HANDSHAKE_PIN
+#define SPI_HANDSHAKE_PIN -1
+#endif
+
+// Bulk data channel
+// ESP32-S3 only: a second SPI host runs the spi_slave_hd driver on its own pins, where the
+// master reads frame blocks asked for with BULK_READ_REQUEST using dual or quad I/O.
+// Commands stay on the SPI_* pins. Leave SPI_BULK_DATA2_PIN/DATA3_PIN at -1 for a dual bus.
+// SPI_BULK_HOST must not be the host the command bus runs on (HSPI_HOST).
+#ifndef SPI_BULK_CHANNEL_ENABLED
+#define SPI_BULK_CHANNEL_ENABLED false
+#endif
+#ifndef SPI_BULK_HOST
+#define SPI_BULK_HOST SPI2_HOST
+#endif
+#ifndef SPI_BULK_SCK_PIN
+#define SPI_BULK_SCK_PIN -1
+#endif
+#ifndef SPI_BULK_CS_PIN
+#define SPI_BULK_CS_PIN -1
+#endif
+#ifndef SPI_BULK_DATA0_PIN
+#define SPI_BULK_DATA0_PIN -1
+#endif
+#ifndef SPI_BULK_DATA1_PIN
+#define SPI_BULK_DATA1_PIN -1
+#endif
+#ifndef SPI_BULK_DATA2_PIN
+#define SPI_BULK_DATA2_PIN -1
+#endif
+#ifndef SPI_BULK_DATA3_PIN
+#define SPI_BULK_DATA3_PIN -1
+#endif
+
+// Health checks
+// Each check runs on its own interval, update() in loop() runs at most one due check per call
+#define HEALTH_CHECK_HEAP_INTERVAL 5000      // milliseconds
+#define HEALTH_CHECK_SPI_INTERVAL 2000       // milliseconds
+#define HEALTH_HEAP_WARNING_BYTES 32768      // Free internal heap below this is a warning
+#define HEALTH_HEAP_CRITICAL_BYTES 8192      // and below this critical
+#define HEALTH_CHECK_CPU_BUDGET 10000        // Checks may use 1% of the CPU (per million)
+#define HEALTH_CHECK_TEMPERATURE_INTERVAL 10000 // milliseconds, also refreshes the telemetry value
+#define HEALTH_TEMPERATURE_WARNING 80.0f     // Chip temperature in Celsius
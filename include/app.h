@@ -4,11 +4,19 @@
 #include "Config.h"
 
 #include "lib/Communication/SPISlaveHandler.h"
+#include "lib/Communication/SPIBulkChannel.h"
 #include "lib/Sensors/Camera.h"
+#include "lib/Sensors/ChangeDetector.h"
+#include "lib/Sensors/FrameRing.h"
+#include "lib/Sensors/FrameSpool.h"
+#include "lib/Sensors/FrameEncoder.h"
+#include "lib/Sensors/QualityController.h"
 #include "lib/Sensors/TemperatureSensor.h"
 #include "lib/Utils/FileManager.h"
 #include "lib/Utils/HealthCheck.h"
+#include "lib/Utils/Histogram.h"
 #include "lib/Utils/Logger.h"
+#include "lib/Utils/Memory.h"
 #include "lib/Utils/SpiAllocator.h"
 #include "lib/Utils/I2CScanner.h"
 #include "lib/Utils/I2CManager.h"
@@ -25,27 +33,116 @@ struct CameraFrame {
   uint16_t blockSize;      // Size of each block in bytes
   bool isValid;            // Flag indicating if the frame data is valid
   uint32_t captureTime;    // Timestamp of when the frame was captured
+  uint32_t crc;            // CRC32 of the whole frame data
+  uint32_t sequence;       // Sequence number, increases with every captured frame
   camera_fb_t* frameBuffer; // Original camera frame buffer (if still needed)
+  const Sensors::FrameSlot* ringSlot; // Frame ring slot holding the data (if any)
+  uint8_t kind;            // FRAME_KIND_*, what the data holds
+  uint32_t unchangedSince; // Sequence of the last changed frame this one matches, 0 if it changed
+  uint8_t quality;         // JPEG quality the frame was compressed with, 0 if unknown
+  Sensors::FrameTimestamps timestamps; // esp_timer times of the capture and transfer stages
 };
 
+// What a CameraFrame holds, sent in byte 26 of the frame header
+#define FRAME_KIND_FULL 0     // The frame as captured
+#define FRAME_KIND_PREVIEW 1  // Downscaled copy of a captured frame
+#define FRAME_KIND_REGION 2   // Cropped part of a captured frame
+
+// Flags in byte 27 of the frame header
+#define FRAME_FLAG_BLOCKS_SKIPPED 0x01 // Streaming sends no blocks, the frame matches one already streamed
+
+// Sizes of the frame and block response headers
+#define FRAME_HEADER_SIZE 52
+#define BLOCK_HEADER_SIZE 9
+
+// Smallest block size SET_TRANSFER_PARAMS accepts, block indices are 16 bits so blocks this size cover 4 MB
+#define MIN_BLOCK_SIZE 64
+#define MAX_FRAME_BLOCKS 0xFFFF
+
+// CAMERA_DATA_MULTI_BLOCK_RESPONSE: command, start block(2), count, then count block responses
+#define MULTI_BLOCK_HEADER_SIZE 4
+#define MULTI_BLOCK_MAX_COUNT 16
+
+// TELEMETRY_RESPONSE: 46 bytes of counters, 6 histograms, then 20 bytes of memory accounting
+#define TELEMETRY_VERSION 3
+#define TELEMETRY_HEADER_SIZE 46
+#define TELEMETRY_MEMORY_SIZE 20
+#define TELEMETRY_RESPONSE_SIZE (TELEMETRY_HEADER_SIZE + 6 * Utils::Histogram::SERIALIZED_SIZE + TELEMETRY_MEMORY_SIZE)
+#define TELEMETRY_TEMPERATURE_UNAVAILABLE ((int16_t)0x8000)
+
+// Shortest transaction SET_TRANSFER_PARAMS accepts, the telemetry record is the longest control response
+#define MIN_TRANSFER_LENGTH ((TELEMETRY_RESPONSE_SIZE + 3) & ~3)
+
+// CAMERA_CONFIG preset index of settings given in the command itself
+#define CAMERA_PROFILE_CUSTOM 0xFF
+
+// Block index of a CAMERA_DATA_BLOCK_REQUEST asking for the next block reported by BLOCK_NACK_BITMAP
+#define RETRANSMIT_NEXT_BLOCK 0xFFFF
+
 // Global camera frame variable
 extern CameraFrame cameraFrame;
 
 extern Communication::SPISlaveHandler* spiSlaveHandler;
+extern Communication::SPIBulkChannel* bulkChannel;
 extern Sensors::Camera* camera;
+extern Sensors::ChangeDetector* changeDetector;
+extern Sensors::QualityController* qualityController;
 extern Sensors::TemperatureSensor* temperatureSensor;
 extern Utils::FileManager* fileManager;
 extern Utils::Logger* logger;
 extern Utils::CommandMapper* commandMapper;
+extern Utils::HealthCheck* healthCheck;
+extern Sensors::FrameRing* frameRing;
+extern Sensors::FrameSpool* frameSpool;
+extern Utils::BlockPool* framePool;
 
 // Task handles
 extern TaskHandle_t cameraStreamTaskHandle;
 
 // Function prototypes
 void setupSPISlaveCommunication();
+void runCameraInit();
+bool isBootCommand(uint8_t command);
 void initializeCameraFrame();
+uint8_t* allocateFrameData(size_t length);
+void releaseFrameData(uint8_t* data);
 void releaseCameraFrame();
+void releaseCameraFrame(CameraFrame& frame);
 bool captureCameraFrame();
+bool captureCameraFrame(CameraFrame& frame);
+uint32_t captureIntoFrameRing();
+uint32_t detectFrameChange(const uint8_t* data, size_t length, uint16_t width, uint16_t height);
+void commitFrameChange(uint32_t sequence, uint32_t unchangedSince);
+void adjustFrameQuality(size_t length);
+void beginFrameTimestamps(Sensors::FrameTimestamps& timestamps, const camera_fb_t* fb);
+void noteBlockStaged(uint16_t blockIndex, bool streaming);
+void completeFrameTiming(int64_t sentTime);
+bool loadRingFrame(CameraFrame& frame, uint32_t sequence);
+bool loadSpooledFrame(CameraFrame& frame, const Sensors::SpoolEntry& entry);
+bool startFrameSpool();
+bool acquireSourceFrame(uint32_t sequence, CameraFrame& source);
+void releaseSourceFrame(CameraFrame& source);
+void loadEncodedFrame(uint8_t* data, size_t length, uint16_t width, uint16_t height,
+                      uint32_t sequence, uint32_t captureTime, uint8_t kind, uint8_t quality);
+bool startCameraPipeline();
+bool pauseCameraCapture();
+void resumeCameraCapture();
+bool applyCameraProfile(const Sensors::CameraProfile& profile);
+bool waitForNextCameraFrame(TickType_t ticksToWait);
+void swapInNextCameraFrame();
+bool takeNextCameraFrame();
 bool isCameraFrameValid();
+size_t writeFrameHeader(uint8_t* buffer, uint8_t flags = 0);
+size_t writeBlockHeader(uint8_t* buffer, uint16_t blockIndex, const uint8_t* blockData, size_t dataLength);
+size_t getBlockLength(uint16_t blockIndex, size_t& startOffset);
+void clearRetransmitRequest();
+bool nextRetransmitBlock(uint16_t& blockIndex);
+bool prepareBlockResponse(uint16_t blockIndex, uint16_t headerIndex);
+uint8_t prepareMultiBlockResponse(uint16_t startBlock, uint8_t maxCount);
+size_t fillStreamTransaction(uint8_t* buffer, size_t capacity);
+size_t fillBulkSegment(uint8_t* buffer, size_t capacity);
+void registerCommandHandlers();
+void setupHealthChecks();
+size_t writeTelemetry(uint8_t* buffer);
 
 #endif
\ No newline at end of file